@@ -0,0 +1,867 @@
+// Python bindings for the field solver, built by make python into build/fieldsim*.so.
+//
+// arrays are shared with the C++ side, never copied. a ChargeSet's x, y, z and q and a
+// FieldGrid's magnitude and direction are float32 buffers over the C++ vectors
+// themselves, so numpy.asarray on them gives views that read and write the solver's own
+// storage, and probe queries read points from and write fields to the caller's arrays.
+// storage can't move while anything holds a view of it: resizing then raises BufferError.
+//
+// solves release the GIL, so Python threads can run other work, or solves on other
+// objects, alongside them. every grid and probe has its own thread pool and one solve
+// at a time, a second one while it's busy raises RuntimeError.
+//
+//   import numpy as np, fieldsim
+//   charges = fieldsim.ChargeSet(1000)
+//   np.asarray(charges.x)[:] = np.random.uniform(0, 200, 1000)    # in place
+//   grid = fieldsim.FieldGrid((64, 64, 64), (0, 0, 0), 200 / 63)
+//   grid.evaluate(charges, theta=0.5)
+//   magnitude = np.asarray(grid.magnitude)                        # shape (z, y, x)
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "charges.h"
+#include "chargeTree.h"
+#include "field.h"
+#include "probe.h"
+#include "scene.h"
+#include "threadPool.h"
+
+namespace
+{
+
+// the head of every object that hands out views of its storage: how many views are held
+// and how many solves are using it with the GIL released
+struct Shared
+{
+    PyObject_HEAD
+    Py_ssize_t exports;
+    int busy;
+};
+
+struct ChargeSetObject
+{
+    Shared shared;
+    ChargeSet *charges;
+};
+
+struct FieldGridObject
+{
+    Shared shared;
+    FieldGrid *grid;
+    ThreadPool *pool;
+};
+
+struct ProbeObject
+{
+    Shared shared;
+    FieldProbe *probe;
+    ThreadPool *pool;
+};
+
+// one array of an owner, exported through the buffer protocol
+struct ArrayObject
+{
+    PyObject_HEAD
+    PyObject *owner;
+    int field;
+    Py_ssize_t shape[4];
+    Py_ssize_t strides[4];
+};
+
+PyTypeObject *chargeSetType = nullptr;
+PyTypeObject *fieldGridType = nullptr;
+PyTypeObject *probeType = nullptr;
+PyTypeObject *arrayType = nullptr;
+
+enum Field
+{
+    CHARGE_X,
+    CHARGE_Y,
+    CHARGE_Z,
+    CHARGE_Q,
+    GRID_MAGNITUDE,
+    GRID_DIRECTION
+};
+
+// where an array lives right now and its C order shape
+float *describe(ArrayObject *array, int &ndim)
+{
+    if (array->field <= CHARGE_Q)
+    {
+        ChargeSet &charges = *((ChargeSetObject *)array->owner)->charges;
+        std::vector<float> *vectors[4] = {&charges.x, &charges.y, &charges.z, &charges.q};
+        std::vector<float> &v = *vectors[array->field];
+        ndim = 1;
+        array->shape[0] = v.size();
+        return v.data();
+    }
+
+    FieldGrid &grid = *((FieldGridObject *)array->owner)->grid;
+    ndim = array->field == GRID_MAGNITUDE ? 3 : 4;
+    array->shape[0] = grid.dims.z;
+    array->shape[1] = grid.dims.y;
+    array->shape[2] = grid.dims.x;
+    array->shape[3] = 3;
+    // glm::vec3 is three packed floats
+    return array->field == GRID_MAGNITUDE ? grid.magnitude.data() : (float *)grid.direction.data();
+}
+
+int arrayGetBuffer(PyObject *self, Py_buffer *view, int flags)
+{
+    ArrayObject *array = (ArrayObject *)self;
+    int ndim;
+    float *data = describe(array, ndim);
+
+    Py_ssize_t stride = sizeof(float);
+    Py_ssize_t count = 1;
+    for (int d = ndim - 1; d >= 0; d--)
+    {
+        array->strides[d] = stride;
+        stride *= array->shape[d];
+        count *= array->shape[d];
+    }
+
+    view->buf = data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = count * sizeof(float);
+    view->readonly = 0;
+    view->itemsize = sizeof(float);
+    view->format = (flags & PyBUF_FORMAT) ? (char *)"f" : nullptr;
+    view->ndim = ndim;
+    view->shape = (flags & PyBUF_ND) ? array->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? array->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+
+    ((Shared *)array->owner)->exports++;
+    return 0;
+}
+
+void arrayReleaseBuffer(PyObject *self, Py_buffer *)
+{
+    ((Shared *)((ArrayObject *)self)->owner)->exports--;
+}
+
+void arrayDealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    Py_XDECREF(((ArrayObject *)self)->owner);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+// a memoryview of one of owner's arrays
+PyObject *arrayView(PyObject *owner, int field)
+{
+    ArrayObject *array = PyObject_New(ArrayObject, arrayType);
+    if (!array)
+    {
+        return nullptr;
+    }
+    Py_INCREF(owner);
+    array->owner = owner;
+    array->field = field;
+    PyObject *view = PyMemoryView_FromObject((PyObject *)array);
+    Py_DECREF(array);
+    return view;
+}
+
+// storage can only be reallocated when nothing can see or is using it
+bool checkMovable(Shared *shared)
+{
+    if (shared->exports > 0 || shared->busy > 0)
+    {
+        PyErr_SetString(PyExc_BufferError, "can't resize while a view or a solve is using the arrays");
+        return false;
+    }
+    return true;
+}
+
+bool startSolve(Shared *shared)
+{
+    if (shared->busy > 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "a solve is already running on this object");
+        return false;
+    }
+    return true;
+}
+
+// C++ errors caught with the GIL released, raised once it's back
+struct SolveError
+{
+    PyObject *type = nullptr;
+    std::string message;
+
+    void capture()
+    {
+        try
+        {
+            throw;
+        }
+        catch (const std::bad_alloc &)
+        {
+            type = PyExc_MemoryError;
+            message = "out of memory";
+        }
+        catch (const std::exception &e)
+        {
+            type = PyExc_RuntimeError;
+            message = e.what();
+        }
+    }
+
+    bool raise() const
+    {
+        if (type)
+        {
+            PyErr_SetString(type, message.c_str());
+        }
+        return type != nullptr;
+    }
+};
+
+bool parseVec3(PyObject *object, glm::vec3 &out)
+{
+    return PyArg_ParseTuple(object, "fff", &out.x, &out.y, &out.z) != 0;
+}
+
+bool parseGridShape(PyObject *dims, PyObject *origin, float spacing, glm::ivec3 &gridDims, glm::vec3 &gridOrigin)
+{
+    if (!PyArg_ParseTuple(dims, "iii", &gridDims.x, &gridDims.y, &gridDims.z) || !parseVec3(origin, gridOrigin))
+    {
+        return false;
+    }
+    if (gridDims.x < 2 || gridDims.y < 2 || gridDims.z < 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "grid dims must be at least 2 along every axis");
+        return false;
+    }
+    if (!std::isfinite(spacing) || spacing <= 0.0f)
+    {
+        PyErr_SetString(PyExc_ValueError, "grid spacing must be positive and finite");
+        return false;
+    }
+    return true;
+}
+
+ChargeSetObject *toChargeSet(PyObject *object)
+{
+    if (!PyObject_TypeCheck(object, chargeSetType))
+    {
+        PyErr_SetString(PyExc_TypeError, "expected a fieldsim.ChargeSet");
+        return nullptr;
+    }
+    return (ChargeSetObject *)object;
+}
+
+// ChargeSet
+
+PyObject *chargeSetNew(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"count", nullptr};
+    Py_ssize_t count = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", (char **)keywords, &count))
+    {
+        return nullptr;
+    }
+    if (count < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "count can't be negative");
+        return nullptr;
+    }
+
+    ChargeSetObject *self = (ChargeSetObject *)type->tp_alloc(type, 0);
+    if (!self)
+    {
+        return nullptr;
+    }
+    try
+    {
+        self->charges = new ChargeSet();
+        self->charges->x.resize(count);
+        self->charges->y.resize(count);
+        self->charges->z.resize(count);
+        self->charges->q.resize(count);
+    }
+    catch (const std::bad_alloc &)
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+void chargeSetDealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete ((ChargeSetObject *)self)->charges;
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+Py_ssize_t chargeSetLength(PyObject *self)
+{
+    return ((ChargeSetObject *)self)->charges->size();
+}
+
+PyObject *chargeSetResize(PyObject *self, PyObject *args)
+{
+    ChargeSetObject *set = (ChargeSetObject *)self;
+    Py_ssize_t count;
+    if (!PyArg_ParseTuple(args, "n", &count) || !checkMovable(&set->shared))
+    {
+        return nullptr;
+    }
+    if (count < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "count can't be negative");
+        return nullptr;
+    }
+    try
+    {
+        set->charges->x.resize(count);
+        set->charges->y.resize(count);
+        set->charges->z.resize(count);
+        set->charges->q.resize(count);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *chargeSetAdd(PyObject *self, PyObject *args)
+{
+    ChargeSetObject *set = (ChargeSetObject *)self;
+    glm::vec3 position;
+    float q;
+    if (!PyArg_ParseTuple(args, "ffff", &position.x, &position.y, &position.z, &q) || !checkMovable(&set->shared))
+    {
+        return nullptr;
+    }
+    set->charges->add(position, q);
+    Py_RETURN_NONE;
+}
+
+PyObject *chargeSetGetX(PyObject *self, void *)
+{
+    return arrayView(self, CHARGE_X);
+}
+
+PyObject *chargeSetGetY(PyObject *self, void *)
+{
+    return arrayView(self, CHARGE_Y);
+}
+
+PyObject *chargeSetGetZ(PyObject *self, void *)
+{
+    return arrayView(self, CHARGE_Z);
+}
+
+PyObject *chargeSetGetQ(PyObject *self, void *)
+{
+    return arrayView(self, CHARGE_Q);
+}
+
+PyMethodDef chargeSetMethods[] = {
+    {"resize", chargeSetResize, METH_VARARGS, "resize(count), new charges are zero"},
+    {"add", chargeSetAdd, METH_VARARGS, "add(x, y, z, q) appends one charge"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef chargeSetGetSet[] = {
+    {(char *)"x", chargeSetGetX, nullptr, (char *)"x coordinates, a writable float32 view", nullptr},
+    {(char *)"y", chargeSetGetY, nullptr, (char *)"y coordinates, a writable float32 view", nullptr},
+    {(char *)"z", chargeSetGetZ, nullptr, (char *)"z coordinates, a writable float32 view", nullptr},
+    {(char *)"q", chargeSetGetQ, nullptr, (char *)"charges, a writable float32 view", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyType_Slot chargeSetSlots[] = {
+    {Py_tp_doc, (void *)"ChargeSet(count=0): point charges as float32 arrays x, y, z and q"},
+    {Py_tp_new, (void *)chargeSetNew},
+    {Py_tp_dealloc, (void *)chargeSetDealloc},
+    {Py_tp_methods, chargeSetMethods},
+    {Py_tp_getset, chargeSetGetSet},
+    {Py_sq_length, (void *)chargeSetLength},
+    {0, nullptr}};
+
+// FieldGrid
+
+PyObject *fieldGridNew(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"dims", "origin", "spacing", "threads", nullptr};
+    PyObject *dims, *origin;
+    float spacing;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOf|i", (char **)keywords, &dims, &origin, &spacing, &threads))
+    {
+        return nullptr;
+    }
+    glm::ivec3 gridDims;
+    glm::vec3 gridOrigin;
+    if (!parseGridShape(dims, origin, spacing, gridDims, gridOrigin))
+    {
+        return nullptr;
+    }
+
+    FieldGridObject *self = (FieldGridObject *)type->tp_alloc(type, 0);
+    if (!self)
+    {
+        return nullptr;
+    }
+    try
+    {
+        self->grid = new FieldGrid(gridDims, gridOrigin, spacing);
+        self->pool = new ThreadPool(threads);
+    }
+    catch (const std::bad_alloc &)
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+void fieldGridDealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete ((FieldGridObject *)self)->grid;
+    delete ((FieldGridObject *)self)->pool;
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+PyObject *fieldGridEvaluate(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"charges", "theta", nullptr};
+    FieldGridObject *grid = (FieldGridObject *)self;
+    PyObject *chargesObject;
+    float theta = 0.0f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|f", (char **)keywords, &chargesObject, &theta))
+    {
+        return nullptr;
+    }
+    ChargeSetObject *charges = toChargeSet(chargesObject);
+    if (!charges || !startSolve(&grid->shared))
+    {
+        return nullptr;
+    }
+
+    // the charges can't be resized under the solve, the grid can't be solved twice at once
+    grid->shared.busy++;
+    charges->shared.busy++;
+    SolveError error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        if (theta > 0.0f)
+        {
+            ChargeTree tree;
+            tree.build(*charges->charges);
+            grid->grid->evaluate(tree, theta, *grid->pool);
+        }
+        else
+        {
+            grid->grid->evaluate(*charges->charges, *grid->pool);
+        }
+    }
+    catch (...)
+    {
+        error.capture();
+    }
+    Py_END_ALLOW_THREADS
+    charges->shared.busy--;
+    grid->shared.busy--;
+
+    if (error.raise())
+    {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject *fieldGridGetMagnitude(PyObject *self, void *)
+{
+    return arrayView(self, GRID_MAGNITUDE);
+}
+
+PyObject *fieldGridGetDirection(PyObject *self, void *)
+{
+    return arrayView(self, GRID_DIRECTION);
+}
+
+PyObject *fieldGridGetDims(PyObject *self, void *)
+{
+    const FieldGrid &grid = *((FieldGridObject *)self)->grid;
+    return Py_BuildValue("(iii)", grid.dims.x, grid.dims.y, grid.dims.z);
+}
+
+PyObject *fieldGridGetOrigin(PyObject *self, void *)
+{
+    const FieldGrid &grid = *((FieldGridObject *)self)->grid;
+    return Py_BuildValue("(fff)", grid.origin.x, grid.origin.y, grid.origin.z);
+}
+
+PyObject *fieldGridGetSpacing(PyObject *self, void *)
+{
+    return PyFloat_FromDouble(((FieldGridObject *)self)->grid->spacing);
+}
+
+PyMethodDef fieldGridMethods[] = {
+    {"evaluate", (PyCFunction)(void (*)(void))fieldGridEvaluate, METH_VARARGS | METH_KEYWORDS,
+     "evaluate(charges, theta=0) solves the field at every sample, exactly or with Barnes-Hut for theta > 0. "
+     "releases the GIL"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef fieldGridGetSet[] = {
+    {(char *)"magnitude", fieldGridGetMagnitude, nullptr, (char *)"field magnitude, float32 view shaped (z, y, x)",
+     nullptr},
+    {(char *)"direction", fieldGridGetDirection, nullptr,
+     (char *)"unit field direction, float32 view shaped (z, y, x, 3)", nullptr},
+    {(char *)"dims", fieldGridGetDims, nullptr, (char *)"samples along x, y and z", nullptr},
+    {(char *)"origin", fieldGridGetOrigin, nullptr, (char *)"position of the first sample", nullptr},
+    {(char *)"spacing", fieldGridGetSpacing, nullptr, (char *)"distance between samples", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyType_Slot fieldGridSlots[] = {
+    {Py_tp_doc, (void *)"FieldGrid(dims, origin, spacing, threads=0): the field sampled on a regular grid"},
+    {Py_tp_new, (void *)fieldGridNew},
+    {Py_tp_dealloc, (void *)fieldGridDealloc},
+    {Py_tp_methods, fieldGridMethods},
+    {Py_tp_getset, fieldGridGetSet},
+    {0, nullptr}};
+
+// Probe
+
+PyObject *probeNew(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"dims", "origin", "spacing", "threads", nullptr};
+    PyObject *dims, *origin;
+    float spacing;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOf|i", (char **)keywords, &dims, &origin, &spacing, &threads))
+    {
+        return nullptr;
+    }
+    glm::ivec3 gridDims;
+    glm::vec3 gridOrigin;
+    if (!parseGridShape(dims, origin, spacing, gridDims, gridOrigin))
+    {
+        return nullptr;
+    }
+
+    ProbeObject *self = (ProbeObject *)type->tp_alloc(type, 0);
+    if (!self)
+    {
+        return nullptr;
+    }
+    try
+    {
+        self->probe = new FieldProbe(gridDims, gridOrigin, spacing);
+        self->pool = new ThreadPool(threads);
+    }
+    catch (const std::bad_alloc &)
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+void probeDealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete ((ProbeObject *)self)->probe;
+    delete ((ProbeObject *)self)->pool;
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+PyObject *probeBuild(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"charges", "tolerance", "cubic", nullptr};
+    ProbeObject *probe = (ProbeObject *)self;
+    PyObject *chargesObject;
+    float tolerance = 1e-3f;
+    int cubic = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|fp", (char **)keywords, &chargesObject, &tolerance, &cubic))
+    {
+        return nullptr;
+    }
+    ChargeSetObject *charges = toChargeSet(chargesObject);
+    if (!charges || !startSolve(&probe->shared))
+    {
+        return nullptr;
+    }
+
+    probe->shared.busy++;
+    charges->shared.busy++;
+    SolveError error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        probe->probe->build(*charges->charges, tolerance, cubic ? FieldProbe::TRICUBIC : FieldProbe::TRILINEAR,
+                            *probe->pool);
+    }
+    catch (...)
+    {
+        error.capture();
+    }
+    Py_END_ALLOW_THREADS
+    charges->shared.busy--;
+    probe->shared.busy--;
+
+    if (error.raise())
+    {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+// a contiguous float32 array of the caller's, checked before it's written or read
+bool getFloatBuffer(PyObject *object, bool writable, const char *name, Py_buffer &view)
+{
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    if (PyObject_GetBuffer(object, &view, flags) != 0)
+    {
+        PyErr_Format(PyExc_TypeError, "%s must be a contiguous%s float32 array", name, writable ? " writable" : "");
+        return false;
+    }
+    const char *format = view.format ? view.format : "B";
+    if (format[0] == '<' || format[0] == '=' || format[0] == '@')
+    {
+        format++;
+    }
+    if (view.itemsize != sizeof(float) || strcmp(format, "f") != 0)
+    {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_TypeError, "%s must be float32", name);
+        return false;
+    }
+    return true;
+}
+
+PyObject *probeQuery(PyObject *self, PyObject *args)
+{
+    ProbeObject *probe = (ProbeObject *)self;
+    PyObject *objects[6];
+    if (!PyArg_ParseTuple(args, "OOOOOO", &objects[0], &objects[1], &objects[2], &objects[3], &objects[4],
+                          &objects[5]) ||
+        !startSolve(&probe->shared))
+    {
+        return nullptr;
+    }
+
+    static const char *names[6] = {"x", "y", "z", "ex", "ey", "ez"};
+    Py_buffer views[6];
+    int got = 0;
+    for (; got < 6; got++)
+    {
+        if (!getFloatBuffer(objects[got], got >= 3, names[got], views[got]))
+        {
+            break;
+        }
+        if (views[got].len != views[0].len)
+        {
+            PyBuffer_Release(&views[got]);
+            PyErr_SetString(PyExc_ValueError, "points and outputs must all be the same length");
+            break;
+        }
+    }
+    if (got < 6)
+    {
+        for (int i = 0; i < got; i++)
+        {
+            PyBuffer_Release(&views[i]);
+        }
+        return nullptr;
+    }
+
+    size_t n = views[0].len / sizeof(float);
+    float *data[6];
+    for (int i = 0; i < 6; i++)
+    {
+        data[i] = (float *)views[i].buf;
+    }
+
+    probe->shared.busy++;
+    ProbeStats stats;
+    SolveError error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        stats = probe->probe->query(data[0], data[1], data[2], n, data[3], data[4], data[5], *probe->pool);
+    }
+    catch (...)
+    {
+        error.capture();
+    }
+    Py_END_ALLOW_THREADS
+    probe->shared.busy--;
+
+    for (int i = 0; i < 6; i++)
+    {
+        PyBuffer_Release(&views[i]);
+    }
+    if (error.raise())
+    {
+        return nullptr;
+    }
+    return Py_BuildValue("(nnd)", (Py_ssize_t)stats.interpolated, (Py_ssize_t)stats.exact, stats.seconds);
+}
+
+PyObject *probeGetTrustedFraction(PyObject *self, void *)
+{
+    return PyFloat_FromDouble(((ProbeObject *)self)->probe->trustedFraction());
+}
+
+PyMethodDef probeMethods[] = {
+    {"build", (PyCFunction)(void (*)(void))probeBuild, METH_VARARGS | METH_KEYWORDS,
+     "build(charges, tolerance=1e-3, cubic=False) caches the field and finds the cells interpolation answers "
+     "within tolerance. releases the GIL"},
+    {"query", probeQuery, METH_VARARGS,
+     "query(x, y, z, ex, ey, ez) writes the field at the points into ex, ey and ez, all contiguous float32 arrays "
+     "of one length. returns (interpolated, exact, seconds). releases the GIL"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef probeGetSet[] = {
+    {(char *)"trusted_fraction", probeGetTrustedFraction, nullptr,
+     (char *)"fraction of the grid's cells answered by interpolation", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyType_Slot probeSlots[] = {
+    {Py_tp_doc, (void *)"Probe(dims, origin, spacing, threads=0): field queries at arbitrary points"},
+    {Py_tp_new, (void *)probeNew},
+    {Py_tp_dealloc, (void *)probeDealloc},
+    {Py_tp_methods, probeMethods},
+    {Py_tp_getset, probeGetSet},
+    {0, nullptr}};
+
+PyType_Slot arraySlots[] = {
+    {Py_tp_doc, (void *)"a float32 array of a ChargeSet or FieldGrid, see the buffer protocol"},
+    {Py_tp_dealloc, (void *)arrayDealloc},
+    {Py_bf_getbuffer, (void *)arrayGetBuffer},
+    {Py_bf_releasebuffer, (void *)arrayReleaseBuffer},
+    {0, nullptr}};
+
+// module functions
+
+PyObject *loadSceneFunction(PyObject *, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"path", "threads", nullptr};
+    const char *path;
+    int threads = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|i", (char **)keywords, &path, &threads))
+    {
+        return nullptr;
+    }
+    ChargeSetObject *set = (ChargeSetObject *)PyObject_CallObject((PyObject *)chargeSetType, nullptr);
+    if (!set)
+    {
+        return nullptr;
+    }
+
+    std::string scenePath = path;
+    SolveError error;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        ThreadPool pool(threads);
+        loadScene(scenePath, *set->charges, pool);
+    }
+    catch (...)
+    {
+        error.capture();
+    }
+    Py_END_ALLOW_THREADS
+
+    if (error.raise())
+    {
+        Py_DECREF(set);
+        return nullptr;
+    }
+    return (PyObject *)set;
+}
+
+PyObject *saveSceneFunction(PyObject *, PyObject *args)
+{
+    const char *path;
+    PyObject *chargesObject;
+    if (!PyArg_ParseTuple(args, "sO", &path, &chargesObject))
+    {
+        return nullptr;
+    }
+    ChargeSetObject *charges = toChargeSet(chargesObject);
+    if (!charges)
+    {
+        return nullptr;
+    }
+    try
+    {
+        saveScene(path, *charges->charges);
+    }
+    catch (const std::exception &e)
+    {
+        PyErr_SetString(PyExc_OSError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyMethodDef moduleMethods[] = {
+    {"load_scene", (PyCFunction)(void (*)(void))loadSceneFunction, METH_VARARGS | METH_KEYWORDS,
+     "load_scene(path, threads=0) reads a scene file into a new ChargeSet"},
+    {"save_scene", saveSceneFunction, METH_VARARGS,
+     "save_scene(path, charges) writes text if the path ends in .txt, binary otherwise"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyModuleDef moduleDef = {PyModuleDef_HEAD_INIT, "fieldsim", "electric field solver", -1, moduleMethods,
+                         nullptr, nullptr, nullptr, nullptr};
+
+PyTypeObject *makeType(PyObject *module, const char *name, const char *qualified, int size, PyType_Slot *slots)
+{
+    PyType_Spec spec = {qualified, size, 0, Py_TPFLAGS_DEFAULT, slots};
+    PyTypeObject *type = (PyTypeObject *)PyType_FromSpec(&spec);
+    if (type && name)
+    {
+        Py_INCREF(type);
+        if (PyModule_AddObject(module, name, (PyObject *)type) != 0)
+        {
+            Py_DECREF(type);
+            Py_DECREF(type);
+            return nullptr;
+        }
+    }
+    return type;
+}
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_fieldsim()
+{
+    PyObject *module = PyModule_Create(&moduleDef);
+    if (!module)
+    {
+        return nullptr;
+    }
+
+    chargeSetType = makeType(module, "ChargeSet", "fieldsim.ChargeSet", sizeof(ChargeSetObject), chargeSetSlots);
+    fieldGridType = makeType(module, "FieldGrid", "fieldsim.FieldGrid", sizeof(FieldGridObject), fieldGridSlots);
+    probeType = makeType(module, "Probe", "fieldsim.Probe", sizeof(ProbeObject), probeSlots);
+    arrayType = makeType(module, nullptr, "fieldsim._Array", sizeof(ArrayObject), arraySlots);
+    if (!chargeSetType || !fieldGridType || !probeType || !arrayType)
+    {
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}
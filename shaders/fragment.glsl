@@ -3,14 +3,30 @@
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
+in float ViewDepth;
+in vec4 ObjColor;
 
-uniform vec4 objColor;
-uniform int activeBlues;
-uniform int activeReds;
-uniform vec3 redPositions[10];
-uniform vec3 bluePositions[10];
+// charges binned into view space clusters on the CPU, see ChargeClusters
+uniform samplerBuffer chargeData;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform int tilesX;
+uniform int tilesY;
+uniform int slices;
+uniform float zNear;
+uniform float zFar;
+uniform float cutoff;
+uniform float screenWidth;
+uniform float screenHeight;
+
+// set when drawing into the weighted blended OIT targets, see WeightedOit
+uniform bool weightedOit;
+
+// the surface's own light, so arrows of a field with no charges nearby still show
+uniform vec3 emissive;
 
 out vec4 outColor;
+out vec4 outReveal;
 
 vec3 computeDiffuse(vec3 color, vec3 pos);
 
@@ -18,21 +34,43 @@ void main()
 {
 	vec3 redColor = vec3(1.0, 0.0, 0.0);
 	vec3 blueColor = vec3(0.0, 0.0, 1.0);
-	vec3 finalColor = vec3(0.0, 0.0, 0.0);
+	vec3 finalColor = emissive;
+
+	// find the cluster this fragment falls in
+	int tileX = clamp(int(gl_FragCoord.x / screenWidth * tilesX), 0, tilesX - 1);
+	int tileY = clamp(int(gl_FragCoord.y / screenHeight * tilesY), 0, tilesY - 1);
+	int slice = clamp(int(log(ViewDepth / zNear) / log(zFar / zNear) * slices), 0, slices - 1);
+	int cluster = (slice * tilesY + tileY) * tilesX + tileX;
+
+	uvec2 range = texelFetch(clusterGrid, cluster).xy;
+
+	for(uint i = 0u; i < range.y; i++)
+	{
+		int index = int(texelFetch(clusterIndices, int(range.x + i)).x);
+		vec4 charge = texelFetch(chargeData, index);
+
+		// fade out towards the cutoff so cluster edges don't show up as seams
+		float dist = distance(charge.xyz, FragPos);
+		float weight = 1.0 - smoothstep(0.8 * cutoff, cutoff, dist);
+		if(weight <= 0.0)
+			continue;
+
+		vec3 color = charge.w > 0.0 ? redColor : blueColor;
+		finalColor += weight * computeDiffuse(color, charge.xyz) * ObjColor.rgb;
+	}
 	
-	for(int i = 0; i < activeReds; i++)
+	if(weightedOit)
 	{
-		vec3 redDiffuse = computeDiffuse(redColor, redPositions[i]);
-		finalColor += redDiffuse * objColor.rgb;
+		// depth weight from McGuire and Bavoil, nearer fragments dominate the average
+		float a = ObjColor.a;
+		float w = a * clamp(0.03 / (1e-5 + pow(ViewDepth / 200.0, 4.0)), 1e-2, 3e3);
+		outColor = vec4(finalColor * a * w, 0.0);
+		outReveal = vec4(a * w, 0.0, 0.0, a);
 	}
-
-	for(int i = 0; i < activeBlues; i++)
+	else
 	{
-		vec3 blueDiffuse = computeDiffuse(blueColor, bluePositions[i]);
-		finalColor += blueDiffuse * objColor.rgb;
+		outColor = vec4(finalColor, ObjColor.a);
 	}
-	
-	outColor = vec4(finalColor, objColor.a);
 }
 
 vec3 computeDiffuse(vec3 color, vec3 pos)
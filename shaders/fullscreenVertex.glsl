@@ -0,0 +1,11 @@
+#version 150 core
+
+out vec2 ndc;
+
+// one triangle covering the whole screen, no vertex buffer needed
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ndc = p * 2.0 - 1.0;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
\ No newline at end of file
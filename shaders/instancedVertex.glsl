@@ -0,0 +1,45 @@
+#version 150 core
+
+in vec3 position;
+in vec4 normal;
+in vec2 texCoords;
+
+// per instance attributes, see Model::Instance
+in mat4 instanceModel;
+in vec4 instanceColor;
+
+uniform mat4 view;
+uniform mat4 proj;
+
+// mesh positions are stored in [-1, 1] over the mesh bounds
+uniform vec3 meshBias;
+uniform vec3 meshScale;
+
+// normals arrive as an octahedral encoding in xy, see octEncode in model.cpp
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+out float ViewDepth;
+out vec4 ObjColor;
+
+void main()
+{
+    vec4 worldPos = instanceModel * vec4(position * meshScale + meshBias, 1.0);
+    vec4 viewPos = view * worldPos;
+    gl_Position = proj * viewPos;
+    TexCoords = texCoords;
+    FragPos = vec3(worldPos);
+    Normal = octDecode(normal.xy);
+    ViewDepth = -viewPos.z;
+    ObjColor = instanceColor;
+}
\ No newline at end of file
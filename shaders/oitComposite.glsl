@@ -0,0 +1,24 @@
+#version 150 core
+
+in vec2 ndc;
+
+uniform sampler2D accum;
+uniform sampler2D reveal;
+
+out vec4 outColor;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 a = texelFetch(accum, pixel, 0);
+	vec4 r = texelFetch(reveal, pixel, 0);
+
+	// r.a is the product of (1 - alpha) of every fragment, so fully revealed means untouched
+	float revealage = r.a;
+	if(revealage >= 1.0)
+		discard;
+
+	// weighted average color, r.r holds the sum of the weights times alpha
+	vec3 average = a.rgb / max(r.r, 1e-5);
+	outColor = vec4(average, 1.0 - revealage);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#version 150 core
+
+in vec3 position;
+in vec4 normal;
+in vec2 texCoords;
+
+// per instance attributes, see Model::PackedInstance
+in vec3 instancePosition;
+in vec2 instanceDirection;
+in float instanceAlpha;
+
+uniform mat4 view;
+uniform mat4 proj;
+
+// scales the charge lighting, so different fields' arrows can be told apart
+uniform vec3 instanceTint;
+
+// instance positions are stored in [0, 1] over the batch
+uniform vec3 instanceBias;
+uniform vec3 instanceScale;
+
+// mesh positions are stored in [-1, 1] over the mesh bounds
+uniform vec3 meshBias;
+uniform vec3 meshScale;
+
+// normals arrive as an octahedral encoding in xy, see octEncode in model.cpp
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+out float ViewDepth;
+out vec4 ObjColor;
+
+void main()
+{
+    // a basis with the mesh's +z turned to the direction and x kept horizontal
+    vec3 d = octDecode(instanceDirection * 2.0 - 1.0);
+    vec3 f = -d;
+    vec3 s = normalize(cross(f, vec3(0.0, 0.0, 1.0)));
+    vec3 u = cross(s, f);
+
+    vec3 p = position * meshScale + meshBias;
+    vec4 worldPos = vec4(s * p.x + u * p.y + d * p.z + instancePosition * instanceScale + instanceBias, 1.0);
+    vec4 viewPos = view * worldPos;
+    gl_Position = proj * viewPos;
+    TexCoords = texCoords;
+    FragPos = vec3(worldPos);
+    Normal = octDecode(normal.xy);
+    ViewDepth = -viewPos.z;
+    ObjColor = vec4(instanceTint, instanceAlpha);
+}
\ No newline at end of file
@@ -3,12 +3,11 @@
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
-
-uniform vec4 objColor;
+in vec4 ObjColor;
 
 out vec4 outColor;
 
 void main()
 {
-	outColor = objColor;
+	outColor = ObjColor;
 }
\ No newline at end of file
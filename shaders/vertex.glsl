@@ -1,22 +1,43 @@
 #version 150 core
 
 in vec3 position;
-in vec3 normal;
+in vec4 normal;
 in vec2 texCoords;
 
+// mesh positions are stored in [-1, 1] over the mesh bounds
+uniform vec3 meshBias;
+uniform vec3 meshScale;
+
+// normals arrive as an octahedral encoding in xy, see octEncode in model.cpp
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 proj;
 uniform mat4 parentPos;
+uniform vec4 objColor;
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+out float ViewDepth;
+out vec4 ObjColor;
 
 void main()
 {
-    gl_Position = proj * view * model * parentPos * vec4(position, 1.0);
+    vec3 meshPos = position * meshScale + meshBias;
+    gl_Position = proj * view * model * parentPos * vec4(meshPos, 1.0);
     TexCoords = texCoords;
-    FragPos = vec3(model * vec4(position, 1.0));
-    Normal = normal;
+    FragPos = vec3(model * vec4(meshPos, 1.0));
+    Normal = octDecode(normal.xy);
+    ViewDepth = -(view * model * parentPos * vec4(meshPos, 1.0)).z;
+    ObjColor = objColor;
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#version 150 core
+
+in vec2 ndc;
+
+uniform mat4 invViewProj;
+uniform vec3 eye;
+uniform vec3 volumeMin;
+uniform vec3 volumeMax;
+uniform vec3 dims;
+uniform vec3 coarseDims;
+uniform float spacing;
+uniform float coarseSize;
+
+uniform float magLow;
+uniform float magHigh;
+uniform float emptyBelow;
+uniform bool useDirection;
+
+uniform sampler3D volume;
+uniform sampler3D directions;
+uniform sampler3D coarse;
+uniform sampler1D transfer;
+
+out vec4 outColor;
+
+float normalizeMag(float m)
+{
+	return clamp(log(max(m, 1e-30) / magLow) / log(magHigh / magLow), 0.0, 1.0);
+}
+
+void main()
+{
+	vec4 farPoint = invViewProj * vec4(ndc, 1.0, 1.0);
+	vec3 dir = normalize(farPoint.xyz / farPoint.w - eye);
+	vec3 invDir = 1.0 / dir;
+
+	// clip the ray against the volume box
+	vec3 t0 = (volumeMin - eye) * invDir;
+	vec3 t1 = (volumeMax - eye) * invDir;
+	vec3 tNear = min(t0, t1);
+	vec3 tFar = max(t0, t1);
+	float t = max(max(tNear.x, tNear.y), max(tNear.z, 0.0));
+	float tExit = min(min(tFar.x, tFar.y), tFar.z);
+	if(tExit <= t)
+		discard;
+
+	float stepSize = 0.5 * spacing;
+	vec4 acc = vec4(0.0);
+
+	while(t < tExit)
+	{
+		// position in voxel units, grid samples sit on texel centers
+		vec3 voxel = (eye + dir * t - volumeMin) / spacing;
+		vec3 uvw = (voxel + 0.5) / dims;
+
+		// empty space skipping, jump to the far side of blocks that can't contribute
+		vec3 cell = clamp(floor(voxel / coarseSize), vec3(0.0), coarseDims - 1.0);
+		float blockMax = texelFetch(coarse, ivec3(cell), 0).g;
+		if(normalizeMag(blockMax) < emptyBelow)
+		{
+			vec3 cellMin = volumeMin + cell * coarseSize * spacing;
+			vec3 cellMax = cellMin + coarseSize * spacing;
+			vec3 c = max((cellMin - eye) * invDir, (cellMax - eye) * invDir);
+			t = max(min(min(c.x, c.y), c.z), t) + 0.01 * stepSize;
+			continue;
+		}
+
+		vec4 s = texture(transfer, normalizeMag(texture(volume, uvw).r));
+		if(useDirection)
+			s.rgb = mix(s.rgb, abs(texture(directions, uvw).xyz * 2.0 - 1.0), 0.5);
+
+		// front to back compositing
+		acc.rgb += (1.0 - acc.a) * s.a * s.rgb;
+		acc.a += (1.0 - acc.a) * s.a;
+
+		// early ray termination
+		if(acc.a > 0.99)
+			break;
+
+		t += stepSize;
+	}
+
+	outColor = acc;
+}
\ No newline at end of file
@@ -1,11 +1,133 @@
 #include "Camera.h"
 
 Camera::Camera()
+  : eye(0.0f, 2.2f, 5.2f), target(0.0f, 0.0f, 0.0f), up(0.0f, 0.0f, 1.0f),
+    fovY(glm::radians(45.0f)), zNear(1.0f), zFar(1000.0f), viewportRect(0.0f, 0.0f, 800.0f, 600.0f),
+    windowExtent(800.0f, 600.0f)
 {
-  view = glm::lookAt(
-    glm::vec3(0.0f, 2.2f, 5.2f), // position
-    glm::vec3(0.0f, 0.0f, 0.0f), // camera center
-    glm::vec3(0.0f, 0.0f, 1.0f) // up axis
-    );
-  proj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 1.0f, 1000.0f);
+  update();
+}
+
+void Camera::lookAt(const glm::vec3 &position, const glm::vec3 &center, const glm::vec3 &upAxis)
+{
+  if(position == eye && center == target && upAxis == up)
+  {
+    return;
+  }
+  eye = position;
+  target = center;
+  up = upAxis;
+  viewDirty = true;
+}
+
+void Camera::orbit(const glm::vec3 &center, float radius, float yaw, float pitch)
+{
+  glm::vec3 offset = glm::vec3(cos(yaw) * sin(pitch), sin(yaw) * sin(pitch), cos(pitch));
+  lookAt(center + offset * radius, center, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void Camera::setPerspective(float fovYRadians, float nearPlane, float farPlane)
+{
+  if(fovYRadians == fovY && nearPlane == zNear && farPlane == zFar)
+  {
+    return;
+  }
+  fovY = fovYRadians;
+  zNear = nearPlane;
+  zFar = farPlane;
+  projDirty = true;
+}
+
+void Camera::setViewport(int width, int height)
+{
+  setViewport(width, height, width, height);
+}
+
+void Camera::setViewport(int width, int height, int windowWidth, int windowHeight)
+{
+  glm::vec4 rect = glm::vec4(0.0f, 0.0f, (float)width, (float)height);
+  glm::vec2 extent = glm::vec2((float)windowWidth, (float)windowHeight);
+  if((rect == viewportRect && extent == windowExtent) || width <= 0 || height <= 0 || windowWidth <= 0 ||
+     windowHeight <= 0)
+  {
+    return;
+  }
+  viewportRect = rect;
+  windowExtent = extent;
+  projDirty = true;
+}
+
+bool Camera::update()
+{
+  if(!viewDirty && !projDirty)
+  {
+    return false;
+  }
+  if(viewDirty)
+  {
+    viewMatrix = glm::lookAt(eye, target, up);
+  }
+  if(projDirty)
+  {
+    projMatrix = glm::perspective(fovY, viewportRect[2] / viewportRect[3], zNear, zFar);
+  }
+  viewProjMatrix = projMatrix * viewMatrix;
+  inverseViewProjMatrix = glm::inverse(viewProjMatrix);
+  viewFrustum = Frustum::fromMatrix(viewProjMatrix);
+  viewDirty = false;
+  projDirty = false;
+  changes++;
+  return true;
+}
+
+const glm::mat4 &Camera::view() const
+{
+  return viewMatrix;
+}
+
+const glm::mat4 &Camera::proj() const
+{
+  return projMatrix;
+}
+
+const glm::mat4 &Camera::viewProj() const
+{
+  return viewProjMatrix;
+}
+
+const glm::mat4 &Camera::inverseViewProj() const
+{
+  return inverseViewProjMatrix;
+}
+
+const Frustum &Camera::frustum() const
+{
+  return viewFrustum;
+}
+
+const glm::vec3 &Camera::position() const
+{
+  return eye;
+}
+
+const glm::vec4 &Camera::viewport() const
+{
+  return viewportRect;
+}
+
+unsigned long Camera::version() const
+{
+  return changes;
+}
+
+void Camera::cursorRay(double x, double y, glm::vec3 &origin, glm::vec3 &dir) const
+{
+  float pixelX = (float)x * viewportRect[2] / windowExtent.x;
+  float pixelY = (float)y * viewportRect[3] / windowExtent.y;
+  float ndcX = 2.0f * (pixelX - viewportRect[0]) / viewportRect[2] - 1.0f;
+  float ndcY = 1.0f - 2.0f * (pixelY - viewportRect[1]) / viewportRect[3];
+  glm::vec4 nearPoint = inverseViewProjMatrix * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+  glm::vec4 farPoint = inverseViewProjMatrix * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+  origin = glm::vec3(nearPoint) / nearPoint.w;
+  dir = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
 }
@@ -9,12 +9,58 @@
 #include <vector>
 #include <stdlib.h>
 
+#include "frustum.h"
+
+// where the scene is seen from. the camera owns its position, what it looks at, the
+// projection and the viewport, and keeps the matrices and frustum planes that follow from
+// them. setters only mark what they changed as stale and update() rebuilds that once per
+// frame, so a frame with the camera at rest does no matrix work. version() moves on
+// whenever the matrices change, for anything that caches work per view
 class Camera
 {
+  glm::vec3 eye, target, up;
+  float fovY, zNear, zFar;
+  glm::vec4 viewportRect;
+  // the window's size in the units cursor positions come in, smaller than the viewport on
+  // HiDPI screens
+  glm::vec2 windowExtent;
+
+  glm::mat4 viewMatrix, projMatrix;
+  glm::mat4 viewProjMatrix, inverseViewProjMatrix;
+  Frustum viewFrustum;
+  bool viewDirty = true;
+  bool projDirty = true;
+  unsigned long changes = 0;
+
 public:
-  glm::mat4 view;
-  glm::mat4 proj;
   Camera();
+
+  void lookAt(const glm::vec3 &position, const glm::vec3 &center, const glm::vec3 &upAxis);
+  // on a sphere of radius around center with z up, yaw turning around z from x and pitch
+  // tipping away from z
+  void orbit(const glm::vec3 &center, float radius, float yaw, float pitch);
+  void setPerspective(float fovYRadians, float nearPlane, float farPlane);
+  // in framebuffer pixels, the aspect ratio follows it. the window is taken to be the same
+  // size unless given
+  void setViewport(int width, int height);
+  void setViewport(int width, int height, int windowWidth, int windowHeight);
+
+  // rebuilds whatever went stale, returns true if anything did
+  bool update();
+
+  const glm::mat4 &view() const;
+  const glm::mat4 &proj() const;
+  const glm::mat4 &viewProj() const;
+  const glm::mat4 &inverseViewProj() const;
+  const Frustum &frustum() const;
+  const glm::vec3 &position() const;
+  // x, y, width, height like GL_VIEWPORT
+  const glm::vec4 &viewport() const;
+  unsigned long version() const;
+
+  // the world space ray through a cursor position in window coordinates, y down, starting
+  // on the near plane. the cursor is scaled to framebuffer pixels first
+  void cursorRay(double x, double y, glm::vec3 &origin, glm::vec3 &dir) const;
 };
 
 #endif
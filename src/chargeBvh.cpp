@@ -0,0 +1,243 @@
+#include "chargeBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// distance along the ray to where it enters the box, FLT_MAX if it misses or only gets
+// there past limit
+static float enterBox(const glm::vec3 &lo, const glm::vec3 &hi, const glm::vec3 &origin, const glm::vec3 &invDir,
+                      float limit)
+{
+    glm::vec3 t0 = (lo - origin) * invDir;
+    glm::vec3 t1 = (hi - origin) * invDir;
+    glm::vec3 near = glm::min(t0, t1);
+    glm::vec3 far = glm::max(t0, t1);
+    float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, limit));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+void ChargeBvh::fitLeaf(const ChargeSet &charges, Node &node) const
+{
+    glm::vec3 lo = glm::vec3(FLT_MAX);
+    glm::vec3 hi = glm::vec3(-FLT_MAX);
+    for (uint32_t k = node.offset; k < node.offset + node.count; k++)
+    {
+        glm::vec3 p = charges.position(order[k]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    node.lo = lo - glm::vec3(radius);
+    node.hi = hi + glm::vec3(radius);
+}
+
+// splits at the median of the longest axis of the charges' extent, which keeps the
+// depth at log2 of the leaves however the charges are spread
+uint32_t ChargeBvh::build(const ChargeSet &charges, uint32_t first, uint32_t last)
+{
+    uint32_t index = nodes.size();
+    nodes.push_back(Node());
+    parent.push_back(-1);
+
+    glm::vec3 lo = glm::vec3(FLT_MAX);
+    glm::vec3 hi = glm::vec3(-FLT_MAX);
+    for (uint32_t k = first; k < last; k++)
+    {
+        glm::vec3 p = charges.position(order[k]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    glm::vec3 extent = hi - lo;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    // charges all on one spot can't be split, they share a leaf however many there are
+    if (last - first <= (uint32_t)leafSize || extent[axis] <= 0.0f)
+    {
+        nodes[index].offset = first;
+        nodes[index].count = last - first;
+        for (uint32_t k = first; k < last; k++)
+        {
+            leafOf[order[k]] = index;
+        }
+        fitLeaf(charges, nodes[index]);
+        return index;
+    }
+
+    const std::vector<float> &coord = axis == 0 ? charges.x : axis == 1 ? charges.y : charges.z;
+    uint32_t mid = first + (last - first) / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last,
+                     [&](uint32_t a, uint32_t b) { return coord[a] < coord[b]; });
+
+    uint32_t left = build(charges, first, mid);
+    uint32_t right = build(charges, mid, last);
+    parent[left] = index;
+    parent[right] = index;
+    nodes[index].offset = right;
+    nodes[index].count = 0;
+    nodes[index].lo = glm::min(nodes[left].lo, nodes[right].lo);
+    nodes[index].hi = glm::max(nodes[left].hi, nodes[right].hi);
+    return index;
+}
+
+void ChargeBvh::build(const ChargeSet &charges)
+{
+    size_t n = charges.size();
+    builtCount = n;
+    nodes.clear();
+    parent.clear();
+    order.resize(n);
+    leafOf.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        order[i] = i;
+    }
+    if (n == 0)
+    {
+        return;
+    }
+    nodes.reserve(2 * (n / leafSize + 1));
+    parent.reserve(nodes.capacity());
+    build(charges, 0, n);
+}
+
+void ChargeBvh::sync(const ChargeSet &charges)
+{
+    if (charges.size() < builtCount || charges.size() - builtCount > looseLimit)
+    {
+        build(charges);
+    }
+}
+
+void ChargeBvh::refit(const ChargeSet &charges)
+{
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node &node = nodes[i];
+        if (node.count > 0)
+        {
+            fitLeaf(charges, node);
+        }
+        else
+        {
+            node.lo = glm::min(nodes[i + 1].lo, nodes[node.offset].lo);
+            node.hi = glm::max(nodes[i + 1].hi, nodes[node.offset].hi);
+        }
+    }
+}
+
+void ChargeBvh::refit(const ChargeSet &charges, size_t i)
+{
+    // a loose charge is tested where it is
+    if (i >= builtCount)
+    {
+        return;
+    }
+    int index = leafOf[i];
+    fitLeaf(charges, nodes[index]);
+
+    // up to the first ancestor whose box didn't change
+    for (int p = parent[index]; p >= 0; p = parent[p])
+    {
+        Node &node = nodes[p];
+        glm::vec3 lo = glm::min(nodes[p + 1].lo, nodes[node.offset].lo);
+        glm::vec3 hi = glm::max(nodes[p + 1].hi, nodes[node.offset].hi);
+        if (lo == node.lo && hi == node.hi)
+        {
+            break;
+        }
+        node.lo = lo;
+        node.hi = hi;
+    }
+}
+
+void ChargeBvh::testCharge(const ChargeSet &charges, uint32_t i, const glm::vec3 &origin, const glm::vec3 &dir,
+                           PickHit &hit, bool &found) const
+{
+    glm::vec3 toCenter = charges.position(i) - origin;
+    float along = glm::dot(toCenter, dir);
+    float miss2 = glm::dot(toCenter, toCenter) - along * along;
+    float r2 = radius * radius;
+    if (miss2 > r2)
+    {
+        return;
+    }
+
+    // the far side when the ray starts inside the sphere
+    float half = std::sqrt(r2 - miss2);
+    float t = along - half >= 0.0f ? along - half : along + half;
+    if (t >= 0.0f && t < hit.distance)
+    {
+        hit.index = i;
+        hit.distance = t;
+        found = true;
+    }
+}
+
+bool ChargeBvh::pick(const ChargeSet &charges, const glm::vec3 &origin, const glm::vec3 &dir, PickHit &hit) const
+{
+    bool found = false;
+    hit.distance = FLT_MAX;
+
+    if (!nodes.empty())
+    {
+        glm::vec3 invDir = 1.0f / dir;
+
+        // nearer child first, and anything entered past the closest hit so far is skipped.
+        // median splits keep the depth far below the stack's size
+        struct Entry
+        {
+            uint32_t node;
+            float enter;
+        };
+        Entry stack[64];
+        int top = 0;
+        float rootEnter = enterBox(nodes[0].lo, nodes[0].hi, origin, invDir, FLT_MAX);
+        if (rootEnter < FLT_MAX)
+        {
+            stack[top++] = {0, rootEnter};
+        }
+
+        while (top > 0)
+        {
+            Entry entry = stack[--top];
+            if (entry.enter > hit.distance)
+            {
+                continue;
+            }
+            const Node &node = nodes[entry.node];
+            if (node.count > 0)
+            {
+                for (uint32_t k = node.offset; k < node.offset + node.count; k++)
+                {
+                    testCharge(charges, order[k], origin, dir, hit, found);
+                }
+                continue;
+            }
+
+            uint32_t left = entry.node + 1;
+            uint32_t right = node.offset;
+            float leftEnter = enterBox(nodes[left].lo, nodes[left].hi, origin, invDir, hit.distance);
+            float rightEnter = enterBox(nodes[right].lo, nodes[right].hi, origin, invDir, hit.distance);
+            if (leftEnter > rightEnter)
+            {
+                std::swap(left, right);
+                std::swap(leftEnter, rightEnter);
+            }
+            if (rightEnter < FLT_MAX)
+            {
+                stack[top++] = {right, rightEnter};
+            }
+            if (leftEnter < FLT_MAX)
+            {
+                stack[top++] = {left, leftEnter};
+            }
+        }
+    }
+
+    for (size_t i = builtCount; i < charges.size(); i++)
+    {
+        testCharge(charges, i, origin, dir, hit, found);
+    }
+    return found;
+}
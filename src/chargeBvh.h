@@ -0,0 +1,71 @@
+#ifndef CHARGEBVH_H
+#define CHARGEBVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+
+struct PickHit
+{
+    size_t index = 0;
+    float distance = 0.0f;
+};
+
+// a bounding volume hierarchy over the charges drawn as spheres, for picking them with
+// the cursor ray. nodes are laid out depth first, so a node's first child is the next
+// node and every child comes after its parent: refitting is one pass over the nodes
+// backwards, and a single moved charge only refits the path from its leaf to the root.
+//
+// the hierarchy is built once and refit when charges move, a refit keeps the tree's shape
+// so it's O(n) for all of them and O(depth) for one. charges added since the build are
+// kept in a short list tested one by one, and the tree is only rebuilt once that list
+// grows long or charges were removed
+class ChargeBvh
+{
+    struct Node
+    {
+        glm::vec3 lo, hi;
+        // an inner node's second child, or a leaf's first charge in order
+        uint32_t offset;
+        // charges in a leaf, 0 for an inner node
+        uint32_t count;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> parent;
+    // charge indices, every leaf's contiguous
+    std::vector<uint32_t> order;
+    // leaf holding each charge
+    std::vector<uint32_t> leafOf;
+    // charges from here on were added after the build and aren't in the tree yet
+    size_t builtCount = 0;
+
+    uint32_t build(const ChargeSet &charges, uint32_t first, uint32_t last);
+    void fitLeaf(const ChargeSet &charges, Node &node) const;
+    void testCharge(const ChargeSet &charges, uint32_t i, const glm::vec3 &origin, const glm::vec3 &dir,
+                    PickHit &hit, bool &found) const;
+
+public:
+    // radius of a drawn charge
+    float radius = 2.0f;
+    int leafSize = 4;
+    // charges left out of the tree before sync rebuilds it
+    size_t looseLimit = 4096;
+
+    void build(const ChargeSet &charges);
+    // brings the tree up to date after charges were added or removed, cheaply unless a
+    // rebuild is due
+    void sync(const ChargeSet &charges);
+    // every charge may have moved, their order and count haven't changed
+    void refit(const ChargeSet &charges);
+    // charge i moved
+    void refit(const ChargeSet &charges, size_t i);
+
+    // closest charge the ray hits, dir normalized, false if it misses them all
+    bool pick(const ChargeSet &charges, const glm::vec3 &origin, const glm::vec3 &dir, PickHit &hit) const;
+};
+
+#endif // CHARGEBVH_H
@@ -0,0 +1,211 @@
+#include "chargeClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+ChargeClusters::ChargeClusters(float cutoffDist, int textureUnit)
+{
+    cutoff = cutoffDist;
+    firstUnit = textureUnit;
+    zNear = 1.0f;
+    zFar = 1000.0f;
+    width = 1.0f;
+    height = 1.0f;
+    bins.resize(tilesX * tilesY * slices);
+
+    glGenBuffers(1, &chargeBuf);
+    glGenBuffers(1, &gridBuf);
+    glGenBuffers(1, &indexBuf);
+    glGenTextures(1, &chargeTex);
+    glGenTextures(1, &gridTex);
+    glGenTextures(1, &indexTex);
+
+    // attach each buffer to its texture once, the storage is respecified on upload
+    glBindBuffer(GL_TEXTURE_BUFFER, chargeBuf);
+    glBindTexture(GL_TEXTURE_BUFFER, chargeTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, chargeBuf);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, gridBuf);
+    glBindTexture(GL_TEXTURE_BUFFER, gridTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuf);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, indexBuf);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuf);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ChargeClusters::markDirty()
+{
+    dirty = true;
+}
+
+void ChargeClusters::buildClusterBounds()
+{
+    // recover the clip planes from the projection matrix
+    zNear = cachedProj[3][2] / (cachedProj[2][2] - 1.0f);
+    zFar = cachedProj[3][2] / (cachedProj[2][2] + 1.0f);
+
+    clusterMin.resize(tilesX * tilesY * slices);
+    clusterMax.resize(tilesX * tilesY * slices);
+
+    for (int k = 0; k < slices; k++)
+    {
+        // exponential slicing so near clusters aren't stretched out in depth
+        float dn = zNear * pow(zFar / zNear, (float)k / slices);
+        float df = zNear * pow(zFar / zNear, (float)(k + 1) / slices);
+
+        for (int j = 0; j < tilesY; j++)
+        {
+            float ndcB = -1.0f + 2.0f * j / tilesY;
+            float ndcT = -1.0f + 2.0f * (j + 1) / tilesY;
+            for (int i = 0; i < tilesX; i++)
+            {
+                float ndcL = -1.0f + 2.0f * i / tilesX;
+                float ndcR = -1.0f + 2.0f * (i + 1) / tilesX;
+
+                // view space x = ndc * depth / P[0][0], bound the frustum slice by an AABB
+                float xs[4] = {ndcL * dn, ndcL * df, ndcR * dn, ndcR * df};
+                float ys[4] = {ndcB * dn, ndcB * df, ndcT * dn, ndcT * df};
+
+                int c = (k * tilesY + j) * tilesX + i;
+                clusterMin[c] = glm::vec3(*std::min_element(xs, xs + 4) / cachedProj[0][0],
+                                          *std::min_element(ys, ys + 4) / cachedProj[1][1],
+                                          -df);
+                clusterMax[c] = glm::vec3(*std::max_element(xs, xs + 4) / cachedProj[0][0],
+                                          *std::max_element(ys, ys + 4) / cachedProj[1][1],
+                                          -dn);
+            }
+        }
+    }
+}
+
+void ChargeClusters::update(const ChargeSet &chargeSet, const Camera &camera, float viewportWidth, float viewportHeight)
+{
+    bool projChanged = camera.proj() != cachedProj || clusterMin.empty();
+    if (!dirty && !projChanged && camera.view() == cachedView &&
+        viewportWidth == width && viewportHeight == height)
+    {
+        return;
+    }
+
+    cachedView = camera.view();
+    cachedProj = camera.proj();
+    width = viewportWidth;
+    height = viewportHeight;
+    if (projChanged)
+    {
+        buildClusterBounds();
+    }
+
+    // position and sign, the shader picks the light color from the sign
+    charges.clear();
+    for (size_t i = 0; i < chargeSet.size(); i++)
+    {
+        charges.push_back(glm::vec4(chargeSet.position(i), chargeSet.q[i] > 0.0f ? 1.0f : -1.0f));
+    }
+
+    for (auto &bin : bins)
+    {
+        bin.clear();
+    }
+
+    float logRatio = log(zFar / zNear);
+    for (GLuint n = 0; n < charges.size(); n++)
+    {
+        glm::vec3 c = glm::vec3(cachedView * glm::vec4(glm::vec3(charges[n]), 1.0f));
+        float depth = -c.z;
+        if (depth + cutoff < zNear || depth - cutoff > zFar)
+        {
+            continue;
+        }
+
+        // only the slices the cutoff sphere overlaps in depth need testing
+        int k0 = 0;
+        if (depth - cutoff > zNear)
+        {
+            k0 = (int)(log((depth - cutoff) / zNear) / logRatio * slices);
+        }
+        int k1 = slices - 1;
+        if (depth + cutoff < zFar)
+        {
+            k1 = std::min(slices - 1, (int)(log((depth + cutoff) / zNear) / logRatio * slices));
+        }
+
+        for (int k = k0; k <= k1; k++)
+        {
+            for (int t = 0; t < tilesX * tilesY; t++)
+            {
+                int cl = k * tilesX * tilesY + t;
+                glm::vec3 closest = glm::clamp(c, clusterMin[cl], clusterMax[cl]);
+                glm::vec3 d = c - closest;
+                if (glm::dot(d, d) <= cutoff * cutoff)
+                {
+                    bins[cl].push_back(n);
+                }
+            }
+        }
+    }
+
+    // flatten the bins into (offset, count) pairs and one shared index list
+    grid.resize(bins.size() * 2);
+    indices.clear();
+    for (size_t cl = 0; cl < bins.size(); cl++)
+    {
+        grid[cl * 2 + 0] = indices.size();
+        grid[cl * 2 + 1] = bins[cl].size();
+        indices.insert(indices.end(), bins[cl].begin(), bins[cl].end());
+    }
+
+    // buffer textures can't be empty
+    if (charges.empty())
+    {
+        charges.push_back(glm::vec4(0.0f));
+    }
+    if (indices.empty())
+    {
+        indices.push_back(0);
+    }
+
+    upload();
+    dirty = false;
+}
+
+void ChargeClusters::upload()
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, chargeBuf);
+    glBufferData(GL_TEXTURE_BUFFER, charges.size() * sizeof(glm::vec4), &charges[0], GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, gridBuf);
+    glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(GLuint), &grid[0], GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, indexBuf);
+    glBufferData(GL_TEXTURE_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ChargeClusters::bind(Model &model)
+{
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, chargeTex);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+    glBindTexture(GL_TEXTURE_BUFFER, gridTex);
+    glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    model.setIntUniform("chargeData", firstUnit);
+    model.setIntUniform("clusterGrid", firstUnit + 1);
+    model.setIntUniform("clusterIndices", firstUnit + 2);
+    model.setIntUniform("tilesX", tilesX);
+    model.setIntUniform("tilesY", tilesY);
+    model.setIntUniform("slices", slices);
+    model.setFloatUniform("zNear", zNear);
+    model.setFloatUniform("zFar", zFar);
+    model.setFloatUniform("cutoff", cutoff);
+    model.setFloatUniform("screenWidth", width);
+    model.setFloatUniform("screenHeight", height);
+}
@@ -0,0 +1,59 @@
+#ifndef CHARGECLUSTERS_H
+#define CHARGECLUSTERS_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Camera.h"
+#include "charges.h"
+#include "model.h"
+
+// bins the charges into a grid of view space clusters (screen tiles x exponential
+// depth slices) so the lit fragment shader only loops over the charges whose
+// cutoff sphere touches the fragment's cluster
+class ChargeClusters
+{
+    void buildClusterBounds();
+    void upload();
+
+    GLuint chargeBuf, chargeTex;
+    GLuint gridBuf, gridTex;
+    GLuint indexBuf, indexTex;
+    int firstUnit;
+
+    // projection parameters the cluster bounds were built for
+    glm::mat4 cachedView;
+    glm::mat4 cachedProj;
+    float zNear, zFar;
+    float width, height;
+    bool dirty = true;
+
+    std::vector<glm::vec3> clusterMin;
+    std::vector<glm::vec3> clusterMax;
+    std::vector<std::vector<GLuint> > bins;
+
+    // flattened data that goes to the buffer textures
+    std::vector<glm::vec4> charges;
+    std::vector<GLuint> grid;
+    std::vector<GLuint> indices;
+
+public:
+    static const int tilesX = 16;
+    static const int tilesY = 9;
+    static const int slices = 24;
+
+    float cutoff;
+
+    ChargeClusters(float cutoffDist, int textureUnit);
+    void markDirty();
+    void update(const ChargeSet &chargeSet, const Camera &camera, float viewportWidth, float viewportHeight);
+    void bind(Model &model);
+};
+
+#endif // CHARGECLUSTERS_H
@@ -0,0 +1,357 @@
+#include "chargeTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void ChargeTree::build(const ChargeSet &charges)
+{
+    build(charges, MultipoleSet());
+}
+
+void ChargeTree::build(const ChargeSet &charges, const MultipoleSet &multipoles)
+{
+    cells.clear();
+    sorted.clear();
+    source.clear();
+    hasDipoles = !multipoles.empty();
+
+    // charges are multipoles without a dipole, both go in one source list
+    for (size_t i = 0; i < charges.size(); i++)
+    {
+        sorted.add(charges.position(i), charges.q[i], glm::vec3(0.0f));
+    }
+    for (size_t i = 0; i < multipoles.size(); i++)
+    {
+        sorted.add(multipoles.position(i), multipoles.q[i], multipoles.dipole(i));
+    }
+    if (sorted.empty())
+    {
+        return;
+    }
+
+    // the root is a cube around every source so children stay cubes
+    glm::vec3 lo = sorted.position(0);
+    glm::vec3 hi = lo;
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        lo = glm::min(lo, sorted.position(i));
+        hi = glm::max(hi, sorted.position(i));
+    }
+    float edge = std::max(std::max(hi.x - lo.x, hi.y - lo.y), std::max(hi.z - lo.z, 1e-3f));
+    hi = lo + glm::vec3(edge);
+
+    buildOrder.resize(sorted.size());
+    for (size_t i = 0; i < buildOrder.size(); i++)
+    {
+        buildOrder[i] = i;
+    }
+
+    // split works on positions in sorted, the sources are put in final order afterwards
+    Cell root;
+    root.lo = lo;
+    root.hi = hi;
+    root.first = 0;
+    root.count = sorted.size();
+    root.firstChild = -1;
+    cells.push_back(root);
+    split(0, buildOrder, 0);
+
+    unsorted.clear();
+    std::swap(unsorted, sorted);
+    for (size_t i = 0; i < buildOrder.size(); i++)
+    {
+        size_t from = buildOrder[i];
+        sorted.add(unsorted.position(from), unsorted.q[from], unsorted.dipole(from));
+    }
+    source.swap(buildOrder);
+    for (Cell &cell : cells)
+    {
+        computeMoments(cell);
+    }
+}
+
+void ChargeTree::split(int cellIndex, std::vector<size_t> &order, int depth)
+{
+    Cell cell = cells[cellIndex];
+    if ((int)cell.count <= leafSize || depth >= maxDepth)
+    {
+        return;
+    }
+
+    // three nested partitions put the charges of each octant next to each other
+    glm::vec3 mid = (cell.lo + cell.hi) * 0.5f;
+    std::vector<size_t>::iterator begin = order.begin() + cell.first;
+    std::vector<size_t>::iterator end = begin + cell.count;
+    std::vector<size_t>::iterator bounds[9];
+    bounds[0] = begin;
+    bounds[8] = end;
+    bounds[4] = std::partition(begin, end, [&](size_t i) { return sorted.x[i] < mid.x; });
+    for (int h = 0; h < 2; h++)
+    {
+        bounds[h * 4 + 2] = std::partition(bounds[h * 4], bounds[h * 4 + 4],
+                                           [&](size_t i) { return sorted.y[i] < mid.y; });
+        for (int q = 0; q < 2; q++)
+        {
+            int b = h * 4 + q * 2;
+            bounds[b + 1] = std::partition(bounds[b], bounds[b + 2], [&](size_t i) { return sorted.z[i] < mid.z; });
+        }
+    }
+
+    int firstChild = cells.size();
+    cells[cellIndex].firstChild = firstChild;
+    for (int c = 0; c < 8; c++)
+    {
+        Cell child;
+        glm::vec3 upper = glm::vec3(c & 4 ? 1.0f : 0.0f, c & 2 ? 1.0f : 0.0f, c & 1 ? 1.0f : 0.0f);
+        child.lo = cell.lo + upper * (mid - cell.lo);
+        child.hi = child.lo + (mid - cell.lo);
+        child.first = bounds[c] - order.begin();
+        child.count = bounds[c + 1] - bounds[c];
+        child.firstChild = -1;
+        cells.push_back(child);
+    }
+    for (int c = 0; c < 8; c++)
+    {
+        split(firstChild + c, order, depth + 1);
+    }
+}
+
+void ChargeTree::computeMoments(Cell &cell) const
+{
+    cell.size = cell.hi.x - cell.lo.x;
+    cell.charge = 0.0f;
+    cell.dipole = glm::vec3(0.0f);
+
+    // centered on the absolute charge, the net charge of a mixed group can be near zero
+    glm::vec3 weighted = glm::vec3(0.0f);
+    float absCharge = 0.0f;
+    for (size_t i = cell.first; i < cell.first + cell.count; i++)
+    {
+        weighted += std::abs(sorted.q[i]) * sorted.position(i);
+        absCharge += std::abs(sorted.q[i]);
+        cell.charge += sorted.q[i];
+    }
+    cell.center = absCharge > 0.0f ? weighted / absCharge : (cell.lo + cell.hi) * 0.5f;
+
+    for (size_t i = cell.first; i < cell.first + cell.count; i++)
+    {
+        cell.dipole += sorted.q[i] * (sorted.position(i) - cell.center) + sorted.dipole(i);
+    }
+}
+
+void ChargeTree::setCharges(const std::vector<float> &q)
+{
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        sorted.q[i] = q[source[i]];
+    }
+
+    // children always come after their parent, so going backwards every cell's children
+    // are done before it
+    for (size_t c = cells.size(); c-- > 0;)
+    {
+        Cell &cell = cells[c];
+        cell.charge = 0.0f;
+        cell.dipole = glm::vec3(0.0f);
+        if (cell.firstChild < 0)
+        {
+            for (size_t i = cell.first; i < cell.first + cell.count; i++)
+            {
+                cell.charge += sorted.q[i];
+                cell.dipole += sorted.q[i] * (sorted.position(i) - cell.center) + sorted.dipole(i);
+            }
+        }
+        else
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                const Cell &child = cells[cell.firstChild + k];
+                cell.charge += child.charge;
+                cell.dipole += child.dipole + child.charge * (child.center - cell.center);
+            }
+        }
+    }
+}
+
+glm::vec3 ChargeTree::field(const glm::vec3 &p, float theta) const
+{
+    glm::vec3 e = glm::vec3(0.0f);
+    if (cells.empty())
+    {
+        return e;
+    }
+
+    int stack[8 * 32];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Cell &cell = cells[stack[--top]];
+        if (cell.count == 0)
+        {
+            continue;
+        }
+
+        glm::vec3 r = p - cell.center;
+        float d = glm::length(r);
+        if (cell.size < theta * d)
+        {
+            float inv3 = 1.0f / (d * d * d);
+            glm::vec3 n = r / d;
+            e += cell.charge * r * inv3 + (3.0f * glm::dot(cell.dipole, n) * n - cell.dipole) * inv3;
+        }
+        else if (cell.firstChild < 0)
+        {
+            for (size_t i = cell.first; i < cell.first + cell.count; i++)
+            {
+                glm::vec3 rc = p - sorted.position(i);
+                float dc = std::max(glm::length(rc), coulombMinDist);
+                float inv3 = 1.0f / (dc * dc * dc);
+                e += sorted.q[i] * rc * inv3;
+                if (hasDipoles)
+                {
+                    glm::vec3 nc = rc / dc;
+                    e += (3.0f * glm::dot(sorted.dipole(i), nc) * nc - sorted.dipole(i)) * inv3;
+                }
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                stack[top++] = cell.firstChild + c;
+            }
+        }
+    }
+    return e;
+}
+
+float ChargeTree::potential(const glm::vec3 &p, float theta) const
+{
+    float phi = 0.0f;
+    if (cells.empty())
+    {
+        return phi;
+    }
+
+    int stack[8 * 32];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Cell &cell = cells[stack[--top]];
+        if (cell.count == 0)
+        {
+            continue;
+        }
+
+        glm::vec3 r = p - cell.center;
+        float d = glm::length(r);
+        if (cell.size < theta * d)
+        {
+            phi += (cell.charge + glm::dot(cell.dipole, r) / (d * d)) / d;
+        }
+        else if (cell.firstChild < 0)
+        {
+            for (size_t i = cell.first; i < cell.first + cell.count; i++)
+            {
+                glm::vec3 rc = p - sorted.position(i);
+                float dc = glm::length(rc);
+                phi += sorted.q[i] / dc;
+                if (hasDipoles)
+                {
+                    phi += glm::dot(sorted.dipole(i), rc) / (dc * dc * dc);
+                }
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                stack[top++] = cell.firstChild + c;
+            }
+        }
+    }
+    return phi;
+}
+
+float ChargeTree::nearestDistance(const glm::vec3 &p) const
+{
+    float best = std::numeric_limits<float>::max();
+    if (cells.empty())
+    {
+        return best;
+    }
+
+    int stack[8 * 32];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Cell &cell = cells[stack[--top]];
+        if (cell.count == 0 || glm::length(p - glm::clamp(p, cell.lo, cell.hi)) >= best)
+        {
+            continue;
+        }
+
+        if (cell.firstChild < 0)
+        {
+            for (size_t i = cell.first; i < cell.first + cell.count; i++)
+            {
+                best = std::min(best, glm::length(p - sorted.position(i)));
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                stack[top++] = cell.firstChild + c;
+            }
+        }
+    }
+    return best;
+}
+
+void ChargeTree::collect(const glm::vec3 &boxLo, const glm::vec3 &boxHi, float theta, ChargeSet &near,
+                         MultipoleSet &far) const
+{
+    if (cells.empty())
+    {
+        return;
+    }
+
+    int stack[8 * 32];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Cell &cell = cells[stack[--top]];
+        if (cell.count == 0)
+        {
+            continue;
+        }
+
+        // the closest any point of the box gets to the cell's center
+        glm::vec3 closest = glm::clamp(cell.center, boxLo, boxHi);
+        float d = glm::length(cell.center - closest);
+        if (cell.size < theta * d)
+        {
+            far.add(cell.center, cell.charge, cell.dipole);
+        }
+        else if (cell.firstChild < 0)
+        {
+            for (size_t i = cell.first; i < cell.first + cell.count; i++)
+            {
+                near.add(sorted.position(i), sorted.q[i]);
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                stack[top++] = cell.firstChild + c;
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef CHARGETREE_H
+#define CHARGETREE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+
+// a Barnes-Hut octree over a charge set. every cell keeps its total charge, the center of
+// its absolute charge and its dipole moment about that center, so a cell far enough away
+// from a sample can stand in for all the charges below it. a cell is far enough when its
+// size is under theta times its distance.
+//
+// a tree can also hold multipoles handed over from elsewhere, as in the locally essential
+// trees of the MPI solver. they sit in the leaves like charges and their dipoles are
+// folded into the moments of every cell above them
+class ChargeTree
+{
+public:
+    struct Cell
+    {
+        glm::vec3 lo, hi;
+        glm::vec3 center;
+        glm::vec3 dipole;
+        float charge;
+        float size;
+        int firstChild; // eight children from here on, -1 for a leaf
+        size_t first, count; // range of the tree ordered charges
+    };
+
+    std::vector<Cell> cells;
+    // the sources reordered so every cell's are contiguous, charges have no dipole
+    MultipoleSet sorted;
+    // which source each sorted one came from, charges first then multipoles
+    std::vector<size_t> source;
+    // false when built from charges alone, the leaves then skip the dipole term
+    bool hasDipoles = false;
+
+    int leafSize = 16;
+    int maxDepth = 24;
+
+    void build(const ChargeSet &charges);
+    void build(const ChargeSet &charges, const MultipoleSet &multipoles);
+
+    // new charges for the same positions, indexed like the sources the tree was built
+    // from. the cells and their centers stay as they are and only the charges and dipoles
+    // are summed again, bottom up, so the field is linear in the new charges
+    void setCharges(const std::vector<float> &q);
+
+    // field at p, cells passing the theta test contribute as multipoles
+    glm::vec3 field(const glm::vec3 &p, float theta) const;
+    // potential at p, q / r. unlike the field it isn't clamped, p can't be on a source
+    float potential(const glm::vec3 &p, float theta) const;
+    // distance from p to the closest source
+    float nearestDistance(const glm::vec3 &p) const;
+
+    // what a target box needs from this tree, its locally essential part: cells that pass
+    // the theta test for every point of the box become multipoles, charges in the cells
+    // that don't are copied as they are. only meaningful for a tree built from charges
+    void collect(const glm::vec3 &boxLo, const glm::vec3 &boxHi, float theta, ChargeSet &near,
+                 MultipoleSet &far) const;
+
+private:
+    // build scratch, kept with the cells so rebuilding a tree of about the same size reuses
+    // their storage instead of going back to the heap
+    MultipoleSet unsorted;
+    std::vector<size_t> buildOrder;
+
+    void split(int cell, std::vector<size_t> &order, int depth);
+    void computeMoments(Cell &cell) const;
+};
+
+#endif // CHARGETREE_H
@@ -0,0 +1,82 @@
+#include "charges.h"
+
+size_t ChargeSet::size() const
+{
+    return q.size();
+}
+
+bool ChargeSet::empty() const
+{
+    return q.empty();
+}
+
+void ChargeSet::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    q.clear();
+}
+
+void ChargeSet::add(const glm::vec3 &pos, float charge)
+{
+    x.push_back(pos.x);
+    y.push_back(pos.y);
+    z.push_back(pos.z);
+    q.push_back(charge);
+}
+
+void ChargeSet::append(const ChargeSet &other)
+{
+    x.insert(x.end(), other.x.begin(), other.x.end());
+    y.insert(y.end(), other.y.begin(), other.y.end());
+    z.insert(z.end(), other.z.begin(), other.z.end());
+    q.insert(q.end(), other.q.begin(), other.q.end());
+}
+
+glm::vec3 ChargeSet::position(size_t i) const
+{
+    return glm::vec3(x[i], y[i], z[i]);
+}
+
+size_t MultipoleSet::size() const
+{
+    return q.size();
+}
+
+bool MultipoleSet::empty() const
+{
+    return q.empty();
+}
+
+void MultipoleSet::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    q.clear();
+    px.clear();
+    py.clear();
+    pz.clear();
+}
+
+void MultipoleSet::add(const glm::vec3 &center, float charge, const glm::vec3 &dipole)
+{
+    x.push_back(center.x);
+    y.push_back(center.y);
+    z.push_back(center.z);
+    q.push_back(charge);
+    px.push_back(dipole.x);
+    py.push_back(dipole.y);
+    pz.push_back(dipole.z);
+}
+
+glm::vec3 MultipoleSet::position(size_t i) const
+{
+    return glm::vec3(x[i], y[i], z[i]);
+}
+
+glm::vec3 MultipoleSet::dipole(size_t i) const
+{
+    return glm::vec3(px[i], py[i], pz[i]);
+}
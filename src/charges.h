@@ -0,0 +1,48 @@
+#ifndef CHARGES_H
+#define CHARGES_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// coulomb distances are clamped to this so a sample on top of a charge stays finite
+const float coulombMinDist = 1.0f;
+
+// point charges stored as a structure of arrays so the field kernels can stream
+// each component on its own
+struct ChargeSet
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> q;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void add(const glm::vec3 &pos, float charge);
+    void append(const ChargeSet &other);
+    glm::vec3 position(size_t i) const;
+};
+
+// far field stand-ins for groups of charges: the group's total charge at a center plus
+// its dipole moment about that center
+struct MultipoleSet
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> q;
+    std::vector<float> px;
+    std::vector<float> py;
+    std::vector<float> pz;
+
+    size_t size() const;
+    void clear();
+    bool empty() const;
+    void add(const glm::vec3 &center, float charge, const glm::vec3 &dipole);
+    glm::vec3 position(size_t i) const;
+    glm::vec3 dipole(size_t i) const;
+};
+
+#endif // CHARGES_H
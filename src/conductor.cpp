@@ -0,0 +1,473 @@
+#include "conductor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "tiny_obj_loader.h"
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a degree 2 rule for triangles, three points with a third of the weight each
+static glm::vec3 quadraturePoint(const glm::vec3 *v, int k)
+{
+    return (3.0f * v[k] + v[0] + v[1] + v[2]) / 6.0f;
+}
+
+// integral of 1 / |x - p| over the triangle v, for any p. the closed form of Wilton et
+// al. summed over the edges, in double since it cancels badly near the plane
+static double triangleIntegral(const glm::vec3 *v, const glm::vec3 &point)
+{
+    glm::dvec3 a = glm::dvec3(v[0]);
+    glm::dvec3 n = glm::normalize(glm::cross(glm::dvec3(v[1]) - a, glm::dvec3(v[2]) - a));
+    glm::dvec3 p = glm::dvec3(point);
+    double w = glm::dot(p - a, n);
+    double height = std::abs(w);
+    glm::dvec3 foot = p - w * n;
+
+    double sum = 0.0;
+    for (int e = 0; e < 3; e++)
+    {
+        glm::dvec3 from = glm::dvec3(v[e]);
+        glm::dvec3 to = glm::dvec3(v[(e + 1) % 3]);
+        glm::dvec3 along = glm::normalize(to - from);
+        glm::dvec3 out = glm::cross(along, n);
+
+        // distance from the foot to the edge's line, positive on the inside. the edge
+        // adds nothing when the foot is on its line
+        double t = glm::dot(from - foot, out);
+        if (std::abs(t) < 1e-9 * glm::length(to - from))
+        {
+            continue;
+        }
+        double sFrom = glm::dot(from - foot, along);
+        double sTo = glm::dot(to - foot, along);
+        double r0Squared = t * t + w * w;
+        double rFrom = std::sqrt(r0Squared + sFrom * sFrom);
+        double rTo = std::sqrt(r0Squared + sTo * sTo);
+
+        // r + s loses everything when s is negative and about -r, r0^2 / (r - s) doesn't
+        double lFrom = sFrom >= 0.0 ? rFrom + sFrom : r0Squared / (rFrom - sFrom);
+        double lTo = sTo >= 0.0 ? rTo + sTo : r0Squared / (rTo - sTo);
+        sum += t * std::log(lTo / lFrom);
+        sum -= height * (std::atan(t * sTo / (r0Squared + height * rTo)) -
+                         std::atan(t * sFrom / (r0Squared + height * rFrom)));
+    }
+    return sum;
+}
+
+static double dot(const std::vector<double> &a, const std::vector<double> &b)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void ConductorSet::load(const std::string &path, float potential, const glm::vec3 &offset, float scale)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str()))
+    {
+        throw std::runtime_error("Conductor Error: could not load " + path + ": " + err);
+    }
+
+    int conductor = potentials.size();
+    size_t before = panels.size();
+    for (const auto &shape : shapes)
+    {
+        // faces are triangulated by the loader
+        for (size_t f = 0; f + 2 < shape.mesh.indices.size(); f += 3)
+        {
+            Panel panel;
+            for (int k = 0; k < 3; k++)
+            {
+                int index = shape.mesh.indices[f + k].vertex_index;
+                glm::vec3 v = glm::vec3(attrib.vertices[3 * index + 0], attrib.vertices[3 * index + 1],
+                                        attrib.vertices[3 * index + 2]);
+                panel.vertex[k] = offset + scale * v;
+            }
+            glm::vec3 u = panel.vertex[1] - panel.vertex[0];
+            glm::vec3 w = panel.vertex[2] - panel.vertex[0];
+            panel.area = 0.5f * glm::length(glm::cross(u, w));
+            panel.size = std::max(std::max(glm::length(u), glm::length(w)),
+                                  glm::length(panel.vertex[2] - panel.vertex[1]));
+
+            // slivers don't carry charge and their integrals aren't defined
+            if (!(panel.area > 1e-6f * panel.size * panel.size))
+            {
+                continue;
+            }
+            panel.centroid = (panel.vertex[0] + panel.vertex[1] + panel.vertex[2]) / 3.0f;
+            panel.conductor = conductor;
+            panels.push_back(panel);
+        }
+    }
+    if (panels.size() == before)
+    {
+        throw std::runtime_error("Conductor Error: " + path + " has no triangles");
+    }
+
+    potentials.push_back(potential);
+    prepared = false;
+}
+
+void ConductorSet::clear()
+{
+    panels.clear();
+    potentials.clear();
+    points.clear();
+    density.clear();
+    prepared = false;
+}
+
+size_t ConductorSet::size() const
+{
+    return panels.size();
+}
+
+bool ConductorSet::empty() const
+{
+    return panels.empty();
+}
+
+size_t ConductorSet::conductorCount() const
+{
+    return potentials.size();
+}
+
+void ConductorSet::prepare(ThreadPool &pool)
+{
+    size_t n = panels.size();
+    points.clear();
+    for (const Panel &panel : panels)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            points.add(quadraturePoint(panel.vertex, k), 1.0f);
+        }
+    }
+    panelTree.build(points);
+    pointCharges.resize(points.size());
+
+    findNear(pool);
+
+    // the same near rows for every product, their point rule part comes out of the tree
+    diagonal.resize(n);
+    pool.parallelFor(0, n, 256, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            const glm::vec3 &c = panels[i].centroid;
+            for (size_t k = nearStart[i]; k < nearStart[i + 1]; k++)
+            {
+                const Panel &panel = panels[nearPanel[k]];
+                double exact = triangleIntegral(panel.vertex, c);
+                double pointRule = 0.0;
+                for (int q = 0; q < 3; q++)
+                {
+                    pointRule += panel.area / 3.0 / glm::length(c - quadraturePoint(panel.vertex, q));
+                }
+                nearValue[k] = exact - pointRule;
+                if ((size_t)nearPanel[k] == i)
+                {
+                    diagonal[i] = exact;
+                }
+            }
+        }
+    });
+
+    if (density.size() != n)
+    {
+        density.assign(n, 0.0);
+    }
+    prepared = true;
+}
+
+void ConductorSet::findNear(ThreadPool &pool)
+{
+    size_t n = panels.size();
+
+    // a panel j is near centroid i when it's within nearFactor of j's own size, which is
+    // what the point rule's error depends on. every panel goes in the hash cells its near
+    // sphere touches, so each centroid only looks in its own cell
+    double meanSize = 0.0;
+    glm::vec3 lo = panels[0].centroid;
+    for (const Panel &panel : panels)
+    {
+        meanSize += panel.size;
+        lo = glm::min(lo, panel.centroid - glm::vec3(nearFactor * panel.size));
+    }
+    float cellSize = nearFactor * meanSize / n;
+
+    auto cellOf = [&](const glm::vec3 &p) {
+        glm::vec3 u = (p - lo) / cellSize;
+        return glm::ivec3(std::min((int)u.x, 0x1fffff), std::min((int)u.y, 0x1fffff), std::min((int)u.z, 0x1fffff));
+    };
+    auto key = [](int x, int y, int z) { return ((uint64_t)x << 42) | ((uint64_t)y << 21) | (uint64_t)z; };
+
+    std::vector<std::pair<uint64_t, int>> entries;
+    for (size_t j = 0; j < n; j++)
+    {
+        glm::vec3 radius = glm::vec3(nearFactor * panels[j].size);
+        glm::ivec3 cellLo = cellOf(panels[j].centroid - radius);
+        glm::ivec3 cellHi = cellOf(panels[j].centroid + radius);
+        for (int x = cellLo.x; x <= cellHi.x; x++)
+        {
+            for (int y = cellLo.y; y <= cellHi.y; y++)
+            {
+                for (int z = cellLo.z; z <= cellHi.z; z++)
+                {
+                    entries.push_back(std::make_pair(key(x, y, z), (int)j));
+                }
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    // counted first so the rows can be filled in place
+    auto forNear = [&](size_t i, int *out) {
+        glm::ivec3 cell = cellOf(panels[i].centroid);
+        std::pair<uint64_t, int> start = std::make_pair(key(cell.x, cell.y, cell.z), -1);
+        size_t count = 0;
+        for (auto it = std::upper_bound(entries.begin(), entries.end(), start);
+             it != entries.end() && it->first == start.first; ++it)
+        {
+            const Panel &panel = panels[it->second];
+            if (glm::length(panels[i].centroid - panel.centroid) < nearFactor * panel.size || (size_t)it->second == i)
+            {
+                if (out)
+                {
+                    out[count] = it->second;
+                }
+                count++;
+            }
+        }
+        return count;
+    };
+
+    std::vector<size_t> counts(n);
+    pool.parallelFor(0, n, 1024, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            counts[i] = forNear(i, nullptr);
+        }
+    });
+    size_t total = parallelExclusiveScan(pool, counts, nearStart);
+    nearStart.push_back(total);
+    nearPanel.resize(total);
+    nearValue.resize(total);
+    pool.parallelFor(0, n, 1024, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            forNear(i, &nearPanel[nearStart[i]]);
+        }
+    });
+}
+
+void ConductorSet::multiply(const std::vector<double> &x, std::vector<double> &y, ThreadPool &pool)
+{
+    size_t n = panels.size();
+    for (size_t j = 0; j < n; j++)
+    {
+        float q = x[j] * panels[j].area / 3.0;
+        pointCharges[3 * j + 0] = q;
+        pointCharges[3 * j + 1] = q;
+        pointCharges[3 * j + 2] = q;
+    }
+    panelTree.setCharges(pointCharges);
+
+    y.resize(n);
+    pool.parallelFor(0, n, 256, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            double phi = panelTree.potential(panels[i].centroid, theta);
+            for (size_t k = nearStart[i]; k < nearStart[i + 1]; k++)
+            {
+                phi += nearValue[k] * x[nearPanel[k]];
+            }
+            y[i] = phi;
+        }
+    });
+}
+
+// restarted GMRES, preconditioned on the right by the diagonal so the residual it
+// tracks is the true one
+int ConductorSet::gmres(const std::vector<double> &b, std::vector<double> &x, double &residual, ThreadPool &pool)
+{
+    size_t n = b.size();
+    double bNorm = std::sqrt(dot(b, b));
+    if (bNorm == 0.0)
+    {
+        x.assign(n, 0.0);
+        residual = 0.0;
+        return 0;
+    }
+
+    int m = restart;
+    std::vector<std::vector<double>> basis(m + 1, std::vector<double>(n));
+    std::vector<double> h((m + 1) * m), cs(m), sn(m), g(m + 1), y(m);
+    std::vector<double> w(n), z(n);
+
+    int iterations = 0;
+    while (true)
+    {
+        multiply(x, w, pool);
+        for (size_t i = 0; i < n; i++)
+        {
+            w[i] = b[i] - w[i];
+        }
+        double beta = std::sqrt(dot(w, w));
+        residual = beta / bNorm;
+        if (residual < tolerance || iterations >= maxIterations)
+        {
+            return iterations;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            basis[0][i] = w[i] / beta;
+        }
+        std::fill(g.begin(), g.end(), 0.0);
+        g[0] = beta;
+
+        int k = 0;
+        while (k < m && iterations < maxIterations)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                z[i] = basis[k][i] / diagonal[i];
+            }
+            multiply(z, w, pool);
+
+            // modified Gram-Schmidt against the basis so far
+            for (int j = 0; j <= k; j++)
+            {
+                double hjk = dot(w, basis[j]);
+                h[j * m + k] = hjk;
+                for (size_t i = 0; i < n; i++)
+                {
+                    w[i] -= hjk * basis[j][i];
+                }
+            }
+            double next = std::sqrt(dot(w, w));
+            h[(k + 1) * m + k] = next;
+            if (next > 0.0)
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    basis[k + 1][i] = w[i] / next;
+                }
+            }
+
+            // keep the Hessenberg matrix triangular with Givens rotations
+            for (int j = 0; j < k; j++)
+            {
+                double a = h[j * m + k];
+                double c = h[(j + 1) * m + k];
+                h[j * m + k] = cs[j] * a + sn[j] * c;
+                h[(j + 1) * m + k] = -sn[j] * a + cs[j] * c;
+            }
+            double diag = h[k * m + k];
+            double r = std::sqrt(diag * diag + next * next);
+            cs[k] = diag / r;
+            sn[k] = next / r;
+            h[k * m + k] = r;
+            h[(k + 1) * m + k] = 0.0;
+            g[k + 1] = -sn[k] * g[k];
+            g[k] = cs[k] * g[k];
+
+            k++;
+            iterations++;
+            if (std::abs(g[k]) / bNorm < tolerance || next == 0.0)
+            {
+                break;
+            }
+        }
+
+        // x += M^-1 V y with H y = g
+        for (int j = k - 1; j >= 0; j--)
+        {
+            double sum = g[j];
+            for (int l = j + 1; l < k; l++)
+            {
+                sum -= h[j * m + l] * y[l];
+            }
+            y[j] = sum / h[j * m + j];
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            double sum = 0.0;
+            for (int j = 0; j < k; j++)
+            {
+                sum += y[j] * basis[j][i];
+            }
+            x[i] += sum / diagonal[i];
+        }
+    }
+}
+
+ConductorStats ConductorSet::solve(const ChargeSet &charges, ThreadPool &pool)
+{
+    ConductorStats stats;
+    if (panels.empty())
+    {
+        return stats;
+    }
+    double start = seconds();
+    if (!prepared)
+    {
+        prepare(pool);
+    }
+
+    // each centroid has to make up the difference between its conductor's potential and
+    // the free charges'
+    size_t n = panels.size();
+    chargeTree.build(charges);
+    std::vector<double> b(n);
+    pool.parallelFor(0, n, 256, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            b[i] = potentials[panels[i].conductor] - chargeTree.potential(panels[i].centroid, theta);
+        }
+    });
+
+    stats.iterations = gmres(b, density, stats.residual, pool);
+
+    for (size_t j = 0; j < n; j++)
+    {
+        float q = density[j] * panels[j].area / 3.0;
+        points.q[3 * j + 0] = q;
+        points.q[3 * j + 1] = q;
+        points.q[3 * j + 2] = q;
+    }
+    stats.seconds = seconds() - start;
+    return stats;
+}
+
+float ConductorSet::totalCharge(int conductor) const
+{
+    double sum = 0.0;
+    for (size_t j = 0; j < panels.size() && j < density.size(); j++)
+    {
+        if (panels[j].conductor == conductor)
+        {
+            sum += density[j] * panels[j].area;
+        }
+    }
+    return sum;
+}
+
+const ChargeSet &ConductorSet::sources() const
+{
+    return points;
+}
@@ -0,0 +1,93 @@
+#ifndef CONDUCTOR_H
+#define CONDUCTOR_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+#include "chargeTree.h"
+#include "threadPool.h"
+
+struct ConductorStats
+{
+    int iterations = 0;
+    // relative residual the solve stopped at
+    double residual = 0.0;
+    double seconds = 0.0;
+};
+
+// conductors held at fixed potentials, solved with the boundary element method. every
+// triangle of a conductor's mesh is a panel with a constant surface charge density, and
+// the densities are found so the potential at every panel's centroid is the conductor's
+// own once the free charges' potential is added.
+//
+// the system is dense, so it's never formed: GMRES only needs products with it, which
+// are a Barnes-Hut pass over the panels as three point charges each (a degree 2 rule)
+// plus a sparse correction for the panels near each centroid, where the point rule
+// is replaced by the exact integral over the triangle. the diagonal, the panel's own
+// potential at its centroid, preconditions it
+class ConductorSet
+{
+    struct Panel
+    {
+        glm::vec3 vertex[3];
+        glm::vec3 centroid;
+        float area;
+        float size; // longest edge
+        int conductor;
+    };
+
+    std::vector<Panel> panels;
+    std::vector<float> potentials;
+
+    // the panels' quadrature points, the tree over them is built once per mesh and only
+    // gets new charges after that
+    ChargeTree panelTree;
+    ChargeSet points;
+    std::vector<float> pointCharges;
+    bool prepared = false;
+
+    // near field corrections as sparse rows, exact integral minus the point rule
+    std::vector<size_t> nearStart;
+    std::vector<int> nearPanel;
+    std::vector<float> nearValue;
+    std::vector<double> diagonal;
+
+    // the last solution, the next solve starts from it
+    std::vector<double> density;
+
+    ChargeTree chargeTree;
+
+    void prepare(ThreadPool &pool);
+    void findNear(ThreadPool &pool);
+    void multiply(const std::vector<double> &x, std::vector<double> &y, ThreadPool &pool);
+    int gmres(const std::vector<double> &b, std::vector<double> &x, double &residual, ThreadPool &pool);
+
+public:
+    // the Barnes-Hut opening angle of the products
+    float theta = 0.4f;
+    // panels closer than this many times their longest edge are integrated exactly
+    float nearFactor = 3.0f;
+    int restart = 30;
+    int maxIterations = 500;
+    double tolerance = 1e-4;
+
+    // adds the triangles of an obj file as one conductor at the given potential, every
+    // vertex moved to offset + scale * v. throws std::runtime_error if it can't be read
+    void load(const std::string &path, float potential, const glm::vec3 &offset, float scale);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    size_t conductorCount() const;
+
+    // the panel densities that hold every conductor at its potential next to the charges
+    ConductorStats solve(const ChargeSet &charges, ThreadPool &pool);
+    // net charge of a conductor as of the last solve
+    float totalCharge(int conductor) const;
+    // the solved surface charge as point charges, three per panel
+    const ChargeSet &sources() const;
+};
+
+#endif // CONDUCTOR_H
@@ -0,0 +1,161 @@
+#include "culling.h"
+
+#include <algorithm>
+
+ArrowCuller::ArrowCuller(ThreadPool &threadPool, FrameArena &frameArena) : pool(threadPool), arena(frameArena)
+{
+}
+
+size_t ArrowCuller::brickIndex(int bx, int by, int bz) const
+{
+    return ((size_t)bx * bricksAcross + by) * bricksAcross + bz;
+}
+
+void ArrowCuller::classify(const Lattice &lattice, const Frustum &frustum, glm::ivec3 lo, glm::ivec3 hi)
+{
+    // bounds of the arrows in bricks [lo, hi)
+    glm::vec3 boxLo = glm::vec3(lo * brickSize) * lattice.edgeSpace - glm::vec3(arrowRadius);
+    glm::ivec3 lastArrow = glm::min(hi * brickSize, glm::ivec3(lattice.edgeSize)) - glm::ivec3(1);
+    glm::vec3 boxHi = glm::vec3(lastArrow) * lattice.edgeSpace + glm::vec3(arrowRadius);
+
+    Frustum::Result result = frustum.testBox(boxLo, boxHi);
+    glm::ivec3 size = hi - lo;
+    bool single = size.x == 1 && size.y == 1 && size.z == 1;
+
+    if (result != Frustum::INTERSECTS || single)
+    {
+        for (int bx = lo.x; bx < hi.x; bx++)
+            for (int by = lo.y; by < hi.y; by++)
+                for (int bz = lo.z; bz < hi.z; bz++)
+                    brickState[brickIndex(bx, by, bz)] = result;
+        return;
+    }
+
+    // split the longest axis and recurse
+    int axis = 0;
+    if (size.y > size[axis])
+        axis = 1;
+    if (size.z > size[axis])
+        axis = 2;
+    glm::ivec3 mid = hi;
+    mid[axis] = lo[axis] + size[axis] / 2;
+    glm::ivec3 midLo = lo;
+    midLo[axis] = mid[axis];
+
+    classify(lattice, frustum, lo, mid);
+    classify(lattice, frustum, midLo, hi);
+}
+
+bool ArrowCuller::cull(const Lattice &lattice, const ArrowField &field, unsigned long fieldVersion,
+                       const Camera &camera, std::vector<Model::PackedInstance> &out)
+{
+    const glm::mat4 &viewProj = camera.viewProj();
+    bool fieldChanged = fieldVersion != cachedVersion;
+    if (!fieldChanged && viewProj == cachedViewProj)
+    {
+        return false;
+    }
+    cachedViewProj = viewProj;
+
+    // the instances only depend on the field, build them once per solve. arrows sit one
+    // unit down z from their lattice point
+    if (fieldChanged)
+    {
+        positionBias = lattice.position(0, 0, 0) + glm::vec3(0.0f, 0.0f, -1.0f);
+        positionScale = glm::vec3(std::max((lattice.edgeSize - 1) * lattice.edgeSpace, 1e-6f));
+        transforms.resize(lattice.count());
+        pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+            for (int x = first; x < (int)last; x++)
+                for (int y = 0; y < lattice.edgeSize; y++)
+                    for (int z = 0; z < lattice.edgeSize; z++)
+                    {
+                        size_t i = lattice.index(x, y, z);
+                        if (field.alpha[i] > 0.0f)
+                        {
+                            glm::vec3 pos = lattice.position(x, y, z) + glm::vec3(0.0f, 0.0f, -1.0f);
+                            transforms[i] = Model::packInstance(pos, field.direction[i], field.alpha[i],
+                                                                positionBias, positionScale);
+                        }
+                    }
+        });
+        cachedVersion = fieldVersion;
+    }
+
+    bricksAcross = (lattice.edgeSize + brickSize - 1) / brickSize;
+    size_t brickTotal = (size_t)bricksAcross * bricksAcross * bricksAcross;
+    brickState = arena.allocate<Frustum::Result>(brickTotal);
+    brickCount = arena.allocate<size_t>(brickTotal);
+    brickOffset = arena.allocate<size_t>(brickTotal);
+    keep = arena.allocate<unsigned char>(lattice.count());
+    std::fill_n(brickCount, brickTotal, 0);
+    std::fill_n(keep, lattice.count(), 0);
+
+    const Frustum &frustum = camera.frustum();
+    classify(lattice, frustum, glm::ivec3(0), glm::ivec3(bricksAcross));
+
+    // count the survivors of every brick, arrows in partially visible bricks get a sphere test
+    pool.parallelFor(0, brickTotal, 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; b++)
+        {
+            if (brickState[b] == Frustum::OUTSIDE)
+            {
+                continue;
+            }
+
+            int bx = b / (bricksAcross * bricksAcross);
+            int by = (b / bricksAcross) % bricksAcross;
+            int bz = b % bricksAcross;
+            size_t count = 0;
+            for (int x = bx * brickSize; x < std::min((bx + 1) * brickSize, lattice.edgeSize); x++)
+                for (int y = by * brickSize; y < std::min((by + 1) * brickSize, lattice.edgeSize); y++)
+                    for (int z = bz * brickSize; z < std::min((bz + 1) * brickSize, lattice.edgeSize); z++)
+                    {
+                        size_t i = lattice.index(x, y, z);
+                        if (field.alpha[i] <= 0.0f)
+                        {
+                            continue;
+                        }
+                        if (brickState[b] == Frustum::INTERSECTS &&
+                            !frustum.testSphere(lattice.position(x, y, z), arrowRadius))
+                        {
+                            continue;
+                        }
+                        keep[i] = 1;
+                        count++;
+                    }
+            brickCount[b] = count;
+        }
+    });
+
+    arrowsDrawn = parallelExclusiveScan(pool, brickCount, brickOffset, brickTotal);
+    bricksCulled = std::count(brickState, brickState + brickTotal, Frustum::OUTSIDE);
+    out.resize(arrowsDrawn);
+
+    // every brick owns out[offset, offset + count), so the writes don't overlap
+    pool.parallelFor(0, brickTotal, 1, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; b++)
+        {
+            if (brickCount[b] == 0)
+            {
+                continue;
+            }
+
+            int bx = b / (bricksAcross * bricksAcross);
+            int by = (b / bricksAcross) % bricksAcross;
+            int bz = b % bricksAcross;
+            size_t next = brickOffset[b];
+            for (int x = bx * brickSize; x < std::min((bx + 1) * brickSize, lattice.edgeSize); x++)
+                for (int y = by * brickSize; y < std::min((by + 1) * brickSize, lattice.edgeSize); y++)
+                    for (int z = bz * brickSize; z < std::min((bz + 1) * brickSize, lattice.edgeSize); z++)
+                    {
+                        size_t i = lattice.index(x, y, z);
+                        if (!keep[i])
+                        {
+                            continue;
+                        }
+                        out[next++] = transforms[i];
+                    }
+        }
+    });
+    return true;
+}
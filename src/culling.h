@@ -0,0 +1,60 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "field.h"
+#include "model.h"
+#include "threadPool.h"
+#include "frameArena.h"
+#include "frustum.h"
+
+// sits between evaluateArrows and the instanced draw: drops invisible arrows and packs
+// the rest into an instance list. bricks of the lattice are tested hierarchically against
+// the frustum, then survivors are counted per brick, the counts prefix summed and every
+// brick writes its arrows to its own slice of the output in parallel. arrows are packed
+// instances, only rebuilt when the field version changes, and nothing runs at all when
+// neither the field nor the camera moved
+class ArrowCuller
+{
+    void classify(const Lattice &lattice, const Frustum &frustum, glm::ivec3 lo, glm::ivec3 hi);
+    size_t brickIndex(int bx, int by, int bz) const;
+
+    ThreadPool &pool;
+    FrameArena &arena;
+    int bricksAcross = 0;
+
+    // scratch from the frame arena, only valid during cull(): per brick frustum result,
+    // survivor count and output offset, and per arrow whether it survived
+    Frustum::Result *brickState = nullptr;
+    size_t *brickCount = nullptr;
+    size_t *brickOffset = nullptr;
+    unsigned char *keep = nullptr;
+
+    // per arrow instances for the field version below, reused while the camera moves
+    std::vector<Model::PackedInstance> transforms;
+    unsigned long cachedVersion = 0;
+    glm::mat4 cachedViewProj;
+
+public:
+    static const int brickSize = 4;
+
+    // bounding sphere of an arrow around its lattice point
+    float arrowRadius = 9.0f;
+
+    // quantization of the packed arrow positions, for Model::renderPacked
+    glm::vec3 positionBias, positionScale;
+
+    size_t bricksCulled = 0;
+    size_t arrowsDrawn = 0;
+
+    ArrowCuller(ThreadPool &threadPool, FrameArena &frameArena);
+    // returns false, leaving out untouched, when neither the field nor the camera changed
+    bool cull(const Lattice &lattice, const ArrowField &field, unsigned long fieldVersion,
+              const Camera &camera, std::vector<Model::PackedInstance> &out);
+};
+
+#endif // CULLING_H
@@ -0,0 +1,186 @@
+#include "currents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// two unit vectors perpendicular to normal and each other
+static void planeBasis(const glm::vec3 &normal, glm::vec3 &e1, glm::vec3 &e2)
+{
+    glm::vec3 n = glm::normalize(normal);
+    glm::vec3 helper = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    e1 = glm::normalize(glm::cross(n, helper));
+    e2 = glm::cross(n, e1);
+}
+
+size_t CurrentSet::size() const
+{
+    return current.size();
+}
+
+bool CurrentSet::empty() const
+{
+    return current.empty();
+}
+
+void CurrentSet::clear()
+{
+    ax.clear();
+    ay.clear();
+    az.clear();
+    bx.clear();
+    by.clear();
+    bz.clear();
+    current.clear();
+}
+
+void CurrentSet::addSegment(const glm::vec3 &a, const glm::vec3 &b, float i)
+{
+    ax.push_back(a.x);
+    ay.push_back(a.y);
+    az.push_back(a.z);
+    bx.push_back(b.x);
+    by.push_back(b.y);
+    bz.push_back(b.z);
+    current.push_back(i);
+}
+
+void CurrentSet::addLoop(const glm::vec3 &center, const glm::vec3 &normal, float radius, float i)
+{
+    glm::vec3 e1, e2;
+    planeBasis(normal, e1, e2);
+    int n = std::max(segmentsPerTurn, 3);
+    for (int s = 0; s < n; s++)
+    {
+        float t0 = 2.0f * (float)M_PI * s / n;
+        float t1 = 2.0f * (float)M_PI * (s + 1) / n;
+        addSegment(center + radius * (cosf(t0) * e1 + sinf(t0) * e2),
+                   center + radius * (cosf(t1) * e1 + sinf(t1) * e2), i);
+    }
+}
+
+void CurrentSet::addCoil(const glm::vec3 &start, const glm::vec3 &axis, float radius, float turns, float i)
+{
+    glm::vec3 e1, e2;
+    planeBasis(axis, e1, e2);
+    int n = std::max(1, (int)std::ceil(std::max(segmentsPerTurn, 3) * turns));
+    glm::vec3 previous = start + radius * e1;
+    for (int s = 1; s <= n; s++)
+    {
+        float f = (float)s / n;
+        float t = 2.0f * (float)M_PI * turns * f;
+        glm::vec3 next = start + f * axis + radius * (cosf(t) * e1 + sinf(t) * e2);
+        addSegment(previous, next, i);
+        previous = next;
+    }
+}
+
+glm::vec3 CurrentSet::field(const glm::vec3 &p) const
+{
+    float x = p.x, y = p.y, z = p.z;
+    float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+    float nearest = 1e30f;
+    biotSavart(*this, &x, &y, &z, 1, &fx, &fy, &fz, &nearest);
+    return glm::vec3(fx, fy, fz);
+}
+
+void biotSavart(const CurrentSet &currents, const float *x, const float *y, const float *z, size_t n,
+                float *fieldX, float *fieldY, float *fieldZ, float *nearest)
+{
+    const float core = coulombMinDist * coulombMinDist;
+    for (size_t s = 0; s < currents.size(); s++)
+    {
+        float sx = currents.bx[s] - currents.ax[s];
+        float sy = currents.by[s] - currents.ay[s];
+        float sz = currents.bz[s] - currents.az[s];
+        float lengthSquared = sx * sx + sy * sy + sz * sz;
+        float invLengthSquared = lengthSquared > 0.0f ? 1.0f / lengthSquared : 0.0f;
+        float i = currents.current[s];
+
+        for (size_t k = 0; k < n; k++)
+        {
+            // a and b run from the point to the ends, B = I (a x b) (|a| + |b|) / (|a| |b| (|a| |b| + a.b))
+            float ax = currents.ax[s] - x[k];
+            float ay = currents.ay[s] - y[k];
+            float az = currents.az[s] - z[k];
+            float bx = currents.bx[s] - x[k];
+            float by = currents.by[s] - y[k];
+            float bz = currents.bz[s] - z[k];
+            float la = std::sqrt(ax * ax + ay * ay + az * az);
+            float lb = std::sqrt(bx * bx + by * by + bz * bz);
+            float lab = la * lb;
+            float ab = ax * bx + ay * by + az * bz;
+            float cx = ay * bz - az * by;
+            float cy = az * bx - ax * bz;
+            float cz = ax * by - ay * bx;
+
+            // beside a long segment |a| |b| + a.b cancels, |a x b|^2 / (|a| |b| - a.b) is the same
+            float c2 = cx * cx + cy * cy + cz * cz;
+            float sum = ab >= 0.0f ? lab + ab : c2 / (lab - ab);
+
+            // |a x b| / |b - a| is the distance d from the wire's line. closer than
+            // coulombMinDist the field is scaled by d^2 / coulombMinDist^2, a solid core
+            // that goes to zero on the wire instead of blowing up
+            float coreSquared = core * lengthSquared;
+            float denominator = lab * sum * coreSquared;
+            float scale = i * (la + lb) * std::min(c2, coreSquared) / std::max(denominator, 1e-30f);
+            fieldX[k] += scale * cx;
+            fieldY[k] += scale * cy;
+            fieldZ[k] += scale * cz;
+
+            // closest point of the segment, clamped to its ends
+            float t = std::min(std::max(-(ax * sx + ay * sy + az * sz) * invLengthSquared, 0.0f), 1.0f);
+            float dx = ax + t * sx;
+            float dy = ay + t * sy;
+            float dz = az + t * sz;
+            nearest[k] = std::min(nearest[k], std::sqrt(dx * dx + dy * dy + dz * dz));
+        }
+    }
+}
+
+void loadCurrents(const std::string &path, CurrentSet &currents)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        throw std::runtime_error("Current Error: could not open " + path);
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type))
+        {
+            continue;
+        }
+
+        // how many numbers each type takes, current last
+        int expected = type == "segment" ? 7 : type == "loop" ? 8 : type == "coil" ? 9 : 0;
+        float v[9];
+        int read = 0;
+        while (read < expected && fields >> v[read])
+        {
+            read++;
+        }
+        std::string extra;
+        if (expected == 0 || read != expected || fields >> extra)
+        {
+            throw std::runtime_error("Current Error: " + path + " line " + std::to_string(lineNumber) +
+                                     " is not a segment, loop or coil");
+        }
+
+        glm::vec3 a = glm::vec3(v[0], v[1], v[2]);
+        glm::vec3 b = glm::vec3(v[3], v[4], v[5]);
+        if (type == "segment")
+            currents.addSegment(a, b, v[6]);
+        else if (type == "loop")
+            currents.addLoop(a, b, v[6], v[7]);
+        else
+            currents.addCoil(a, b, v[6], v[7], v[8]);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef CURRENTS_H
+#define CURRENTS_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+
+// straight wire segments carrying a current from a to b, stored as a structure of arrays
+// like ChargeSet. loops and coils are built out of segments. the units match the
+// charges': B = I dl x r / |r|^3, so a long straight wire's field is 2 I / distance
+struct CurrentSet
+{
+    std::vector<float> ax, ay, az;
+    std::vector<float> bx, by, bz;
+    std::vector<float> current;
+
+    // segments per turn of the loops and coils added after it's set
+    int segmentsPerTurn = 32;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void addSegment(const glm::vec3 &a, const glm::vec3 &b, float current);
+    // a circle around center, counter clockwise seen from the normal's side
+    void addLoop(const glm::vec3 &center, const glm::vec3 &normal, float radius, float current);
+    // a helix of turns around axis, which runs the coil's length from the center of one end
+    // to the other. counter clockwise seen from the far end
+    void addCoil(const glm::vec3 &start, const glm::vec3 &axis, float radius, float turns, float current);
+
+    // field at one point, mostly for checks. the lattice goes through biotSavart
+    glm::vec3 field(const glm::vec3 &p) const;
+};
+
+// adds the field of every segment at a batch of n points, given as coordinate arrays, to
+// fieldX/Y/Z and lowers nearest to each point's distance from the closest segment. the
+// segments are the outer loop so the inner one is straight line math over the points the
+// compiler can vectorize. within coulombMinDist of a wire the field is smoothed out to
+// stay finite
+void biotSavart(const CurrentSet &currents, const float *x, const float *y, const float *z, size_t n,
+                float *fieldX, float *fieldY, float *fieldZ, float *nearest);
+
+// reads wires from a text file, one per line, blank lines and # comments skipped:
+//   segment ax ay az  bx by bz  I
+//   loop    cx cy cz  nx ny nz  radius  I
+//   coil    sx sy sz  ax ay az  radius  turns  I      (a runs the length of the coil)
+// throws std::runtime_error naming the line if one can't be read
+void loadCurrents(const std::string &path, CurrentSet &currents);
+
+#endif // CURRENTS_H
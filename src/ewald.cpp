@@ -0,0 +1,532 @@
+#include "ewald.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+// erfc(x) is 1e-5 here, the default splitting drops the direct part at that size
+static const float directTolerance = 3.123f;
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the order n B-spline weights M_n(w + n - 1 - i) and their derivatives for the n mesh
+// points a coordinate with fraction w touches, the recursion from Essmann et al. 1995
+static void fillBSpline(double w, int n, double *value, double *derivative)
+{
+    value[n - 1] = 0.0;
+    value[1] = w;
+    value[0] = 1.0 - w;
+    for (int k = 3; k < n; k++)
+    {
+        double div = 1.0 / (k - 1);
+        value[k - 1] = div * w * value[k - 2];
+        for (int j = 1; j < k - 1; j++)
+        {
+            value[k - j - 1] = div * ((w + j) * value[k - j - 2] + (k - j - w) * value[k - j - 1]);
+        }
+        value[0] = div * (1.0 - w) * value[0];
+    }
+
+    // the derivative of order n comes from order n - 1
+    derivative[0] = -value[0];
+    for (int j = 1; j < n; j++)
+    {
+        derivative[j] = value[j - 1] - value[j];
+    }
+
+    double div = 1.0 / (n - 1);
+    value[n - 1] = div * w * value[n - 2];
+    for (int j = 1; j < n - 1; j++)
+    {
+        value[n - j - 1] = div * ((w + j) * value[n - j - 2] + (n - j - w) * value[n - j - 1]);
+    }
+    value[0] = div * (1.0 - w) * value[0];
+}
+
+// power of two mesh edge for an axis, scaled so mesh spacing is about the same on all
+static int meshEdge(const glm::vec3 &cellSize, const EwaldParams &params, int axis)
+{
+    float longest = std::max(std::max(cellSize.x, cellSize.y), cellSize.z);
+    int wanted = (int)ceil(params.meshSize * cellSize[axis] / longest);
+    return Fft3d::nextPowerOfTwo(std::max(wanted, params.order));
+}
+
+// the direct part of the split coulomb field of charge q at offset r
+static glm::vec3 screenedField(const glm::vec3 &r, float q, float beta)
+{
+    float d = std::max(glm::length(r), coulombMinDist);
+    float bd = beta * d;
+    float screen = erfc(bd) + 1.1283792f * bd * exp(-bd * bd); // 2 / sqrt(pi)
+    return q * screen * r / (d * d * d);
+}
+
+EwaldSolver::EwaldSolver(const glm::vec3 &cellSize, const EwaldParams &ewaldParams)
+    : cell(cellSize), params(ewaldParams),
+      fft(meshEdge(cellSize, ewaldParams, 0), meshEdge(cellSize, ewaldParams, 1), meshEdge(cellSize, ewaldParams, 2))
+{
+    float shortest = std::min(std::min(cell.x, cell.y), cell.z);
+    if (params.cutoff <= 0.0f || params.cutoff > 0.5f * shortest)
+    {
+        throw std::runtime_error("Ewald Error: the cutoff has to be within half the cell's shortest edge");
+    }
+    if (params.order < 3 || params.order > 12)
+    {
+        throw std::runtime_error("Ewald Error: the spline order has to be between 3 and 12");
+    }
+
+    beta = params.splitting > 0.0f ? params.splitting : directTolerance / params.cutoff;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mesh[axis] = meshEdge(cell, params, axis);
+        cellCount[axis] = std::max(1, (int)(cell[axis] / params.cutoff));
+    }
+    potential.resize(fft.size());
+    buildInfluence();
+}
+
+const EwaldParams &EwaldSolver::settings() const
+{
+    return params;
+}
+
+const glm::vec3 &EwaldSolver::cellSize() const
+{
+    return cell;
+}
+
+float EwaldSolver::splitting() const
+{
+    return beta;
+}
+
+bool EwaldSolver::matches(const glm::vec3 &cellSize, const EwaldParams &ewaldParams) const
+{
+    return cell == cellSize && params.meshSize == ewaldParams.meshSize && params.order == ewaldParams.order &&
+           params.cutoff == ewaldParams.cutoff && params.splitting == ewaldParams.splitting;
+}
+
+void EwaldSolver::buildInfluence()
+{
+    int n = params.order;
+    std::vector<double> splineAt(n), unused(n);
+    fillBSpline(0.0, n, &splineAt[0], &unused[0]);
+
+    // |b(m)|^2 per axis, the spline's smearing that the mesh solve divides back out
+    std::vector<double> bmod[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int k = mesh[axis];
+        bmod[axis].resize(k);
+        for (int m = 0; m < k; m++)
+        {
+            std::complex<double> sum = 0.0;
+            for (int j = 0; j < n - 1; j++)
+            {
+                // M_n(j + 1) is weight n - 2 - j at w = 0
+                double angle = 2.0 * M_PI * m * j / k;
+                sum += splineAt[n - 2 - j] * std::complex<double>(cos(angle), sin(angle));
+            }
+            bmod[axis][m] = std::norm(sum);
+        }
+        // odd orders vanish at the Nyquist frequency, borrow the neighbors
+        for (int m = 0; m < k; m++)
+        {
+            if (bmod[axis][m] < 1e-7)
+            {
+                bmod[axis][m] = 0.5 * (bmod[axis][(m + k - 1) % k] + bmod[axis][(m + 1) % k]);
+            }
+        }
+    }
+
+    double volume = (double)cell.x * cell.y * cell.z;
+    influence.resize(fft.size());
+    for (int z = 0; z < mesh[2]; z++)
+    {
+        for (int y = 0; y < mesh[1]; y++)
+        {
+            for (int x = 0; x < mesh[0]; x++)
+            {
+                int m[3] = {x, y, z};
+                double m2 = 0.0;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    int signedM = m[axis] <= mesh[axis] / 2 ? m[axis] : m[axis] - mesh[axis];
+                    double component = signedM / (double)cell[axis];
+                    m2 += component * component;
+                }
+
+                // exp(-pi^2 m^2 / beta^2) / (pi V m^2), the zero mode is the neutralizing background
+                size_t i = ((size_t)z * mesh[1] + y) * mesh[0] + x;
+                influence[i] = m2 == 0.0 ? 0.0
+                                         : exp(-M_PI * M_PI * m2 / ((double)beta * beta)) / (M_PI * volume * m2) /
+                                               (bmod[0][x] * bmod[1][y] * bmod[2][z]);
+            }
+        }
+    }
+}
+
+glm::vec3 EwaldSolver::wrap(const glm::vec3 &p) const
+{
+    glm::vec3 w = p;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        w[axis] -= cell[axis] * floor(w[axis] / cell[axis]);
+        if (w[axis] >= cell[axis])
+        {
+            w[axis] = 0.0f;
+        }
+    }
+    return w;
+}
+
+void EwaldSolver::buildCellList(const ChargeSet &charges)
+{
+    size_t cells = (size_t)cellCount[0] * cellCount[1] * cellCount[2];
+    std::vector<size_t> owner(charges.size());
+    cellStart.assign(cells + 1, 0);
+    for (size_t i = 0; i < charges.size(); i++)
+    {
+        glm::vec3 p = wrap(charges.position(i));
+        int c[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            c[axis] = std::min((int)(p[axis] / cell[axis] * cellCount[axis]), cellCount[axis] - 1);
+        }
+        owner[i] = ((size_t)c[2] * cellCount[1] + c[1]) * cellCount[0] + c[0];
+        cellStart[owner[i] + 1]++;
+    }
+    for (size_t c = 0; c < cells; c++)
+    {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    // counting sort, wrapped holds the charges cell by cell
+    std::vector<size_t> next(cellStart.begin(), cellStart.end() - 1);
+    wrapped.x.resize(charges.size());
+    wrapped.y.resize(charges.size());
+    wrapped.z.resize(charges.size());
+    wrapped.q.resize(charges.size());
+    for (size_t i = 0; i < charges.size(); i++)
+    {
+        glm::vec3 p = wrap(charges.position(i));
+        size_t slot = next[owner[i]]++;
+        wrapped.x[slot] = p.x;
+        wrapped.y[slot] = p.y;
+        wrapped.z[slot] = p.z;
+        wrapped.q[slot] = charges.q[i];
+    }
+}
+
+void EwaldSolver::spread(ThreadPool &pool)
+{
+    int n = params.order;
+    size_t count = wrapped.size();
+
+    // spline weights per charge in parallel, the scatter onto the mesh is serial
+    std::vector<int> base(count * 3);
+    std::vector<double> weights(count * 3 * n);
+    pool.parallelFor(0, count, 1024, [&](size_t first, size_t last) {
+        std::vector<double> unused(n);
+        for (size_t i = first; i < last; i++)
+        {
+            glm::vec3 p = wrapped.position(i);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                double u = p[axis] / cell[axis] * mesh[axis];
+                double whole = floor(u);
+                base[i * 3 + axis] = (int)whole - n + 1;
+                fillBSpline(u - whole, n, &weights[(i * 3 + axis) * n], &unused[0]);
+            }
+        }
+    });
+
+    std::fill(potential.begin(), potential.end(), std::complex<double>(0.0));
+    for (size_t i = 0; i < count; i++)
+    {
+        const double *wx = &weights[(i * 3 + 0) * n];
+        const double *wy = &weights[(i * 3 + 1) * n];
+        const double *wz = &weights[(i * 3 + 2) * n];
+        for (int c = 0; c < n; c++)
+        {
+            int z = (base[i * 3 + 2] + c + mesh[2]) % mesh[2];
+            for (int b = 0; b < n; b++)
+            {
+                int y = (base[i * 3 + 1] + b + mesh[1]) % mesh[1];
+                double qzy = wrapped.q[i] * wz[c] * wy[b];
+                size_t row = ((size_t)z * mesh[1] + y) * mesh[0];
+                for (int a = 0; a < n; a++)
+                {
+                    int x = (base[i * 3 + 0] + a + mesh[0]) % mesh[0];
+                    potential[row + x] += qzy * wx[a];
+                }
+            }
+        }
+    }
+}
+
+void EwaldSolver::setCharges(const ChargeSet &charges, ThreadPool &pool)
+{
+    buildCellList(charges);
+    spread(pool);
+
+    // convolving the spread charges with the influence function gives the mesh potential
+    fft.forward(potential, pool);
+    pool.parallelFor(0, potential.size(), 4096, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            potential[i] *= influence[i];
+        }
+    });
+    fft.inverse(potential, pool);
+}
+
+glm::vec3 EwaldSolver::realField(const glm::vec3 &point) const
+{
+    glm::vec3 p = wrap(point);
+    glm::vec3 e = glm::vec3(0.0f);
+    if (wrapped.empty())
+    {
+        return e;
+    }
+
+    // the neighboring cells along each axis, or all of them when there are fewer than three
+    int neighbors[3][3];
+    int neighborCount[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int count = cellCount[axis];
+        int c = std::min((int)(p[axis] / cell[axis] * count), count - 1);
+        neighborCount[axis] = std::min(count, 3);
+        for (int k = 0; k < neighborCount[axis]; k++)
+        {
+            neighbors[axis][k] = count < 3 ? k : (c + k - 1 + count) % count;
+        }
+    }
+
+    float cutoff2 = params.cutoff * params.cutoff;
+    for (int k = 0; k < neighborCount[2]; k++)
+    {
+        for (int j = 0; j < neighborCount[1]; j++)
+        {
+            for (int i = 0; i < neighborCount[0]; i++)
+            {
+                size_t c = ((size_t)neighbors[2][k] * cellCount[1] + neighbors[1][j]) * cellCount[0] + neighbors[0][i];
+                for (size_t s = cellStart[c]; s < cellStart[c + 1]; s++)
+                {
+                    // the nearest image, the cutoff is within half the cell so there's only one
+                    glm::vec3 r = p - wrapped.position(s);
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        r[axis] -= cell[axis] * floor(r[axis] / cell[axis] + 0.5f);
+                    }
+                    if (glm::dot(r, r) < cutoff2)
+                    {
+                        e += screenedField(r, wrapped.q[s], beta);
+                    }
+                }
+            }
+        }
+    }
+    return e;
+}
+
+glm::vec3 EwaldSolver::meshField(const glm::vec3 &point) const
+{
+    int n = params.order;
+    double value[3][12], derivative[3][12];
+    int base[3];
+    glm::vec3 p = wrap(point);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double u = p[axis] / cell[axis] * mesh[axis];
+        double whole = floor(u);
+        base[axis] = (int)whole - n + 1;
+        fillBSpline(u - whole, n, value[axis], derivative[axis]);
+    }
+
+    // minus the gradient of the interpolated mesh potential
+    double gradient[3] = {0.0, 0.0, 0.0};
+    for (int c = 0; c < n; c++)
+    {
+        int z = (base[2] + c + mesh[2]) % mesh[2];
+        for (int b = 0; b < n; b++)
+        {
+            int y = (base[1] + b + mesh[1]) % mesh[1];
+            size_t row = ((size_t)z * mesh[1] + y) * mesh[0];
+            for (int a = 0; a < n; a++)
+            {
+                int x = (base[0] + a + mesh[0]) % mesh[0];
+                double phi = potential[row + x].real();
+                gradient[0] += derivative[0][a] * value[1][b] * value[2][c] * phi;
+                gradient[1] += value[0][a] * derivative[1][b] * value[2][c] * phi;
+                gradient[2] += value[0][a] * value[1][b] * derivative[2][c] * phi;
+            }
+        }
+    }
+    return glm::vec3(-gradient[0] * mesh[0] / cell.x, -gradient[1] * mesh[1] / cell.y,
+                     -gradient[2] * mesh[2] / cell.z);
+}
+
+glm::vec3 EwaldSolver::field(const glm::vec3 &p) const
+{
+    return realField(p) + meshField(p);
+}
+
+namespace
+{
+
+// the classic Ewald sum, direct part over the whole nearest image cell and the
+// reciprocal part summed over wave vectors until it's converged
+struct ReferenceEwald
+{
+    glm::vec3 cell;
+    const ChargeSet &charges;
+    double beta;
+    double cutoff;
+    std::vector<glm::dvec3> waves;
+    std::vector<std::complex<double> > structure;
+
+    ReferenceEwald(const glm::vec3 &cellSize, const ChargeSet &chargeSet, ThreadPool &pool)
+        : cell(cellSize), charges(chargeSet)
+    {
+        cutoff = 0.5 * std::min(std::min(cell.x, cell.y), cell.z);
+        beta = 3.8 / cutoff; // erfc is below 1e-7 at the cutoff
+
+        // exp(-pi^2 m^2 / beta^2) is below 1e-8 past this
+        double reach = beta * sqrt(log(1e8)) / M_PI;
+        int kmax[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            kmax[axis] = (int)ceil(reach * cell[axis]);
+        }
+        for (int z = -kmax[2]; z <= kmax[2]; z++)
+        {
+            for (int y = -kmax[1]; y <= kmax[1]; y++)
+            {
+                for (int x = -kmax[0]; x <= kmax[0]; x++)
+                {
+                    glm::dvec3 m = glm::dvec3(x / (double)cell.x, y / (double)cell.y, z / (double)cell.z);
+                    double m2 = glm::dot(m, m);
+                    if (m2 > 0.0 && m2 <= reach * reach)
+                    {
+                        waves.push_back(m);
+                    }
+                }
+            }
+        }
+
+        // S(m) = sum q exp(-2 pi i m.r)
+        structure.resize(waves.size());
+        pool.parallelFor(0, waves.size(), 16, [&](size_t first, size_t last) {
+            for (size_t w = first; w < last; w++)
+            {
+                std::complex<double> s = 0.0;
+                for (size_t i = 0; i < charges.size(); i++)
+                {
+                    double phase = -2.0 * M_PI * glm::dot(waves[w], glm::dvec3(charges.position(i)));
+                    s += (double)charges.q[i] * std::complex<double>(cos(phase), sin(phase));
+                }
+                structure[w] = s;
+            }
+        });
+    }
+
+    glm::dvec3 field(const glm::vec3 &p) const
+    {
+        glm::dvec3 e = glm::dvec3(0.0);
+        for (size_t i = 0; i < charges.size(); i++)
+        {
+            glm::vec3 r = p - charges.position(i);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                r[axis] -= cell[axis] * floor(r[axis] / cell[axis] + 0.5f);
+            }
+            if (glm::length(r) < cutoff)
+            {
+                e += glm::dvec3(screenedField(r, charges.q[i], beta));
+            }
+        }
+
+        // minus the gradient of sum exp(-pi^2 m^2 / beta^2) / (pi V m^2) S(m) exp(2 pi i m.p)
+        double volume = (double)cell.x * cell.y * cell.z;
+        for (size_t w = 0; w < waves.size(); w++)
+        {
+            double m2 = glm::dot(waves[w], waves[w]);
+            double c = exp(-M_PI * M_PI * m2 / (beta * beta)) / (M_PI * volume * m2);
+            double phase = 2.0 * M_PI * glm::dot(waves[w], glm::dvec3(p));
+            double im = (structure[w] * std::complex<double>(cos(phase), sin(phase))).imag();
+            e += 2.0 * M_PI * c * im * waves[w];
+        }
+        return e;
+    }
+};
+
+} // namespace
+
+EwaldAccuracy measureEwald(const glm::vec3 &cellSize, const ChargeSet &charges, const EwaldParams &params,
+                           int samples, ThreadPool &pool)
+{
+    EwaldSolver solver(cellSize, params);
+    EwaldAccuracy result;
+    double start = seconds();
+    solver.setCharges(charges, pool);
+    result.setupSeconds = seconds() - start;
+
+    // samples on top of a charge only show the distance clamp, keep away from them
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<glm::vec3> points;
+    for (int attempt = 0; (int)points.size() < samples && attempt < samples * 100; attempt++)
+    {
+        glm::vec3 p = glm::vec3(unit(random), unit(random), unit(random)) * cellSize;
+        bool clear = true;
+        for (size_t i = 0; i < charges.size() && clear; i++)
+        {
+            glm::vec3 r = p - charges.position(i);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                r[axis] -= cellSize[axis] * floor(r[axis] / cellSize[axis] + 0.5f);
+            }
+            clear = glm::length(r) > 2.0f * coulombMinDist;
+        }
+        if (clear)
+        {
+            points.push_back(p);
+        }
+    }
+
+    std::vector<glm::vec3> fields(points.size());
+    start = seconds();
+    for (size_t s = 0; s < points.size(); s++)
+    {
+        fields[s] = solver.field(points[s]);
+    }
+    result.sampleSeconds = points.empty() ? 0.0 : (seconds() - start) / points.size();
+
+    ReferenceEwald reference(cellSize, charges, pool);
+    std::vector<glm::dvec3> exact(points.size());
+    pool.parallelFor(0, points.size(), 1, [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; s++)
+        {
+            exact[s] = reference.field(points[s]);
+        }
+    });
+
+    double errorSum = 0.0, fieldSum = 0.0, worst = 0.0;
+    for (size_t s = 0; s < points.size(); s++)
+    {
+        double error = glm::length(glm::dvec3(fields[s]) - exact[s]);
+        errorSum += error * error;
+        fieldSum += glm::dot(exact[s], exact[s]);
+        worst = std::max(worst, error);
+    }
+    double rms = sqrt(fieldSum / std::max<size_t>(points.size(), 1));
+    result.rmsError = rms > 0.0 ? sqrt(errorSum / std::max<size_t>(points.size(), 1)) / rms : 0.0f;
+    result.maxError = rms > 0.0 ? worst / rms : 0.0f;
+    return result;
+}
@@ -0,0 +1,82 @@
+#ifndef EWALD_H
+#define EWALD_H
+
+#include <complex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+#include "fft.h"
+#include "threadPool.h"
+
+// smooth particle mesh Ewald settings. the coulomb kernel is split by erfc(splitting r):
+// the short range part is summed directly within cutoff, the long range part is spread
+// onto a mesh with B-splines of the given order and solved with FFTs.
+//
+// splitting 0 picks it from the cutoff so the direct part is dropped at about 1e-5 of
+// its size. the cutoff can be at most half the cell's shortest edge and the mesh edge is
+// rounded up to a power of two
+struct EwaldParams
+{
+    int meshSize = 32;
+    int order = 4;
+    float cutoff = 50.0f;
+    float splitting = 0.0f;
+};
+
+// field of a periodic cell of charges and all its images, the box [0, cellSize). a
+// non neutral cell gets a uniform neutralizing background, as usual with Ewald sums
+class EwaldSolver
+{
+    glm::vec3 cell;
+    EwaldParams params;
+    float beta;
+    int mesh[3];
+    Fft3d fft;
+
+    // B-spline and coulomb factor of every mesh wave vector, and the potential on the
+    // mesh that the long range field is interpolated from
+    std::vector<double> influence;
+    std::vector<std::complex<double> > potential;
+
+    // charges wrapped into the cell and bucketed into cells no smaller than the cutoff
+    ChargeSet wrapped;
+    int cellCount[3];
+    std::vector<size_t> cellStart;
+
+    void buildInfluence();
+    void buildCellList(const ChargeSet &charges);
+    void spread(ThreadPool &pool);
+    glm::vec3 wrap(const glm::vec3 &p) const;
+
+public:
+    EwaldSolver(const glm::vec3 &cellSize, const EwaldParams &ewaldParams);
+
+    const EwaldParams &settings() const;
+    const glm::vec3 &cellSize() const;
+    float splitting() const;
+    bool matches(const glm::vec3 &cellSize, const EwaldParams &ewaldParams) const;
+
+    // wraps and bins the charges and solves the mesh part, field() is valid after this
+    void setCharges(const ChargeSet &charges, ThreadPool &pool);
+
+    glm::vec3 realField(const glm::vec3 &p) const;
+    glm::vec3 meshField(const glm::vec3 &p) const;
+    glm::vec3 field(const glm::vec3 &p) const;
+};
+
+// how one set of parameters does on a charge set: the time to set up a solve, the time
+// per sample, and the error against a plain Ewald sum converged to about 1e-7
+struct EwaldAccuracy
+{
+    double setupSeconds;
+    double sampleSeconds;
+    float rmsError; // relative to the rms field
+    float maxError; // relative to the rms field
+};
+
+EwaldAccuracy measureEwald(const glm::vec3 &cellSize, const ChargeSet &charges, const EwaldParams &params,
+                           int samples, ThreadPool &pool);
+
+#endif // EWALD_H
@@ -0,0 +1,141 @@
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// iterative radix 2 on one contiguous line
+static void transformLine(std::complex<double> *line, int n, const std::complex<double> *twiddles, bool inverse)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(line[i], line[j]);
+        }
+    }
+
+    for (int half = 1; half < n; half <<= 1)
+    {
+        int stride = n / (half * 2);
+        for (int start = 0; start < n; start += half * 2)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                std::complex<double> w = twiddles[k * stride];
+                if (inverse)
+                {
+                    w = std::conj(w);
+                }
+                std::complex<double> a = line[start + k];
+                std::complex<double> b = line[start + k + half] * w;
+                line[start + k] = a + b;
+                line[start + k + half] = a - b;
+            }
+        }
+    }
+}
+
+Fft3d::Fft3d(int nx, int ny, int nz)
+{
+    n[0] = nx;
+    n[1] = ny;
+    n[2] = nz;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (!isPowerOfTwo(n[axis]))
+        {
+            throw std::runtime_error("FFT Error: mesh edges must be powers of two");
+        }
+        twiddles[axis].resize(std::max(n[axis] / 2, 1));
+        for (int k = 0; k < n[axis] / 2; k++)
+        {
+            double angle = -2.0 * M_PI * k / n[axis];
+            twiddles[axis][k] = std::complex<double>(cos(angle), sin(angle));
+        }
+    }
+}
+
+bool Fft3d::isPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+int Fft3d::nextPowerOfTwo(int value)
+{
+    int p = 1;
+    while (p < value)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+size_t Fft3d::size() const
+{
+    return (size_t)n[0] * n[1] * n[2];
+}
+
+void Fft3d::transformAxis(std::vector<std::complex<double> > &data, int axis, bool inverse, ThreadPool &pool) const
+{
+    int length = n[axis];
+    if (length == 1)
+    {
+        return;
+    }
+
+    // lines along x are contiguous, the others are gathered into a buffer and put back
+    size_t stride = axis == 0 ? 1 : axis == 1 ? n[0] : (size_t)n[0] * n[1];
+    size_t lines = size() / length;
+    pool.parallelFor(0, lines, 16, [&](size_t first, size_t last) {
+        std::vector<std::complex<double> > buffer(axis == 0 ? 0 : length);
+        for (size_t line = first; line < last; line++)
+        {
+            // the line's start: every index with a zero coordinate along axis
+            size_t start;
+            if (axis == 0)
+                start = line * length;
+            else if (axis == 1)
+                start = (line / n[0]) * n[0] * n[1] + line % n[0];
+            else
+                start = line;
+
+            if (axis == 0)
+            {
+                transformLine(&data[start], length, &twiddles[axis][0], inverse);
+                continue;
+            }
+            for (int i = 0; i < length; i++)
+            {
+                buffer[i] = data[start + i * stride];
+            }
+            transformLine(&buffer[0], length, &twiddles[axis][0], inverse);
+            for (int i = 0; i < length; i++)
+            {
+                data[start + i * stride] = buffer[i];
+            }
+        }
+    });
+}
+
+void Fft3d::forward(std::vector<std::complex<double> > &data, ThreadPool &pool) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        transformAxis(data, axis, false, pool);
+    }
+}
+
+void Fft3d::inverse(std::vector<std::complex<double> > &data, ThreadPool &pool) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        transformAxis(data, axis, true, pool);
+    }
+}
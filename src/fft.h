@@ -0,0 +1,30 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+#include "threadPool.h"
+
+// in place complex FFTs on a 3D mesh stored x fastest, every edge a power of two.
+// forward uses exp(-2 pi i k n / N), inverse exp(+2 pi i k n / N), neither is scaled
+class Fft3d
+{
+    int n[3];
+    // exp(-2 pi i k / N) for k < N/2, per axis
+    std::vector<std::complex<double> > twiddles[3];
+
+    void transformAxis(std::vector<std::complex<double> > &data, int axis, bool inverse, ThreadPool &pool) const;
+
+public:
+    Fft3d(int nx, int ny, int nz);
+
+    static bool isPowerOfTwo(int value);
+    static int nextPowerOfTwo(int value);
+
+    size_t size() const;
+    void forward(std::vector<std::complex<double> > &data, ThreadPool &pool) const;
+    void inverse(std::vector<std::complex<double> > &data, ThreadPool &pool) const;
+};
+
+#endif // FFT_H
@@ -0,0 +1,547 @@
+#include "field.h"
+
+#include <algorithm>
+#include <cmath>
+
+static float mapNum(float s, float a1, float a2, float b1, float b2)
+{
+    return b1 + (s - a1) * (b2 - b1) / (a2 - a1);
+}
+
+// arrows are opaque within 30 units of the nearest charge and gone past 50
+static const float arrowFadeDist = 50.0f;
+
+static float arrowAlpha(float dist)
+{
+    float alpha = 0.0f;
+    if (dist <= arrowFadeDist)
+        alpha = mapNum(dist, 70.0f, 0.0f, 0.0f, 1.0f);
+    if (dist <= 30.0f)
+        alpha = 1.0f;
+    return alpha;
+}
+
+size_t Lattice::count() const
+{
+    return (size_t)edgeSize * edgeSize * edgeSize;
+}
+
+size_t Lattice::index(int x, int y, int z) const
+{
+    return ((size_t)x * edgeSize + y) * edgeSize + z;
+}
+
+glm::vec3 Lattice::position(int x, int y, int z) const
+{
+    return glm::vec3(x * edgeSpace, y * edgeSpace, z * edgeSpace);
+}
+
+// the electric arrow at one lattice point, the coulomb field q r / |r|^3 like every other
+// field in the program, so the arrows point the same way whichever mode drew them
+static void electricArrow(const Lattice &lattice, const ChargeSet &charges, int x, int y, int z, ArrowField &out)
+{
+    float dist = 10000.0f;
+    glm::vec3 arrowPos = lattice.position(x, y, z);
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, 0.0f);
+
+    for (size_t c = 0; c < charges.size(); c++)
+    {
+        glm::vec3 r = arrowPos - glm::vec3(charges.x[c], charges.y[c], charges.z[c]);
+        float len = glm::length(r);
+        float d = std::max(len, coulombMinDist);
+        direction += charges.q[c] * r / (d * d * d);
+        dist = std::min(dist, len);
+    }
+
+    size_t i = lattice.index(x, y, z);
+    out.direction[i] = direction;
+    out.alpha[i] = arrowAlpha(dist);
+}
+
+// the magnetic arrows along z of one lattice row, scratch holds 7 floats per point
+static void magneticRow(const Lattice &lattice, const CurrentSet &currents, int x, int y, std::vector<float> &scratch,
+                        ArrowField &out)
+{
+    size_t n = lattice.edgeSize;
+    scratch.assign(7 * n, 0.0f);
+    float *px = &scratch[0];
+    float *py = px + n;
+    float *pz = py + n;
+    float *fx = pz + n;
+    float *fy = fx + n;
+    float *fz = fy + n;
+    float *nearest = fz + n;
+    for (size_t z = 0; z < n; z++)
+    {
+        glm::vec3 p = lattice.position(x, y, z);
+        px[z] = p.x;
+        py[z] = p.y;
+        pz[z] = p.z;
+        nearest[z] = 10000.0f;
+    }
+
+    biotSavart(currents, px, py, pz, n, fx, fy, fz, nearest);
+
+    size_t first = lattice.index(x, y, 0);
+    for (size_t z = 0; z < n; z++)
+    {
+        out.direction[first + z] = glm::vec3(fx[z], fy[z], fz[z]);
+        out.alpha[first + z] = arrowAlpha(nearest[z]);
+    }
+}
+
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, ArrowField &out, ThreadPool &pool)
+{
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    electricArrow(lattice, charges, x, y, z, out);
+                }
+            }
+        }
+    });
+}
+
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const CurrentSet &currents,
+                    ArrowField &electric, ArrowField &magnetic, ThreadPool &pool)
+{
+    electric.direction.resize(lattice.count());
+    electric.alpha.resize(lattice.count());
+    magnetic.direction.resize(lattice.count());
+    magnetic.alpha.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        std::vector<float> scratch;
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    electricArrow(lattice, charges, x, y, z, electric);
+                }
+                magneticRow(lattice, currents, x, y, scratch, magnetic);
+            }
+        }
+    });
+}
+
+void evaluateArrows(const Lattice &lattice, const CurrentSet &currents, ArrowField &out, ThreadPool &pool)
+{
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        std::vector<float> scratch;
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                magneticRow(lattice, currents, x, y, scratch, out);
+            }
+        }
+    });
+}
+
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const EwaldSolver &ewald, ArrowField &out,
+                    ThreadPool &pool)
+{
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+    glm::vec3 cell = ewald.cellSize();
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    glm::vec3 arrowPos = lattice.position(x, y, z);
+                    float dist = 10000.0f;
+                    for (size_t c = 0; c < charges.size(); c++)
+                    {
+                        glm::vec3 r = arrowPos - charges.position(c);
+                        for (int axis = 0; axis < 3; axis++)
+                        {
+                            r[axis] -= cell[axis] * floor(r[axis] / cell[axis] + 0.5f);
+                        }
+                        dist = std::min(dist, glm::length(r));
+                    }
+
+                    size_t i = lattice.index(x, y, z);
+                    out.direction[i] = ewald.field(arrowPos);
+                    out.alpha[i] = arrowAlpha(dist);
+                }
+            }
+        }
+    });
+}
+
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const FieldGrid &background, ArrowField &out,
+                    ThreadPool &pool)
+{
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    glm::vec3 arrowPos = lattice.position(x, y, z);
+                    glm::vec3 e = background.sample(arrowPos);
+                    float dist = 10000.0f;
+                    for (size_t c = 0; c < charges.size(); c++)
+                    {
+                        glm::vec3 r = arrowPos - charges.position(c);
+                        float d = std::max(glm::length(r), coulombMinDist);
+                        e += charges.q[c] * r / (d * d * d);
+                        dist = std::min(dist, glm::length(r));
+                    }
+
+                    size_t i = lattice.index(x, y, z);
+                    out.direction[i] = e;
+                    out.alpha[i] = background.contains(arrowPos) ? 1.0f : arrowAlpha(dist);
+                }
+            }
+        }
+    });
+}
+
+void evaluateArrows(const Lattice &lattice, const ChargeTree &tree, float theta, ArrowField &out, ThreadPool &pool)
+{
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    glm::vec3 arrowPos = lattice.position(x, y, z);
+
+                    size_t i = lattice.index(x, y, z);
+                    out.direction[i] = tree.field(arrowPos, theta);
+                    out.alpha[i] = arrowAlpha(tree.nearestDistance(arrowPos));
+                }
+            }
+        }
+    });
+}
+
+// one charge's term of an electric arrow, as electricArrow sums it. a charge right on the
+// lattice point adds nothing, so it can be taken out again when it moves
+static glm::dvec3 arrowTerm(const glm::vec3 &arrowPos, const glm::vec3 &charge, float q, float &len)
+{
+    glm::vec3 r = arrowPos - charge;
+    len = glm::length(r);
+    float d = std::max(len, coulombMinDist);
+    return glm::dvec3(q * r / (d * d * d));
+}
+
+void IncrementalArrows::rebuild(const Lattice &newLattice, const ChargeSet &newCharges, ThreadPool &pool)
+{
+    lattice = newLattice;
+    charges = newCharges;
+    updatesSinceRebuild = 0;
+    sums.resize(lattice.count());
+    nearest.resize(lattice.count());
+
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    glm::vec3 arrowPos = lattice.position(x, y, z);
+                    glm::dvec3 sum = glm::dvec3(0.0);
+                    float dist = 10000.0f;
+                    for (size_t c = 0; c < charges.size(); c++)
+                    {
+                        float len;
+                        sum += arrowTerm(arrowPos, charges.position(c), charges.q[c], len);
+                        dist = std::min(dist, len);
+                    }
+
+                    size_t i = lattice.index(x, y, z);
+                    sums[i] = sum;
+                    nearest[i] = dist;
+                }
+            }
+        }
+    });
+}
+
+void IncrementalArrows::applyChanges(const ChargeSet &newCharges, ThreadPool &pool)
+{
+    size_t oldCount = charges.size();
+
+    // the sums everywhere, the nearest distances only where a changed charge is within the
+    // fade distance. points that lost their nearest charge are marked with -1 for repair
+    pool.parallelFor(0, lattice.edgeSize, 1, [&](size_t first, size_t last) {
+        for (int x = first; x < (int)last; x++)
+        {
+            for (int y = 0; y < lattice.edgeSize; y++)
+            {
+                for (int z = 0; z < lattice.edgeSize; z++)
+                {
+                    glm::vec3 arrowPos = lattice.position(x, y, z);
+                    size_t i = lattice.index(x, y, z);
+                    glm::dvec3 sum = sums[i];
+                    float dist = nearest[i];
+                    bool lostNearest = false;
+                    for (size_t c : changed)
+                    {
+                        float len;
+                        if (c < oldCount)
+                        {
+                            sum -= arrowTerm(arrowPos, charges.position(c), charges.q[c], len);
+                            lostNearest = lostNearest || (len <= arrowFadeDist && len <= nearest[i]);
+                        }
+                        sum += arrowTerm(arrowPos, newCharges.position(c), newCharges.q[c], len);
+                        dist = std::min(dist, len);
+                    }
+                    sums[i] = sum;
+                    nearest[i] = lostNearest ? -1.0f : dist;
+                }
+            }
+        }
+    });
+
+    for (size_t c : changed)
+    {
+        if (c >= charges.size())
+        {
+            charges.add(newCharges.position(c), newCharges.q[c]);
+            continue;
+        }
+        charges.x[c] = newCharges.x[c];
+        charges.y[c] = newCharges.y[c];
+        charges.z[c] = newCharges.z[c];
+        charges.q[c] = newCharges.q[c];
+    }
+
+    repair.clear();
+    for (size_t i = 0; i < nearest.size(); i++)
+    {
+        if (nearest[i] < 0.0f)
+        {
+            repair.push_back(i);
+        }
+    }
+    pool.parallelFor(0, repair.size(), 1, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; r++)
+        {
+            size_t i = repair[r];
+            int x = i / ((size_t)lattice.edgeSize * lattice.edgeSize);
+            int y = i / lattice.edgeSize % lattice.edgeSize;
+            int z = i % lattice.edgeSize;
+            glm::vec3 arrowPos = lattice.position(x, y, z);
+            float dist = 10000.0f;
+            for (size_t c = 0; c < charges.size(); c++)
+            {
+                dist = std::min(dist, glm::length(arrowPos - charges.position(c)));
+            }
+            nearest[i] = dist;
+        }
+    });
+}
+
+bool IncrementalArrows::update(const Lattice &newLattice, const ChargeSet &newCharges, ArrowField &out,
+                               ThreadPool &pool)
+{
+    bool sameLattice = lattice.edgeSize == newLattice.edgeSize && lattice.edgeSpace == newLattice.edgeSpace &&
+                       sums.size() == newLattice.count();
+    bool incremental = sameLattice && newCharges.size() >= charges.size() &&
+                       newCharges.size() - charges.size() <= maxChanged && updatesSinceRebuild < rebuildInterval;
+
+    // charges added since are changes too, a removed one means starting over
+    changed.clear();
+    for (size_t c = 0; incremental && c < newCharges.size(); c++)
+    {
+        if (c >= charges.size() || newCharges.x[c] != charges.x[c] || newCharges.y[c] != charges.y[c] ||
+            newCharges.z[c] != charges.z[c] || newCharges.q[c] != charges.q[c])
+        {
+            changed.push_back(c);
+            incremental = changed.size() <= maxChanged;
+        }
+    }
+
+    if (!incremental)
+    {
+        rebuild(newLattice, newCharges, pool);
+    }
+    else if (!changed.empty())
+    {
+        applyChanges(newCharges, pool);
+        updatesSinceRebuild++;
+    }
+
+    out.direction.resize(lattice.count());
+    out.alpha.resize(lattice.count());
+    for (size_t i = 0; i < sums.size(); i++)
+    {
+        out.direction[i] = glm::vec3(sums[i]);
+        out.alpha[i] = arrowAlpha(nearest[i]);
+    }
+    return incremental;
+}
+
+FieldGrid::FieldGrid(glm::ivec3 gridDims, glm::vec3 gridOrigin, float gridSpacing)
+{
+    dims = gridDims;
+    origin = gridOrigin;
+    spacing = gridSpacing;
+    magnitude.resize((size_t)dims.x * dims.y * dims.z, 0.0f);
+    direction.resize(magnitude.size(), glm::vec3(0.0f));
+}
+
+size_t FieldGrid::index(int x, int y, int z) const
+{
+    return ((size_t)z * dims.y + y) * dims.x + x;
+}
+
+glm::vec3 FieldGrid::position(int x, int y, int z) const
+{
+    return origin + glm::vec3(x, y, z + firstLayer) * spacing;
+}
+
+glm::vec3 FieldGrid::extent() const
+{
+    return glm::vec3(dims.x - 1, dims.y - 1, dims.z - 1) * spacing;
+}
+
+void FieldGrid::evaluate(const ChargeSet &charges, ThreadPool &pool)
+{
+    pool.parallelFor(0, dims.z, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 0; y < dims.y; y++)
+            {
+                for (int x = 0; x < dims.x; x++)
+                {
+                    glm::vec3 p = position(x, y, z);
+                    glm::vec3 e = glm::vec3(0.0f);
+
+                    // coulomb field, E = q * r / |r|^3
+                    for (size_t c = 0; c < charges.size(); c++)
+                    {
+                        glm::vec3 r = p - glm::vec3(charges.x[c], charges.y[c], charges.z[c]);
+                        float d = std::max(glm::length(r), coulombMinDist);
+                        e += charges.q[c] * r / (d * d * d);
+                    }
+
+                    size_t i = index(x, y, z);
+                    magnitude[i] = glm::length(e);
+                    direction[i] = magnitude[i] > 0.0f ? e / magnitude[i] : glm::vec3(0.0f);
+                }
+            }
+        }
+    });
+}
+
+void FieldGrid::evaluate(const ChargeTree &tree, float theta, ThreadPool &pool)
+{
+    pool.parallelFor(0, dims.z, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 0; y < dims.y; y++)
+            {
+                for (int x = 0; x < dims.x; x++)
+                {
+                    glm::vec3 p = position(x, y, z);
+                    glm::vec3 e = tree.field(p, theta);
+
+                    size_t i = index(x, y, z);
+                    magnitude[i] = glm::length(e);
+                    direction[i] = magnitude[i] > 0.0f ? e / magnitude[i] : glm::vec3(0.0f);
+                }
+            }
+        }
+    });
+}
+
+void FieldGrid::evaluate(const EwaldSolver &ewald, ThreadPool &pool)
+{
+    pool.parallelFor(0, dims.z, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 0; y < dims.y; y++)
+            {
+                for (int x = 0; x < dims.x; x++)
+                {
+                    glm::vec3 e = ewald.field(position(x, y, z));
+
+                    size_t i = index(x, y, z);
+                    magnitude[i] = glm::length(e);
+                    direction[i] = magnitude[i] > 0.0f ? e / magnitude[i] : glm::vec3(0.0f);
+                }
+            }
+        }
+    });
+}
+
+bool FieldGrid::contains(const glm::vec3 &p) const
+{
+    glm::vec3 u = (p - origin) / spacing - glm::vec3(0.0f, 0.0f, (float)firstLayer);
+    return u.x >= 0.0f && u.y >= 0.0f && u.z >= 0.0f && u.x <= dims.x - 1 && u.y <= dims.y - 1 && u.z <= dims.z - 1;
+}
+
+glm::vec3 FieldGrid::sample(const glm::vec3 &p) const
+{
+    if (!contains(p))
+    {
+        return glm::vec3(0.0f);
+    }
+
+    glm::vec3 u = (p - origin) / spacing - glm::vec3(0.0f, 0.0f, (float)firstLayer);
+    int base[3];
+    float f[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        base[axis] = std::min((int)u[axis], dims[axis] - 2);
+        f[axis] = u[axis] - base[axis];
+    }
+
+    glm::vec3 e = glm::vec3(0.0f);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        int dx = corner & 1, dy = (corner >> 1) & 1, dz = (corner >> 2) & 1;
+        float weight = (dx ? f[0] : 1.0f - f[0]) * (dy ? f[1] : 1.0f - f[1]) * (dz ? f[2] : 1.0f - f[2]);
+        size_t i = index(base[0] + dx, base[1] + dy, base[2] + dz);
+        e += weight * magnitude[i] * direction[i];
+    }
+    return e;
+}
+
+void FieldGrid::add(const FieldGrid &other, ThreadPool &pool)
+{
+    pool.parallelFor(0, dims.z, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 0; y < dims.y; y++)
+            {
+                for (int x = 0; x < dims.x; x++)
+                {
+                    size_t i = index(x, y, z);
+                    glm::vec3 e = magnitude[i] * direction[i] + other.sample(position(x, y, z));
+                    magnitude[i] = glm::length(e);
+                    direction[i] = magnitude[i] > 0.0f ? e / magnitude[i] : glm::vec3(0.0f);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,126 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+#include "chargeTree.h"
+#include "currents.h"
+#include "ewald.h"
+#include "threadPool.h"
+
+// the cube of arrows drawn by the main view
+struct Lattice
+{
+    int edgeSize;
+    float edgeSpace;
+
+    size_t count() const;
+    size_t index(int x, int y, int z) const;
+    glm::vec3 position(int x, int y, int z) const;
+};
+
+// what the arrow view needs for every lattice point, stored per field rather than per arrow
+struct ArrowField
+{
+    std::vector<glm::vec3> direction;
+    std::vector<float> alpha;
+};
+
+// sums the coulomb field of every charge and fades the arrows out with the distance to
+// the nearest one, parallel over x slabs of the lattice
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, ArrowField &out, ThreadPool &pool);
+// periodic version, the arrows follow the field of the charges and all their images and
+// fade with the distance to the nearest image
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const EwaldSolver &ewald, ArrowField &out,
+                    ThreadPool &pool);
+
+// Barnes-Hut version for big source sets like solved conductor panels, the arrows follow
+// the field of everything in the tree and fade with the distance to the nearest source
+void evaluateArrows(const Lattice &lattice, const ChargeTree &tree, float theta, ArrowField &out, ThreadPool &pool);
+
+// electric arrows of the charges, as above, and magnetic arrows of the currents in one
+// pass over the lattice. every lattice row goes to biotSavart as a batch, the magnetic
+// arrows fade with the distance to the nearest wire
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const CurrentSet &currents,
+                    ArrowField &electric, ArrowField &magnetic, ThreadPool &pool);
+// magnetic arrows alone, for the modes whose electric arrows come from elsewhere
+void evaluateArrows(const Lattice &lattice, const CurrentSet &currents, ArrowField &out, ThreadPool &pool);
+
+// the arrows of evaluateArrows(lattice, charges, ...) kept up to date as charges are
+// dragged or added. every lattice point keeps its running sum and its nearest charge
+// distance, so a changed charge costs one pass over the lattice, its old contribution
+// taken out and the new one put in, instead of a pass over every charge at every point.
+//
+// only lattice points within the fade distance of a changed charge's old or new place
+// can change alpha. of those, the ones whose nearest charge was the one that moved away
+// search all the charges again. a rebuild from scratch every rebuildInterval updates
+// keeps rounding in the sums from building up
+class IncrementalArrows
+{
+    Lattice lattice = {0, 0.0f};
+    // the charges the sums are for
+    ChargeSet charges;
+    std::vector<glm::dvec3> sums;
+    // distance to the nearest charge where that's within the fade distance, anything past
+    // it otherwise
+    std::vector<float> nearest;
+    int updatesSinceRebuild = 0;
+
+    // scratch, kept so dragging doesn't allocate
+    std::vector<size_t> changed;
+    std::vector<size_t> repair;
+
+    void rebuild(const Lattice &newLattice, const ChargeSet &newCharges, ThreadPool &pool);
+    void applyChanges(const ChargeSet &newCharges, ThreadPool &pool);
+
+public:
+    // more changed charges than this and a rebuild is cheaper
+    size_t maxChanged = 16;
+    int rebuildInterval = 600;
+
+    // brings the arrows up to charges on lattice and writes them to out. returns false when
+    // it had to start over rather than update
+    bool update(const Lattice &newLattice, const ChargeSet &newCharges, ArrowField &out, ThreadPool &pool);
+};
+
+// field sampled on a regular grid, used by the volume renderer
+class FieldGrid
+{
+public:
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float spacing;
+    // a slab of a taller grid with the same origin starts this many layers up z. samples
+    // are placed from the whole grid's origin so a slab's match the whole grid's exactly
+    int firstLayer = 0;
+
+    std::vector<float> magnitude;
+    std::vector<glm::vec3> direction;
+
+    FieldGrid(glm::ivec3 gridDims, glm::vec3 gridOrigin, float gridSpacing);
+    size_t index(int x, int y, int z) const;
+    glm::vec3 position(int x, int y, int z) const;
+    glm::vec3 extent() const;
+    void evaluate(const ChargeSet &charges, ThreadPool &pool);
+    // Barnes-Hut version, walks tree with the theta test at every sample
+    void evaluate(const ChargeTree &tree, float theta, ThreadPool &pool);
+    // periodic version, the charges have to be set on ewald already
+    void evaluate(const EwaldSolver &ewald, ThreadPool &pool);
+
+    // the field vector at p, trilinear between the samples and zero outside the grid
+    glm::vec3 sample(const glm::vec3 &p) const;
+    bool contains(const glm::vec3 &p) const;
+    // adds another grid's field, sampled at every point of this one
+    void add(const FieldGrid &other, ThreadPool &pool);
+};
+
+// with a background field, like one solved from a density volume, the arrows follow the
+// coulomb field of the charges plus the background. arrows inside the background's
+// extent are always drawn
+void evaluateArrows(const Lattice &lattice, const ChargeSet &charges, const FieldGrid &background, ArrowField &out,
+                    ThreadPool &pool);
+
+#endif // FIELD_H
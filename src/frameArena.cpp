@@ -0,0 +1,57 @@
+#include "frameArena.h"
+
+#include <algorithm>
+
+FrameArena::FrameArena(size_t initialSize)
+{
+    blocks.push_back({new char[initialSize], initialSize});
+}
+
+FrameArena::~FrameArena()
+{
+    for (Block &block : blocks)
+    {
+        delete[] block.data;
+    }
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes > blocks.back().size)
+    {
+        // start a new block big enough for this request, new[] memory is aligned for any type
+        usedBefore += offset;
+        size_t size = std::max(bytes, blocks.back().size * 2);
+        blocks.push_back({new char[size], size});
+        start = 0;
+    }
+
+    offset = start + bytes;
+    highWater = std::max(highWater, used());
+    return blocks.back().data + start;
+}
+
+size_t FrameArena::used() const
+{
+    return usedBefore + offset;
+}
+
+void FrameArena::reset()
+{
+    // a frame spilled into more blocks, replace them with one that holds the whole frame
+    if (blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (Block &block : blocks)
+        {
+            total += block.size;
+            delete[] block.data;
+        }
+        blocks.clear();
+        blocks.push_back({new char[total], total});
+    }
+
+    offset = 0;
+    usedBefore = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// a linear allocator for scratch data that only lives for one frame. allocating bumps an
+// offset, nothing is freed on its own, and reset() at the end of the frame makes all of
+// it available again. when a frame needs more than the arena holds, extra blocks are
+// taken from the heap and merged into one block at the next reset, so after the first
+// few frames the arena stops touching the heap. only for trivially destructible types,
+// no destructors are run
+class FrameArena
+{
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t offset = 0;
+    size_t usedBefore = 0;
+
+public:
+    // most bytes in use at once in any frame so far
+    size_t highWater = 0;
+
+    FrameArena(size_t initialSize = 1 << 20);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment);
+
+    // uninitialized storage for count Ts, valid until the next reset
+    template <typename T>
+    T *allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    size_t used() const;
+    void reset();
+};
+
+#endif // FRAMEARENA_H
@@ -0,0 +1,240 @@
+#include "frameCapture.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+FrameCapture::FrameCapture(int targetWidth, int targetHeight, const std::string &pattern, int ringSize, int queueLimit)
+    : framesWritten(0)
+{
+    if (!validPattern(pattern))
+    {
+        throw std::runtime_error("Capture Error: " + pattern + " needs exactly one %d for the frame number");
+    }
+
+    width = targetWidth;
+    height = targetHeight;
+    pathPattern = pattern;
+    maxQueued = queueLimit;
+
+    // the target everything is composited into
+    glGenRenderbuffers(1, &colorRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthRB);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRB);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRB);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Capture Error: framebuffer incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // read back as RGBA, the format drivers can copy without converting
+    ring.resize(ringSize);
+    for (Slot &slot : ring)
+    {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+        slot.fence = 0;
+        slot.frame = -1;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_one();
+    writer.join();
+
+    for (Slot &slot : ring)
+    {
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorRB);
+    glDeleteRenderbuffers(1, &depthRB);
+}
+
+void FrameCapture::capture()
+{
+    // the slot about to be reused holds the oldest frame, hand that one off first
+    Slot &slot = ring[head];
+    if (slot.frame >= 0)
+    {
+        retire(slot);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = nextFrame++;
+    head = (head + 1) % ring.size();
+}
+
+void FrameCapture::flush()
+{
+    // oldest first so frames reach the writer in order
+    for (size_t i = 0; i < ring.size(); i++)
+    {
+        Slot &slot = ring[(head + i) % ring.size()];
+        if (slot.frame >= 0)
+        {
+            retire(slot);
+        }
+    }
+}
+
+void FrameCapture::retire(Slot &slot)
+{
+    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    Job job;
+    job.frame = slot.frame;
+    slot.frame = -1;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        space.wait(lock, [&] { return !spare.empty() || buffersInUse < maxQueued; });
+        if (!spare.empty())
+        {
+            job.pixels.swap(spare.back());
+            spare.pop_back();
+        }
+        buffersInUse++;
+    }
+    job.pixels.resize(width * height * 4);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        memcpy(&job.pixels[0], mapped, width * height * 4);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(job));
+    }
+    queued.notify_one();
+}
+
+void FrameCapture::writerLoop()
+{
+    std::vector<unsigned char> row(width * 3);
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty())
+            {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        writeImage(job, row);
+        framesWritten++;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(std::move(job.pixels));
+            buffersInUse--;
+        }
+        space.notify_one();
+    }
+}
+
+bool FrameCapture::validPattern(const std::string &pattern)
+{
+    int conversions = 0;
+    size_t n = pattern.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        if (pattern[i] != '%')
+        {
+            continue;
+        }
+        i++;
+        if (i < n && pattern[i] == '%')
+        {
+            continue;
+        }
+        while (i < n && strchr("-+ #0", pattern[i]) && pattern[i] != '\0')
+        {
+            i++;
+        }
+        while (i < n && isdigit((unsigned char)pattern[i]))
+        {
+            i++;
+        }
+        if (i < n && pattern[i] == '.')
+        {
+            i++;
+            while (i < n && isdigit((unsigned char)pattern[i]))
+            {
+                i++;
+            }
+        }
+        if (i >= n || (pattern[i] != 'd' && pattern[i] != 'i'))
+        {
+            return false;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+void FrameCapture::writeImage(const Job &job, std::vector<unsigned char> &row)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), pathPattern.c_str(), job.frame);
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        std::cout << "Capture Error: could not write " << path << std::endl;
+        return;
+    }
+
+    // GL rows start at the bottom, images at the top
+    fprintf(out, "P6\n%d %d\n255\n", width, height);
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const unsigned char *src = &job.pixels[(size_t)y * width * 4];
+        for (int x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(&row[0], 1, row.size(), out);
+    }
+    fclose(out);
+}
@@ -0,0 +1,80 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// an offscreen render target whose frames are saved as an image sequence. each frame is
+// read into the next of a ring of pixel buffer objects, which returns without waiting on
+// the GPU. a buffer is only mapped when the ring comes back around to it, frames later,
+// by which point its fence has long signaled. a writer thread flips the rows and writes
+// the file so encoding and disk I/O never hold up rendering
+class FrameCapture
+{
+    struct Slot
+    {
+        GLuint pbo;
+        GLsync fence;
+        int frame;
+    };
+
+    struct Job
+    {
+        int frame;
+        std::vector<unsigned char> pixels;
+    };
+
+    void retire(Slot &slot);
+    void writerLoop();
+    void writeImage(const Job &job, std::vector<unsigned char> &row);
+
+    int width, height;
+    std::string pathPattern;
+    GLuint colorRB, depthRB;
+
+    std::vector<Slot> ring;
+    int head = 0;
+    int nextFrame = 0;
+
+    // frames waiting for the writer, and spent pixel buffers to reuse. at most maxQueued
+    // frames are in flight, after that capture() waits for the writer to catch up
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable space;
+    std::deque<Job> queue;
+    std::vector<std::vector<unsigned char> > spare;
+    int buffersInUse = 0;
+    int maxQueued;
+    bool stopping = false;
+    std::thread writer;
+
+public:
+    GLuint framebuffer;
+    std::atomic<int> framesWritten;
+
+    // pathPattern is a printf pattern taking the frame number, e.g. "frame%05d.ppm".
+    // frames are written as binary PPM. throws std::runtime_error for a pattern
+    // validPattern turns down
+    FrameCapture(int targetWidth, int targetHeight, const std::string &pattern, int ringSize = 3, int queueLimit = 8);
+    // writes out everything still in flight
+    ~FrameCapture();
+
+    // reads back what was drawn into framebuffer this frame
+    void capture();
+
+    // true if pattern has exactly one %d or %i, with flags, width and precision allowed,
+    // and every other % doubled, so it can't read past the frame number it's given
+    static bool validPattern(const std::string &pattern);
+    // maps and queues every frame still in the ring
+    void flush();
+};
+
+#endif // FRAMECAPTURE_H
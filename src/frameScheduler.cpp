@@ -0,0 +1,67 @@
+#include "frameScheduler.h"
+
+#include <chrono>
+#include <thread>
+
+// the OS sleep is only trusted to within this much, the rest is spent yielding
+static const double sleepSlack = 0.002;
+
+static double clockNow()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameScheduler::FrameScheduler(double step)
+{
+    fixedStep = step;
+}
+
+int FrameScheduler::beginFrame(double now)
+{
+    frameStart = clockNow();
+
+    // the first frame has no previous time, it runs no steps
+    if (lastTime < 0.0)
+    {
+        lastTime = now;
+    }
+    frameTime = now - lastTime;
+    lastTime = now;
+    if (frameTime > maxFrameTime)
+    {
+        frameTime = maxFrameTime;
+    }
+
+    accumulator += frameTime;
+    int steps = 0;
+    while (accumulator >= fixedStep)
+    {
+        accumulator -= fixedStep;
+        steps++;
+    }
+    return steps;
+}
+
+double FrameScheduler::alpha() const
+{
+    return accumulator / fixedStep;
+}
+
+void FrameScheduler::pace()
+{
+    if (targetFrameTime <= 0.0)
+    {
+        return;
+    }
+
+    double deadline = frameStart + targetFrameTime;
+    double remaining = deadline - clockNow();
+    if (remaining > sleepSlack)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(remaining - sleepSlack));
+    }
+    while (clockNow() < deadline)
+    {
+        std::this_thread::yield();
+    }
+}
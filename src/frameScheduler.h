@@ -0,0 +1,30 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+// runs updates on a fixed timestep independent of the frame rate and paces frames.
+// each frame asks how many fixed steps to run, then renders with alpha() to
+// interpolate between the last two update states
+class FrameScheduler
+{
+    double accumulator = 0.0;
+    double lastTime = -1.0;
+    double frameStart = 0.0;
+
+public:
+    double fixedStep;
+    // frames longer than this are clamped so a stall doesn't trigger a burst of steps
+    double maxFrameTime = 0.25;
+    // 0 runs as fast as possible (or at the swap interval), otherwise frames are
+    // padded out to this many seconds
+    double targetFrameTime = 0.0;
+    bool vsync = true;
+
+    double frameTime = 0.0;
+
+    FrameScheduler(double step);
+    int beginFrame(double now);
+    double alpha() const;
+    void pace();
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,59 @@
+#include "frustum.h"
+
+Frustum Frustum::fromMatrix(const glm::mat4 &viewProj)
+{
+    // rows of the matrix, glm is column major
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+    {
+        row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    }
+
+    Frustum f;
+    f.planes[0] = row[3] + row[0]; // left
+    f.planes[1] = row[3] - row[0]; // right
+    f.planes[2] = row[3] + row[1]; // bottom
+    f.planes[3] = row[3] - row[1]; // top
+    f.planes[4] = row[3] + row[2]; // near
+    f.planes[5] = row[3] - row[2]; // far
+    for (int i = 0; i < 6; i++)
+    {
+        f.planes[i] = f.planes[i] / glm::length(glm::vec3(f.planes[i]));
+    }
+    return f;
+}
+
+Frustum::Result Frustum::testBox(const glm::vec3 &lo, const glm::vec3 &hi) const
+{
+    Result result = INSIDE;
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 n = glm::vec3(planes[i]);
+
+        // the corners furthest along and against the plane normal
+        glm::vec3 pos = glm::vec3(n.x > 0 ? hi.x : lo.x, n.y > 0 ? hi.y : lo.y, n.z > 0 ? hi.z : lo.z);
+        glm::vec3 neg = glm::vec3(n.x > 0 ? lo.x : hi.x, n.y > 0 ? lo.y : hi.y, n.z > 0 ? lo.z : hi.z);
+
+        if (glm::dot(n, pos) + planes[i].w < 0.0f)
+        {
+            return OUTSIDE;
+        }
+        if (glm::dot(n, neg) + planes[i].w < 0.0f)
+        {
+            result = INTERSECTS;
+        }
+    }
+    return result;
+}
+
+bool Frustum::testSphere(const glm::vec3 &center, float radius) const
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
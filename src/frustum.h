@@ -0,0 +1,23 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// the six planes of a view frustum, pointing inwards
+struct Frustum
+{
+    enum Result
+    {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE
+    };
+
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4 &viewProj);
+    Result testBox(const glm::vec3 &lo, const glm::vec3 &hi) const;
+    bool testSphere(const glm::vec3 &center, float radius) const;
+};
+
+#endif // FRUSTUM_H
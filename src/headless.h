@@ -0,0 +1,24 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <EGL/egl.h>
+
+// an OpenGL 3.3 core context with no window or surface, for rendering on machines
+// without a display. uses Mesa's surfaceless EGL platform when it's there (llvmpipe on
+// a bare node), the default EGL display otherwise. everything is drawn into framebuffer
+// objects since there's no default framebuffer
+class HeadlessContext
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+public:
+    // makes the context current, throws std::runtime_error if it can't
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+};
+
+#endif // HEADLESS_H
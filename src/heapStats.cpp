@@ -0,0 +1,76 @@
+#include "heapStats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<unsigned long> totalAllocations(0);
+static std::atomic<unsigned long> totalBytes(0);
+static thread_local unsigned long threadAllocations = 0;
+static thread_local unsigned long threadBytes = 0;
+
+static void *countedAlloc(size_t size)
+{
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    totalBytes.fetch_add(size, std::memory_order_relaxed);
+    threadAllocations++;
+    threadBytes += size;
+    return malloc(size ? size : 1);
+}
+
+HeapStats heapStatsTotal()
+{
+    HeapStats stats = {totalAllocations.load(std::memory_order_relaxed), totalBytes.load(std::memory_order_relaxed)};
+    return stats;
+}
+
+HeapStats heapStatsThisThread()
+{
+    HeapStats stats = {threadAllocations, threadBytes};
+    return stats;
+}
+
+void *operator new(size_t size)
+{
+    void *p = countedAlloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,20 @@
+#ifndef HEAPSTATS_H
+#define HEAPSTATS_H
+
+#include <cstddef>
+
+// counts of heap allocations made through operator new, which heapStats.cpp replaces
+// so every container and new expression in the program is included. memory from
+// malloc or from inside the GL driver isn't seen
+struct HeapStats
+{
+    unsigned long allocations;
+    unsigned long bytes;
+};
+
+HeapStats heapStatsTotal();
+// only what the calling thread allocated, so the render loop can be checked on its own
+// while the solver and writer threads do their own thing
+HeapStats heapStatsThisThread();
+
+#endif // HEAPSTATS_H
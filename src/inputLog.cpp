@@ -0,0 +1,198 @@
+#include "inputLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+// every key the main loop reads, a frame stores them as one bit each in this order
+static const int trackedKeys[] = {GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D,
+                                  GLFW_KEY_F, GLFW_KEY_G, GLFW_KEY_V, GLFW_KEY_C};
+static const char trackedNames[] = "WASDFGVC";
+static const int trackedCount = sizeof(trackedKeys) / sizeof(trackedKeys[0]);
+
+// and the mouse buttons after them
+static const int trackedButtons[] = {GLFW_MOUSE_BUTTON_LEFT};
+static const int buttonCount = sizeof(trackedButtons) / sizeof(trackedButtons[0]);
+
+InputLog::InputLog()
+{
+    current.time = 0.0;
+    current.cursorX = 0.0;
+    current.cursorY = 0.0;
+    current.keys = 0;
+}
+
+InputLog::~InputLog()
+{
+    if (recordFile)
+    {
+        fclose(recordFile);
+    }
+}
+
+void InputLog::record(const std::string &path)
+{
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out)
+    {
+        throw std::runtime_error("Input Error: could not write " + path);
+    }
+    if (recordFile)
+    {
+        fclose(recordFile);
+    }
+    recordFile = out;
+    recordBuffer.resize(1 << 16);
+    setvbuf(recordFile, &recordBuffer[0], _IOFBF, recordBuffer.size());
+    fprintf(recordFile, "# time cursorX cursorY keys, key bits from lowest: %s then the left mouse button\n",
+            trackedNames);
+    mode = RECORD;
+}
+
+void InputLog::replay(const std::string &path)
+{
+    FILE *in = fopen(path.c_str(), "r");
+    if (!in)
+    {
+        throw std::runtime_error("Input Error: could not open " + path);
+    }
+
+    frames.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), in))
+    {
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        Frame frame;
+        if (sscanf(line, "%lf %lf %lf %u", &frame.time, &frame.cursorX, &frame.cursorY, &frame.keys) == 4)
+        {
+            frames.push_back(frame);
+        }
+    }
+    fclose(in);
+
+    mode = REPLAY;
+    next = 0;
+    frameTimes.clear();
+    frameTimes.reserve(frames.size());
+}
+
+bool InputLog::poll(GLFWwindow *window, double now)
+{
+    if (mode == REPLAY)
+    {
+        if (lastWall >= 0.0)
+        {
+            frameTimes.push_back(now - lastWall);
+        }
+        lastWall = now;
+
+        if (next == frames.size())
+        {
+            return false;
+        }
+        current = frames[next++];
+        return true;
+    }
+
+    // without a window (headless) nothing is ever pressed
+    current.time = now;
+    current.keys = 0;
+    if (window)
+    {
+        glfwGetCursorPos(window, &current.cursorX, &current.cursorY);
+        for (int k = 0; k < trackedCount; k++)
+        {
+            if (glfwGetKey(window, trackedKeys[k]) == GLFW_PRESS)
+            {
+                current.keys |= 1u << k;
+            }
+        }
+        for (int b = 0; b < buttonCount; b++)
+        {
+            if (glfwGetMouseButton(window, trackedButtons[b]) == GLFW_PRESS)
+            {
+                current.keys |= 1u << (trackedCount + b);
+            }
+        }
+    }
+
+    if (mode == RECORD)
+    {
+        // enough digits that the replayed timestamps are bit identical
+        fprintf(recordFile, "%.17g %.17g %.17g %u\n", current.time, current.cursorX, current.cursorY, current.keys);
+    }
+    return true;
+}
+
+double InputLog::time() const
+{
+    return current.time;
+}
+
+int InputLog::key(int glfwKey) const
+{
+    for (int k = 0; k < trackedCount; k++)
+    {
+        if (trackedKeys[k] == glfwKey)
+        {
+            return (current.keys >> k) & 1 ? GLFW_PRESS : GLFW_RELEASE;
+        }
+    }
+    return GLFW_RELEASE;
+}
+
+int InputLog::button(int glfwButton) const
+{
+    for (int b = 0; b < buttonCount; b++)
+    {
+        if (trackedButtons[b] == glfwButton)
+        {
+            return (current.keys >> (trackedCount + b)) & 1 ? GLFW_PRESS : GLFW_RELEASE;
+        }
+    }
+    return GLFW_RELEASE;
+}
+
+void InputLog::cursor(double &x, double &y) const
+{
+    x = current.cursorX;
+    y = current.cursorY;
+}
+
+void InputLog::finish()
+{
+    if (mode == RECORD)
+    {
+        if (fclose(recordFile) != 0)
+        {
+            fprintf(stderr, "Input Error: could not finish writing the recording\n");
+        }
+        recordFile = nullptr;
+    }
+    else if (mode == REPLAY)
+    {
+        if (frameTimes.empty())
+        {
+            printf("replay: no frames\n");
+            return;
+        }
+
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double t : sorted)
+        {
+            total += t;
+        }
+        size_t n = sorted.size();
+
+        printf("replay: %zu frames in %.3fs, %.1f fps\n", n, total, n / total);
+        printf("frame ms: mean %.3f | min %.3f | p50 %.3f | p95 %.3f | p99 %.3f | max %.3f\n",
+               total / n * 1000.0, sorted[0] * 1000.0, sorted[n / 2] * 1000.0,
+               sorted[std::min(n - 1, n * 95 / 100)] * 1000.0,
+               sorted[std::min(n - 1, n * 99 / 100)] * 1000.0, sorted[n - 1] * 1000.0);
+    }
+}
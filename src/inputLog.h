@@ -0,0 +1,70 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <GLFW/glfw3.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// sits between the main loop and the window's input. live and recording runs read the
+// keys, mouse buttons and cursor from the window each frame, recording writes them out with
+// the frame's timestamp as it goes. a replay feeds a recording back frame by frame in place
+// of the window and measures how long each frame really took
+class InputLog
+{
+    struct Frame
+    {
+        double time;
+        double cursorX, cursorY;
+        unsigned int keys;
+    };
+
+    std::vector<Frame> frames;
+    Frame current;
+    size_t next = 0;
+    // a recording streams through a buffer set up front, so it never grows the heap in the
+    // main loop
+    FILE *recordFile = nullptr;
+    std::vector<char> recordBuffer;
+
+    // wall clock time of each replayed frame
+    std::vector<double> frameTimes;
+    double lastWall = -1.0;
+
+public:
+    enum Mode
+    {
+        LIVE,
+        RECORD,
+        REPLAY
+    };
+    Mode mode = LIVE;
+
+    InputLog();
+    ~InputLog();
+
+    InputLog(const InputLog &) = delete;
+    InputLog &operator=(const InputLog &) = delete;
+
+    // frames are written as they're polled and the file is closed by finish(). throws
+    // std::runtime_error if the file can't be written
+    void record(const std::string &path);
+    // throws std::runtime_error if the file can't be read
+    void replay(const std::string &path);
+
+    // call once per frame after polling events, window may be null when headless. returns
+    // false once a replay has run out
+    bool poll(GLFWwindow *window, double now);
+
+    // the frame's timestamp, recorded or replayed. feed this to the frame scheduler
+    double time() const;
+    int key(int glfwKey) const;
+    int button(int glfwButton) const;
+    void cursor(double &x, double &y) const;
+
+    // closes the recording, or prints the frame time report of a replay
+    void finish();
+};
+
+#endif // INPUTLOG_H
@@ -1,6 +1,49 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "model.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+
+#include <glm/gtc/packing.hpp>
+
+// maps a unit vector onto the octahedron unfolded into [-1, 1]^2, shaders undo it with octDecode
+static glm::vec2 octEncode(const glm::vec3 &n)
+{
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+    glm::vec2 e = glm::vec2(n.x, n.y) / sum;
+    if (n.z < 0.0f)
+    {
+        glm::vec2 folded = glm::vec2(1.0f - std::abs(e.y), 1.0f - std::abs(e.x));
+        e = glm::vec2(e.x >= 0.0f ? folded.x : -folded.x, e.y >= 0.0f ? folded.y : -folded.y);
+    }
+    return e;
+}
+
+// two signed 10 bit components in the low bits of a GL_INT_2_10_10_10_REV word
+static GLuint packSnorm10x2(const glm::vec2 &v)
+{
+    GLint x = (GLint)std::round(glm::clamp(v.x, -1.0f, 1.0f) * 511.0f);
+    GLint y = (GLint)std::round(glm::clamp(v.y, -1.0f, 1.0f) * 511.0f);
+    return ((GLuint)x & 0x3ff) | (((GLuint)y & 0x3ff) << 10);
+}
+
+static GLubyte packUnorm8(float v)
+{
+    return (GLubyte)std::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f);
+}
+
+static GLushort packUnorm16(float v)
+{
+    return (GLushort)std::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
+
 
 Model::Model(bool isLit)
 {
@@ -16,6 +59,7 @@ void Model::loadFromObj(std::string path, int hasTextures)
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
     std::string err;
+    hasTexCoords = hasTextures == 1;
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str()))
     {
         throw std::runtime_error(err);
@@ -30,10 +74,19 @@ void Model::loadFromObj(std::string path, int hasTextures)
             vertices.push_back(attrib.vertices[3 * index.vertex_index + 1]);
             vertices.push_back(attrib.vertices[3 * index.vertex_index + 2]);
 
-	    //add normals
-	    vertices.push_back(attrib.normals[3 * index.normal_index + 0]);
-	    vertices.push_back(attrib.normals[3 * index.normal_index + 1]);
-	    vertices.push_back(attrib.normals[3 * index.normal_index + 2]);
+	    //add normals, meshes without them (like conductors, drawn unlit) get +z
+	    if (index.normal_index >= 0)
+	    {
+	        vertices.push_back(attrib.normals[3 * index.normal_index + 0]);
+	        vertices.push_back(attrib.normals[3 * index.normal_index + 1]);
+	        vertices.push_back(attrib.normals[3 * index.normal_index + 2]);
+	    }
+	    else
+	    {
+	        vertices.push_back(0.0f);
+	        vertices.push_back(0.0f);
+	        vertices.push_back(1.0f);
+	    }
 	    
             if (hasTextures == 1)
             {
@@ -52,6 +105,7 @@ void Model::loadFromObj(std::string path, int hasTextures)
             triangles.push_back(triangles.size());
         }
     }
+    generateLods();
     GLInit();
 }
 
@@ -60,92 +114,200 @@ void Model::GLInit()
     // generate and bind the buffers assosiated with this chunk in order to assign
     // vertices and color to the mesh
     glGenVertexArrays(1, &VAO);
+    glGenVertexArrays(1, &packedVAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
-
-    // load the shaders from their corresponding files
-    GLuint vertexShader = loadShader("shaders/vertex.glsl", GL_VERTEX_SHADER);
-
-    GLuint fragmentShader = 0;
-    if(lit)
-    {
-      fragmentShader = loadShader("shaders/fragment.glsl", GL_FRAGMENT_SHADER);
-    }
-    else
+    glGenBuffers(1, &retainedVBO);
+
+    // load, compile and link the shaders, all programs share the attribute locations
+    const char *fragmentPath = lit ? "shaders/fragment.glsl" : "shaders/unlitFragment.glsl";
+    shaderProgram = loadShaderProgram("shaders/vertex.glsl", fragmentPath);
+    instancedProgram = loadShaderProgram("shaders/instancedVertex.glsl", fragmentPath);
+    packedProgram = loadShaderProgram("shaders/packedInstancedVertex.glsl", fragmentPath);
+
+    // the vertex buffer keeps 12 bytes per vertex (16 with texcoords) instead of 32: half
+    // float positions rescaled to [-1, 1] over the mesh bounds, then an octahedral normal
+    // in a 2_10_10_10 word, then half float texcoords only if the mesh has them
+    GLuint vertexCount = vertices.size() / 8;
+    glm::vec3 lo = glm::vec3(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 hi = lo;
+    for (GLuint i = 0; i < vertexCount; i++)
     {
-      fragmentShader = loadShader("shaders/unlitFragment.glsl", GL_FRAGMENT_SHADER);
+        glm::vec3 p = glm::vec3(vertices[i * 8 + 0], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
     }
-    
-    // compile the GPU programs
-    glCompileShader(vertexShader);
-    glCompileShader(fragmentShader);
+    meshBias = (lo + hi) * 0.5f;
+    meshScale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-6f));
 
-    // catch any errors
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-
-    if(!success)
-    {
-      glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-      std::cout << "Shader Error vertex: " << infoLog << std::endl;
-      
-    }
-    
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    
-    if(!success)
+    GLsizei stride = hasTexCoords ? 16 : 12;
+    std::vector<unsigned char> packed(vertexCount * stride);
+    for (GLuint i = 0; i < vertexCount; i++)
     {
-      glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-      std::cout << "Shader Error fragment: " << infoLog << std::endl; 
-    }
-    
-    // create a program from the shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
+        const float *v = &vertices[i * 8];
+        unsigned char *out = &packed[i * stride];
 
-    glBindFragDataLocation(shaderProgram, 0, "outColor");
+        glm::vec3 p = (glm::vec3(v[0], v[1], v[2]) - meshBias) / meshScale;
+        GLushort position[4] = {glm::packHalf1x16(p.x), glm::packHalf1x16(p.y), glm::packHalf1x16(p.z), 0};
+        memcpy(out, position, sizeof(position));
 
-    // finilize the program and use it
-    glLinkProgram(shaderProgram);
-    glUseProgram(shaderProgram);
+        GLuint normal = packSnorm10x2(octEncode(glm::normalize(glm::vec3(v[3], v[4], v[5]))));
+        memcpy(out + 8, &normal, sizeof(normal));
+
+        if (hasTexCoords)
+        {
+            GLushort texCoords[2] = {glm::packHalf1x16(v[6]), glm::packHalf1x16(v[7])};
+            memcpy(out + 12, texCoords, sizeof(texCoords));
+        }
+    }
 
-    glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // set the array buffer to contain sections the size of a Vertex struct, and
-    // pass a pointer to the vector containing them
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
-        &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), &packed[0], GL_STATIC_DRAW);
 
-    // pass and bind triangle data
+    // pass and bind triangle data, every lod lives in the same index buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
         triangles.size() * sizeof(GLuint), &triangles[0],
         GL_STATIC_DRAW);
 
-    // pass vertex positions to shader program
-    GLint posAttrib = glGetAttribLocation(shaderProgram, "position");
-    glEnableVertexAttribArray(posAttrib);
-    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), 0);
+    // both VAOs read the same mesh
+    for (GLuint vao : {VAO, packedVAO})
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glEnableVertexAttribArray(ATTRIB_POSITION);
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_HALF_FLOAT, GL_FALSE, stride, 0);
 
-    GLint normAttrib = glGetAttribLocation(shaderProgram, "normal");
-    glEnableVertexAttribArray(normAttrib);
-    glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-	
-    GLint texcoordsAttrib = glGetAttribLocation(shaderProgram, "texCoords");
-    glEnableVertexAttribArray(texcoordsAttrib);
-    glVertexAttribPointer(texcoordsAttrib, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(ATTRIB_NORMAL);
+        glVertexAttribPointer(ATTRIB_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)8);
+
+        // without texcoords the attribute reads the constant default of 0
+        if (hasTexCoords)
+        {
+            glEnableVertexAttribArray(ATTRIB_TEXCOORDS);
+            glVertexAttribPointer(ATTRIB_TEXCOORDS, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)12);
+        }
+        else
+        {
+            glDisableVertexAttribArray(ATTRIB_TEXCOORDS);
+        }
+    }
+
+    // per instance transform and color, advanced once per instance. the data itself is
+    // streamed in at draw time
+    glBindVertexArray(VAO);
+    for (int i = 0; i < 4; i++)
+    {
+        glEnableVertexAttribArray(ATTRIB_INSTANCE_MODEL + i);
+        glVertexAttribDivisor(ATTRIB_INSTANCE_MODEL + i, 1);
+    }
+    glEnableVertexAttribArray(ATTRIB_INSTANCE_COLOR);
+    glVertexAttribDivisor(ATTRIB_INSTANCE_COLOR, 1);
+
+    glBindVertexArray(packedVAO);
+    for (GLuint location : {ATTRIB_INSTANCE_POSITION, ATTRIB_INSTANCE_DIRECTION, ATTRIB_INSTANCE_ALPHA})
+    {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindVertexArray(VAO);
+
+    for (GLuint program : {shaderProgram, instancedProgram, packedProgram})
+    {
+        glUseProgram(program);
+        glUniform3fv(glGetUniformLocation(program, "meshBias"), 1, glm::value_ptr(meshBias));
+        glUniform3fv(glGetUniformLocation(program, "meshScale"), 1, glm::value_ptr(meshScale));
+    }
+    glUseProgram(shaderProgram);
 
     uniColor = glGetUniformLocation(shaderProgram, "objColor");
     uniTrans = glGetUniformLocation(shaderProgram, "model");
     uniView = glGetUniformLocation(shaderProgram, "view");
     uniProj = glGetUniformLocation(shaderProgram, "proj");
     uniParent = glGetUniformLocation(shaderProgram, "parentPos");
+    uniInstView = glGetUniformLocation(instancedProgram, "view");
+    uniInstProj = glGetUniformLocation(instancedProgram, "proj");
+    uniPackedView = glGetUniformLocation(packedProgram, "view");
+    uniPackedProj = glGetUniformLocation(packedProgram, "proj");
+    uniPackedBias = glGetUniformLocation(packedProgram, "instanceBias");
+    uniPackedScale = glGetUniformLocation(packedProgram, "instanceScale");
 
     glUniform4f(uniColor, 1.0f, 0.0f, 0.0f, 1.0f);
 }
 
+void Model::generateLods()
+{
+    // bounds of the full mesh, used for the projected size and the clustering grid
+    glm::vec3 lo = glm::vec3(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 hi = lo;
+    GLuint vertexCount = vertices.size() / 8;
+    for (GLuint i = 0; i < vertexCount; i++)
+    {
+        glm::vec3 p = glm::vec3(vertices[i * 8 + 0], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+        radius = std::max(radius, glm::length(p));
+    }
+    glm::vec3 size = glm::max(hi - lo, glm::vec3(1e-6f));
+
+    lods.clear();
+    lods.push_back({0, (GLuint)triangles.size(), 48.0f});
+
+    // coarser levels by vertex clustering: every vertex snaps to the first vertex that
+    // landed in its grid cell and triangles that collapse are dropped
+    const int cellsAcross[3] = {12, 6, 3};
+    const float minPixels[3] = {16.0f, 6.0f, 0.0f};
+    GLuint fullCount = triangles.size();
+    for (int level = 0; level < 3; level++)
+    {
+        int g = cellsAcross[level];
+        std::unordered_map<long long, GLuint> cells;
+        std::vector<GLuint> remap(vertexCount);
+        for (GLuint i = 0; i < vertexCount; i++)
+        {
+            glm::vec3 p = glm::vec3(vertices[i * 8 + 0], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+            glm::ivec3 c = glm::ivec3(glm::min((p - lo) / size * (float)g, glm::vec3(g - 1)));
+            long long key = ((long long)c.z * g + c.y) * g + c.x;
+            auto it = cells.find(key);
+            if (it == cells.end())
+            {
+                cells[key] = i;
+                remap[i] = i;
+            }
+            else
+            {
+                remap[i] = it->second;
+            }
+        }
+
+        Lod lod = {(GLuint)triangles.size(), 0, minPixels[level]};
+        for (GLuint t = 0; t + 2 < fullCount; t += 3)
+        {
+            GLuint a = remap[triangles[t]];
+            GLuint b = remap[triangles[t + 1]];
+            GLuint c = remap[triangles[t + 2]];
+            if (a != b && b != c && a != c)
+            {
+                triangles.push_back(a);
+                triangles.push_back(b);
+                triangles.push_back(c);
+            }
+        }
+        lod.count = triangles.size() - lod.first;
+
+        // a mesh too small to decimate further just keeps the previous level
+        if (lod.count == 0)
+        {
+            lod.first = lods.back().first;
+            lod.count = lods.back().count;
+        }
+        lods.push_back(lod);
+    }
+    lodDrawn.assign(lods.size(), 0);
+}
+
 void Model::render(Camera &camera)
 {
     glUseProgram(shaderProgram);
@@ -154,17 +316,30 @@ void Model::render(Camera &camera)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
     glUniformMatrix4fv(uniTrans, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(uniView, 1, GL_FALSE, glm::value_ptr(camera.view));
-    glUniformMatrix4fv(uniProj, 1, GL_FALSE, glm::value_ptr(camera.proj));
+    glUniformMatrix4fv(uniView, 1, GL_FALSE, glm::value_ptr(camera.view()));
+    glUniformMatrix4fv(uniProj, 1, GL_FALSE, glm::value_ptr(camera.proj()));
     glUniformMatrix4fv(uniParent, 1, GL_FALSE, glm::value_ptr(parentPosition));
 
-    glDrawElements(GL_TRIANGLES, triangles.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, lods[0].count, GL_UNSIGNED_INT, 0);
 }
 
 void Model::setIntUniform(std::string name, int val)
 {
-  GLint uniformLoc = glGetUniformLocation(shaderProgram, name.c_str());
-  glUniform1i(uniformLoc, val);
+  for(GLuint program : {shaderProgram, instancedProgram, packedProgram})
+  {
+    glUseProgram(program);
+    GLint uniformLoc = glGetUniformLocation(program, name.c_str());
+    glUniform1i(uniformLoc, val);
+  }
+}
+
+void Model::setFloatUniform(std::string name, float val)
+{
+  for(GLuint program : {shaderProgram, instancedProgram, packedProgram})
+  {
+    glUseProgram(program);
+    glUniform1f(glGetUniformLocation(program, name.c_str()), val);
+  }
 }
 
 void Model::setVec3Uniform(std::string name, float* pointer)
@@ -172,6 +347,15 @@ void Model::setVec3Uniform(std::string name, float* pointer)
   glUniform3fv(glGetUniformLocation(shaderProgram, name.c_str()), 10, pointer);
 }
 
+void Model::setVec3Uniform(std::string name, const glm::vec3 &val)
+{
+  for(GLuint program : {shaderProgram, instancedProgram, packedProgram})
+  {
+    glUseProgram(program);
+    glUniform3f(glGetUniformLocation(program, name.c_str()), val.x, val.y, val.z);
+  }
+}
+
 void Model::render(Camera &camera, float r, float g, float b, float a)
 {
     glUseProgram(shaderProgram);
@@ -181,48 +365,188 @@ void Model::render(Camera &camera, float r, float g, float b, float a)
 
 
     glUniformMatrix4fv(uniTrans, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(uniView, 1, GL_FALSE, glm::value_ptr(camera.view));
-    glUniformMatrix4fv(uniProj, 1, GL_FALSE, glm::value_ptr(camera.proj));
+    glUniformMatrix4fv(uniView, 1, GL_FALSE, glm::value_ptr(camera.view()));
+    glUniformMatrix4fv(uniProj, 1, GL_FALSE, glm::value_ptr(camera.proj()));
     glUniformMatrix4fv(uniParent, 1, GL_FALSE, glm::value_ptr(parentPosition));
 
     glUniform4f(uniColor, r, g, b, a);
 
-    glDrawElements(GL_TRIANGLES, triangles.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, lods[0].count, GL_UNSIGNED_INT, 0);
 }
 
-GLuint Model::loadShader(const char *filepath, GLenum type)
+glm::vec3 Model::instancePosition(const Instance &instance) const
 {
-    FILE *file = fopen(filepath, "rb");
-    if (!file)
+    return glm::vec3(instance.model[3]);
+}
+
+glm::vec3 Model::instancePosition(const PackedInstance &instance) const
+{
+    glm::vec3 q = glm::vec3(instance.position[0], instance.position[1], instance.position[2]) / 65535.0f;
+    return packedBias + q * packedScale;
+}
+
+float Model::instanceScale(const Instance &instance) const
+{
+    const glm::mat4 &m = instance.model;
+    return std::max(glm::length(glm::vec3(m[0])),
+           std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+}
+
+float Model::instanceScale(const PackedInstance &) const
+{
+    return 1.0f;
+}
+
+Model::PackedInstance Model::packInstance(const glm::vec3 &position, const glm::vec3 &direction, float alpha,
+                                          const glm::vec3 &bias, const glm::vec3 &scale)
+{
+    PackedInstance packed;
+    glm::vec3 q = (position - bias) / scale;
+    packed.position[0] = packUnorm16(q.x);
+    packed.position[1] = packUnorm16(q.y);
+    packed.position[2] = packUnorm16(q.z);
+
+    glm::vec2 e = octEncode(glm::normalize(direction));
+    packed.direction[0] = packUnorm8(e.x * 0.5f + 0.5f);
+    packed.direction[1] = packUnorm8(e.y * 0.5f + 0.5f);
+    packed.alpha = packUnorm8(alpha);
+    packed.pad[0] = packed.pad[1] = packed.pad[2] = 0;
+    return packed;
+}
+
+template <typename T>
+void Model::selectLods(Camera &camera, const std::vector<T> &instances, float viewportHeight, std::vector<T> &out)
+{
+    // projected height in pixels of the bounding sphere is radius * P[1][1] / depth
+    // scaled from NDC to the viewport
+    float pixelScale = radius * camera.proj()[1][1] * 0.5f * viewportHeight;
+
+    lodOf.resize(instances.size());
+    lodStart.assign(lods.size() + 1, 0);
+    for (size_t i = 0; i < instances.size(); i++)
     {
-        return 0;
+        float depth = -(camera.view() * glm::vec4(instancePosition(instances[i]), 1.0f)).z;
+        float pixels = depth > 0.0f ? pixelScale * instanceScale(instances[i]) / depth : 0.0f;
+
+        int level = 0;
+        while (level + 1 < (int)lods.size() && pixels < lods[level].minPixels)
+        {
+            level++;
+        }
+        lodOf[i] = level;
+        lodStart[level + 1]++;
     }
 
-    long len;
-    if (fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) == -1L)
+    // counting sort so each lod's instances are contiguous in the instance buffer
+    for (size_t l = 0; l < lods.size(); l++)
+    {
+        lodStart[l + 1] += lodStart[l];
+    }
+    out.resize(instances.size());
+    lodNext.assign(lodStart.begin(), lodStart.end() - 1);
+    for (size_t i = 0; i < instances.size(); i++)
     {
-        fclose(file);
-        return 0;
+        out[lodNext[lodOf[i]]++] = instances[i];
     }
-    rewind(file);
+}
+
+void Model::renderInstanced(Camera &camera, const std::vector<Instance> &instances, float viewportHeight,
+                            StreamBuffer &stream, bool changed)
+{
+    glUseProgram(instancedProgram);
+    glBindVertexArray(VAO);
+    glUniformMatrix4fv(uniInstView, 1, GL_FALSE, glm::value_ptr(camera.view()));
+    glUniformMatrix4fv(uniInstProj, 1, GL_FALSE, glm::value_ptr(camera.proj()));
+
+    renderBatch(camera, instances, viewportHeight, stream, changed, sorted, false);
+}
 
-    char *buffer = (char *)malloc(len);
-    if (fread(buffer, 1, len, file) != len)
+void Model::renderPacked(Camera &camera, const std::vector<PackedInstance> &instances, const glm::vec3 &bias,
+                         const glm::vec3 &scale, float viewportHeight, StreamBuffer &stream, bool changed)
+{
+    packedBias = bias;
+    packedScale = scale;
+
+    glUseProgram(packedProgram);
+    glBindVertexArray(packedVAO);
+    glUniformMatrix4fv(uniPackedView, 1, GL_FALSE, glm::value_ptr(camera.view()));
+    glUniformMatrix4fv(uniPackedProj, 1, GL_FALSE, glm::value_ptr(camera.proj()));
+    glUniform3fv(uniPackedBias, 1, glm::value_ptr(bias));
+    glUniform3fv(uniPackedScale, 1, glm::value_ptr(scale));
+
+    renderBatch(camera, instances, viewportHeight, stream, changed, sortedPacked, true);
+}
+
+template <typename T>
+void Model::renderBatch(Camera &camera, const std::vector<T> &instances, float viewportHeight, StreamBuffer &stream,
+                        bool changed, std::vector<T> &batch, bool packed)
+{
+    if (changed || !haveSorted)
     {
-        fclose(file);
-        free(buffer);
-        return 0;
+        lodDrawn.assign(lods.size(), 0);
+        haveSorted = false;
+        if (instances.empty())
+        {
+            return;
+        }
+
+        selectLods(camera, instances, viewportHeight, batch);
+        size_t streamOffset = stream.write(&batch[0], batch.size() * sizeof(T));
+        haveSorted = true;
+        retainedUploaded = false;
+        drawLods(streamOffset, packed);
+        return;
     }
-    fclose(file);
 
-    GLuint shader = glCreateShader(type);
-    if (shader == 0)
+    // nothing changed, so the same sorted instances get drawn again. they go to a buffer of
+    // our own once, since the stream ring will be reused, and are drawn from there after that
+    glBindBuffer(GL_ARRAY_BUFFER, retainedVBO);
+    if (!retainedUploaded)
     {
-        free(buffer);
-        return 0;
+        glBufferData(GL_ARRAY_BUFFER, batch.size() * sizeof(T), &batch[0], GL_STATIC_DRAW);
+        retainedUploaded = true;
+        stream.bytesUploaded += batch.size() * sizeof(T);
     }
+    drawLods(0, packed);
+}
+
+void Model::drawLods(size_t offset, bool packed)
+{
+    // one draw per lod, pointing the instance attributes at that lod's slice of whatever
+    // buffer is bound to GL_ARRAY_BUFFER
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    for (size_t l = 0; l < lods.size(); l++)
+    {
+        GLuint count = lodStart[l + 1] - lodStart[l];
+        lodDrawn[l] = count;
+        if (count == 0)
+        {
+            continue;
+        }
 
-    glShaderSource(shader, 1, (const char *const *)&buffer, (GLint *)&len);
-    free(buffer);
-    return shader;
+        if (packed)
+        {
+            size_t base = offset + lodStart[l] * sizeof(PackedInstance);
+            glVertexAttribPointer(ATTRIB_INSTANCE_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedInstance),
+                                  (void*)(base + offsetof(PackedInstance, position)));
+            glVertexAttribPointer(ATTRIB_INSTANCE_DIRECTION, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedInstance),
+                                  (void*)(base + offsetof(PackedInstance, direction)));
+            glVertexAttribPointer(ATTRIB_INSTANCE_ALPHA, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedInstance),
+                                  (void*)(base + offsetof(PackedInstance, alpha)));
+        }
+        else
+        {
+            size_t base = offset + lodStart[l] * sizeof(Instance);
+            for (int i = 0; i < 4; i++)
+            {
+                glVertexAttribPointer(ATTRIB_INSTANCE_MODEL + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                      (void*)(base + i * sizeof(glm::vec4)));
+            }
+            glVertexAttribPointer(ATTRIB_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                  (void*)(base + offsetof(Instance, color)));
+        }
+
+        glDrawElementsInstanced(GL_TRIANGLES, lods[l].count, GL_UNSIGNED_INT,
+                                (void*)(lods[l].first * sizeof(GLuint)), count);
+    }
 }
@@ -14,29 +14,107 @@
 #include <boost/algorithm/string.hpp>
 
 #include "Camera.h"
+#include "shader.h"
+#include "streamBuffer.h"
 
 #include "tiny_obj_loader.h"
 class Model
 {
-    GLuint loadShader(const char *filepath, GLenum type);
+public:
+    // per instance data for instanced draws
+    struct Instance
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+    };
+
+    // compact per instance data for big instanced fields, 12 bytes against 80: position
+    // quantized to 16 bits per axis over the batch's bounds, an octahedral encoded 8:8
+    // direction the mesh's +z is turned towards, and an 8 bit alpha. see packInstance
+    struct PackedInstance
+    {
+        GLushort position[3];
+        GLubyte direction[2];
+        GLubyte alpha;
+        GLubyte pad[3];
+    };
+
+    // a decimated version of the mesh, stored as a range of the shared index buffer
+    struct Lod
+    {
+        GLuint first;
+        GLuint count;
+        float minPixels; // smallest projected size this level is used at
+    };
+
+private:
     void GLInit();
+    void generateLods();
+    template <typename T>
+    void selectLods(Camera &camera, const std::vector<T> &instances, float viewportHeight, std::vector<T> &out);
+    template <typename T>
+    void renderBatch(Camera &camera, const std::vector<T> &instances, float viewportHeight, StreamBuffer &stream,
+                     bool changed, std::vector<T> &batch, bool packed);
+    void drawLods(size_t offset, bool packed);
+    glm::vec3 instancePosition(const Instance &instance) const;
+    glm::vec3 instancePosition(const PackedInstance &instance) const;
+    float instanceScale(const Instance &instance) const;
+    float instanceScale(const PackedInstance &instance) const;
 
-    unsigned int VAO, VBO, EBO;
-    GLuint shaderProgram;
+    // the packed instanced draws get a VAO of their own since their instance attributes
+    // reuse the locations of the full instance's matrix
+    unsigned int VAO, packedVAO, VBO, EBO, retainedVBO;
+    GLuint shaderProgram, instancedProgram, packedProgram;
     GLint uniTrans, uniView, uniProj, uniColor, uniParent;
+    GLint uniInstView, uniInstProj;
+    GLint uniPackedView, uniPackedProj, uniPackedBias, uniPackedScale;
     bool lit = false;
+    bool hasTexCoords = false;
+
+    // vertices are uploaded as half float positions relative to these and octahedral
+    // normals, see GLInit
+    glm::vec3 meshBias, meshScale;
+
+    // quantization of the packed batch being drawn
+    glm::vec3 packedBias, packedScale;
     std::vector<GLuint> triangles;
     std::vector<float> vertices;
     std::vector<float> normals;
+    float radius = 0.0f;
+
+    // instances grouped by lod, rebuilt whenever the instances or camera change
+    std::vector<int> lodOf;
+    std::vector<GLuint> lodStart;
+    std::vector<GLuint> lodNext;
+    std::vector<Instance> sorted;
+    std::vector<PackedInstance> sortedPacked;
+    bool haveSorted = false;
+    bool retainedUploaded = false;
 
 public:
+    std::vector<Lod> lods;
+    std::vector<GLuint> lodDrawn;
+
     Model(bool isLit);
     void loadFromObj(std::string path, int hasTextures);
     void loadFromNV(std::string path);
     void setIntUniform(std::string name, int val);
+    void setFloatUniform(std::string name, float val);
     void setVec3Uniform(std::string name, float* pointer);
+    void setVec3Uniform(std::string name, const glm::vec3 &val);
     void render(Camera &camera);
     void render(Camera &camera, float r, float g, float b, float a);
+    // changed = false redraws the previous call's instances without sorting or uploading them
+    void renderInstanced(Camera &camera, const std::vector<Instance> &instances, float viewportHeight,
+                         StreamBuffer &stream, bool changed = true);
+    // the same for packed instances quantized with bias and scale. a model is drawn with
+    // one kind of instance or the other, they share the retained buffer
+    void renderPacked(Camera &camera, const std::vector<PackedInstance> &instances, const glm::vec3 &bias,
+                      const glm::vec3 &scale, float viewportHeight, StreamBuffer &stream, bool changed = true);
+    // instance at position pointing along direction. positions are stored as
+    // (position - bias) / scale, so bias and scale must cover the whole batch
+    static PackedInstance packInstance(const glm::vec3 &position, const glm::vec3 &direction, float alpha,
+                                       const glm::vec3 &bias, const glm::vec3 &scale);
     glm::mat4 model;
     glm::mat4 parentPosition;
 };
@@ -0,0 +1,440 @@
+#include "multigrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// least margin around the density, in points
+static const int boundaryMargin = 4;
+
+// the smallest m 2^k + 1 >= n with m at most 4, coarsens down to 5 points or fewer
+static int paddedEdge(int n)
+{
+    int best = 0;
+    for (int m = 1; m <= 4; m++)
+    {
+        int edge = m + 1;
+        while (edge < n)
+        {
+            edge = (edge - 1) * 2 + 1;
+        }
+        if (best == 0 || edge < best)
+        {
+            best = edge;
+        }
+    }
+    return std::max(best, 3);
+}
+
+size_t DensityGrid::index(int x, int y, int z) const
+{
+    return ((size_t)z * dims.y + y) * dims.x + x;
+}
+
+void loadCubeDensity(const std::string &path, float scale, DensityGrid &density)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        throw std::runtime_error("Density Error: could not open " + path);
+    }
+
+    // two comment lines, then the atom count and origin, then points and step per axis
+    std::string line;
+    std::getline(in, line);
+    std::getline(in, line);
+    int atoms;
+    glm::vec3 origin;
+    int n[3];
+    glm::vec3 step[3];
+    in >> atoms >> origin.x >> origin.y >> origin.z;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        in >> n[axis] >> step[axis].x >> step[axis].y >> step[axis].z;
+    }
+    if (!in || n[0] <= 1 || n[1] <= 1 || n[2] <= 1)
+    {
+        throw std::runtime_error("Density Error: " + path + " has a bad header");
+    }
+
+    float spacing = step[0].x;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            float expected = c == axis ? spacing : 0.0f;
+            if (std::abs(step[axis][c] - expected) > 1e-4f * spacing)
+            {
+                throw std::runtime_error("Density Error: " + path + " doesn't have axis aligned cubic voxels");
+            }
+        }
+    }
+
+    // atoms are one line each, negative counts add a line of orbital ids
+    std::getline(in, line);
+    for (int a = 0; a < std::abs(atoms); a++)
+    {
+        std::getline(in, line);
+    }
+    if (atoms < 0)
+    {
+        std::getline(in, line);
+    }
+
+    density.dims = glm::ivec3(n[0], n[1], n[2]);
+    density.origin = origin * scale;
+    density.spacing = spacing * scale;
+    density.rho.resize((size_t)n[0] * n[1] * n[2]);
+
+    // values run z fastest, the grid stores x fastest
+    float perVolume = 1.0f / (scale * scale * scale);
+    for (int x = 0; x < n[0]; x++)
+    {
+        for (int y = 0; y < n[1]; y++)
+        {
+            for (int z = 0; z < n[2]; z++)
+            {
+                float value;
+                if (!(in >> value))
+                {
+                    throw std::runtime_error("Density Error: " + path + " ends before its volume does");
+                }
+                density.rho[density.index(x, y, z)] = value * perVolume;
+            }
+        }
+    }
+}
+
+double MultigridStats::convergenceRate() const
+{
+    if (cycles == 0 || residuals.front() <= 0.0)
+    {
+        return 0.0;
+    }
+    return pow(residuals.back() / residuals.front(), 1.0 / cycles);
+}
+
+size_t PoissonMultigrid::Level::index(int x, int y, int z) const
+{
+    return ((size_t)z * dims.y + y) * dims.x + x;
+}
+
+PoissonMultigrid::PoissonMultigrid(const glm::ivec3 &dims, float spacing)
+{
+    densityDims = dims;
+
+    // the density sits in the middle with a margin on every side, so the boundary's
+    // multipole potential is taken well away from it. every edge is then halved while all
+    // of them stay odd and keep an interior
+    int margin = std::max(boundaryMargin, std::max(std::max(dims.x, dims.y), dims.z) / 8);
+    Level level;
+    level.dims = glm::ivec3(paddedEdge(dims.x + 2 * margin), paddedEdge(dims.y + 2 * margin),
+                            paddedEdge(dims.z + 2 * margin));
+    offset = (level.dims - dims) / 2;
+    level.spacing = spacing;
+    while (true)
+    {
+        size_t count = (size_t)level.dims.x * level.dims.y * level.dims.z;
+        level.phi.assign(count, 0.0f);
+        level.rhs.assign(count, 0.0f);
+        level.residual.assign(count, 0.0f);
+        levels.push_back(level);
+
+        glm::ivec3 d = level.dims;
+        bool halves = d.x % 2 == 1 && d.y % 2 == 1 && d.z % 2 == 1 && d.x >= 5 && d.y >= 5 && d.z >= 5;
+        if (!halves)
+        {
+            break;
+        }
+        level.dims = glm::ivec3((d.x - 1) / 2 + 1, (d.y - 1) / 2 + 1, (d.z - 1) / 2 + 1);
+        level.spacing *= 2.0f;
+    }
+}
+
+void PoissonMultigrid::smooth(Level &level, int sweeps, ThreadPool &pool)
+{
+    glm::ivec3 d = level.dims;
+    float h2 = level.spacing * level.spacing;
+    size_t sx = 1, sy = d.x, sz = (size_t)d.x * d.y;
+    for (int s = 0; s < sweeps; s++)
+    {
+        // red points only have black neighbors, so each color is updated in parallel
+        for (int color = 0; color < 2; color++)
+        {
+            pool.parallelFor(1, d.z - 1, 1, [&](size_t first, size_t last) {
+                for (int z = first; z < (int)last; z++)
+                {
+                    for (int y = 1; y < d.y - 1; y++)
+                    {
+                        int x0 = 1 + ((1 + y + z + color) & 1);
+                        for (int x = x0; x < d.x - 1; x += 2)
+                        {
+                            size_t i = level.index(x, y, z);
+                            float neighbors = level.phi[i - sx] + level.phi[i + sx] + level.phi[i - sy] +
+                                              level.phi[i + sy] + level.phi[i - sz] + level.phi[i + sz];
+                            level.phi[i] = (neighbors + h2 * level.rhs[i]) / 6.0f;
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
+
+double PoissonMultigrid::computeResidual(Level &level, ThreadPool &pool)
+{
+    glm::ivec3 d = level.dims;
+    float invH2 = 1.0f / (level.spacing * level.spacing);
+    size_t sx = 1, sy = d.x, sz = (size_t)d.x * d.y;
+    std::vector<double> sums(d.z, 0.0);
+    pool.parallelFor(1, d.z - 1, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            double sum = 0.0;
+            for (int y = 1; y < d.y - 1; y++)
+            {
+                for (int x = 1; x < d.x - 1; x++)
+                {
+                    size_t i = level.index(x, y, z);
+                    float neighbors = level.phi[i - sx] + level.phi[i + sx] + level.phi[i - sy] + level.phi[i + sy] +
+                                      level.phi[i - sz] + level.phi[i + sz];
+                    float r = level.rhs[i] - (6.0f * level.phi[i] - neighbors) * invH2;
+                    level.residual[i] = r;
+                    sum += (double)r * r;
+                }
+            }
+            sums[z] = sum;
+        }
+    });
+
+    double total = 0.0;
+    for (double sum : sums)
+    {
+        total += sum;
+    }
+    return sqrt(total);
+}
+
+void PoissonMultigrid::restrictResidual(const Level &fine, Level &coarse, ThreadPool &pool)
+{
+    // full weighting, 1 2 1 along every axis
+    glm::ivec3 d = coarse.dims;
+    std::fill(coarse.rhs.begin(), coarse.rhs.end(), 0.0f);
+    pool.parallelFor(1, d.z - 1, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 1; y < d.y - 1; y++)
+            {
+                for (int x = 1; x < d.x - 1; x++)
+                {
+                    float sum = 0.0f;
+                    for (int k = -1; k <= 1; k++)
+                    {
+                        for (int j = -1; j <= 1; j++)
+                        {
+                            for (int i = -1; i <= 1; i++)
+                            {
+                                float weight = (2 - std::abs(i)) * (2 - std::abs(j)) * (2 - std::abs(k));
+                                sum += weight * fine.residual[fine.index(2 * x + i, 2 * y + j, 2 * z + k)];
+                            }
+                        }
+                    }
+                    coarse.rhs[coarse.index(x, y, z)] = sum / 64.0f;
+                }
+            }
+        }
+    });
+}
+
+void PoissonMultigrid::prolongate(const Level &coarse, Level &fine, ThreadPool &pool)
+{
+    // trilinear, every fine point averages the coarse points it lies between
+    glm::ivec3 d = fine.dims;
+    pool.parallelFor(1, d.z - 1, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            int z0 = z / 2, z1 = (z + 1) / 2;
+            for (int y = 1; y < d.y - 1; y++)
+            {
+                int y0 = y / 2, y1 = (y + 1) / 2;
+                for (int x = 1; x < d.x - 1; x++)
+                {
+                    int x0 = x / 2, x1 = (x + 1) / 2;
+                    float sum = coarse.phi[coarse.index(x0, y0, z0)] + coarse.phi[coarse.index(x1, y0, z0)] +
+                                coarse.phi[coarse.index(x0, y1, z0)] + coarse.phi[coarse.index(x1, y1, z0)] +
+                                coarse.phi[coarse.index(x0, y0, z1)] + coarse.phi[coarse.index(x1, y0, z1)] +
+                                coarse.phi[coarse.index(x0, y1, z1)] + coarse.phi[coarse.index(x1, y1, z1)];
+                    fine.phi[fine.index(x, y, z)] += sum * 0.125f;
+                }
+            }
+        }
+    });
+}
+
+void PoissonMultigrid::cycle(int depth, ThreadPool &pool)
+{
+    Level &level = levels[depth];
+    if (depth + 1 == (int)levels.size())
+    {
+        smooth(level, coarseSweeps, pool);
+        return;
+    }
+
+    // the coarse level solves for the error, which is zero on the boundary
+    smooth(level, preSmooth, pool);
+    computeResidual(level, pool);
+    Level &coarse = levels[depth + 1];
+    restrictResidual(level, coarse, pool);
+    std::fill(coarse.phi.begin(), coarse.phi.end(), 0.0f);
+    cycle(depth + 1, pool);
+    prolongate(coarse, level, pool);
+    smooth(level, postSmooth, pool);
+}
+
+MultigridStats PoissonMultigrid::solve(const DensityGrid &density, double tolerance, int maxCycles, ThreadPool &pool)
+{
+    Level &top = levels[0];
+    std::fill(top.rhs.begin(), top.rhs.end(), 0.0f);
+    std::fill(top.phi.begin(), top.phi.end(), 0.0f);
+
+    // total charge and dipole about the charge center, for the boundary
+    double volume = (double)density.spacing * density.spacing * density.spacing;
+    double charge = 0.0, absCharge = 0.0;
+    glm::dvec3 weighted = glm::dvec3(0.0);
+    double rhsNorm = 0.0;
+    for (int z = 0; z < density.dims.z; z++)
+    {
+        for (int y = 0; y < density.dims.y; y++)
+        {
+            for (int x = 0; x < density.dims.x; x++)
+            {
+                float rho = density.rho[density.index(x, y, z)];
+                float rhs = 4.0f * (float)M_PI * rho;
+                top.rhs[top.index(x + offset.x, y + offset.y, z + offset.z)] = rhs;
+                rhsNorm += (double)rhs * rhs;
+
+                double q = rho * volume;
+                glm::dvec3 p = glm::dvec3(glm::vec3(x, y, z) * density.spacing);
+                charge += q;
+                absCharge += std::abs(q);
+                weighted += std::abs(q) * p;
+            }
+        }
+    }
+    rhsNorm = sqrt(rhsNorm);
+
+    glm::dvec3 center = absCharge > 0.0 ? weighted * (1.0 / absCharge) : glm::dvec3(0.0);
+    glm::dvec3 dipole = glm::dvec3(0.0);
+    double quadrupole[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+    for (int z = 0; z < density.dims.z; z++)
+    {
+        for (int y = 0; y < density.dims.y; y++)
+        {
+            for (int x = 0; x < density.dims.x; x++)
+            {
+                double q = density.rho[density.index(x, y, z)] * volume;
+                glm::dvec3 r = glm::dvec3(glm::vec3(x, y, z) * density.spacing) - center;
+                dipole += q * r;
+                double r2 = glm::dot(r, r);
+                for (int i = 0; i < 3; i++)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        quadrupole[i][j] += q * (3.0 * r[i] * r[j] - (i == j ? r2 : 0.0));
+                    }
+                }
+            }
+        }
+    }
+
+    // the padded grid's faces take the monopole, dipole and quadrupole potential
+    glm::ivec3 d = top.dims;
+    for (int z = 0; z < d.z; z++)
+    {
+        for (int y = 0; y < d.y; y++)
+        {
+            for (int x = 0; x < d.x; x++)
+            {
+                bool face = x == 0 || y == 0 || z == 0 || x == d.x - 1 || y == d.y - 1 || z == d.z - 1;
+                if (!face)
+                {
+                    continue;
+                }
+                glm::dvec3 r = glm::dvec3(glm::vec3(glm::ivec3(x, y, z) - offset) * top.spacing) - center;
+                double dist = std::max(glm::length(r), (double)coulombMinDist);
+                double dist3 = dist * dist * dist;
+                double quad = 0.0;
+                for (int i = 0; i < 3; i++)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        quad += quadrupole[i][j] * r[i] * r[j];
+                    }
+                }
+                top.phi[top.index(x, y, z)] =
+                    charge / dist + glm::dot(dipole, r) / dist3 + 0.5 * quad / (dist3 * dist * dist);
+            }
+        }
+    }
+
+    MultigridStats stats;
+    double scale = rhsNorm > 0.0 ? rhsNorm : 1.0;
+    stats.residuals.push_back(computeResidual(top, pool) / scale);
+    double start = seconds();
+    while (stats.cycles < maxCycles && stats.residuals.back() > tolerance)
+    {
+        cycle(0, pool);
+        stats.cycles++;
+        stats.residuals.push_back(computeResidual(top, pool) / scale);
+
+        // float rounding stops the residual somewhere around 1e-5, more cycles won't help
+        if (stats.residuals.back() > 0.9 * stats.residuals[stats.residuals.size() - 2])
+        {
+            break;
+        }
+    }
+    stats.secondsPerCycle = stats.cycles > 0 ? (seconds() - start) / stats.cycles : 0.0;
+    return stats;
+}
+
+float PoissonMultigrid::potential(int x, int y, int z) const
+{
+    return levels[0].phi[levels[0].index(x + offset.x, y + offset.y, z + offset.z)];
+}
+
+void PoissonMultigrid::field(FieldGrid &grid, ThreadPool &pool) const
+{
+    const Level &top = levels[0];
+    glm::ivec3 d = densityDims;
+    pool.parallelFor(0, d.z, 1, [&](size_t first, size_t last) {
+        for (int z = first; z < (int)last; z++)
+        {
+            for (int y = 0; y < d.y; y++)
+            {
+                for (int x = 0; x < d.x; x++)
+                {
+                    // the margin puts a point on both sides of every density point
+                    size_t i = top.index(x + offset.x, y + offset.y, z + offset.z);
+                    size_t strides[3] = {1, (size_t)top.dims.x, (size_t)top.dims.x * top.dims.y};
+                    glm::vec3 e;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        e[axis] = -(top.phi[i + strides[axis]] - top.phi[i - strides[axis]]) / (2.0f * top.spacing);
+                    }
+
+                    size_t g = grid.index(x, y, z);
+                    grid.magnitude[g] = glm::length(e);
+                    grid.direction[g] = grid.magnitude[g] > 0.0f ? e / grid.magnitude[g] : glm::vec3(0.0f);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,85 @@
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "field.h"
+#include "threadPool.h"
+
+// charge per unit volume sampled on a regular grid, x fastest like FieldGrid
+struct DensityGrid
+{
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float spacing;
+    std::vector<float> rho;
+
+    size_t index(int x, int y, int z) const;
+};
+
+// reads the volume of a Gaussian cube file, the usual DFT output. the values are taken
+// as charge density as they are and the atoms are skipped. lengths are multiplied by
+// scale with the charge of every voxel kept. only axis aligned cubic voxels are
+// supported, throws std::runtime_error otherwise or if the file can't be read
+void loadCubeDensity(const std::string &path, float scale, DensityGrid &density);
+
+struct MultigridStats
+{
+    int cycles = 0;
+    // relative residual before the first cycle and after each one
+    std::vector<double> residuals;
+    double secondsPerCycle = 0.0;
+
+    // mean factor the residual shrinks by per cycle
+    double convergenceRate() const;
+};
+
+// geometric multigrid for -laplacian(phi) = 4 pi rho on a density grid, the same units as
+// the point charges. the density is treated as isolated: it's centered in a grid padded
+// by an eighth of its longest edge on every side, at least 4 points, and the boundary
+// takes the potential of its monopole, dipole and quadrupole. the padded edges are ones
+// that coarsen well, m 2^k + 1 points, solved with V-cycles of red-black Gauss-Seidel,
+// parallel over z
+class PoissonMultigrid
+{
+    struct Level
+    {
+        glm::ivec3 dims;
+        float spacing;
+        std::vector<float> phi, rhs, residual;
+
+        size_t index(int x, int y, int z) const;
+    };
+
+    std::vector<Level> levels;
+    glm::ivec3 densityDims;
+    // where the density's first point sits in the finest level
+    glm::ivec3 offset;
+
+    void smooth(Level &level, int sweeps, ThreadPool &pool);
+    double computeResidual(Level &level, ThreadPool &pool);
+    void restrictResidual(const Level &fine, Level &coarse, ThreadPool &pool);
+    void prolongate(const Level &coarse, Level &fine, ThreadPool &pool);
+    void cycle(int depth, ThreadPool &pool);
+
+public:
+    int preSmooth = 2;
+    int postSmooth = 2;
+    int coarseSweeps = 50;
+
+    PoissonMultigrid(const glm::ivec3 &dims, float spacing);
+
+    // runs V-cycles until the residual drops below tolerance times the right hand side,
+    // or stops dropping
+    MultigridStats solve(const DensityGrid &density, double tolerance, int maxCycles, ThreadPool &pool);
+
+    // the potential at a density grid point
+    float potential(int x, int y, int z) const;
+    // E = -grad(phi) by central differences into a grid with the density's shape
+    void field(FieldGrid &grid, ThreadPool &pool) const;
+};
+
+#endif // MULTIGRID_H
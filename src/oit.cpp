@@ -0,0 +1,111 @@
+#include "oit.h"
+#include "shader.h"
+
+#include <iostream>
+
+static GLuint makeTarget(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+{
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+}
+
+WeightedOit::WeightedOit(int targetWidth, int targetHeight)
+{
+    width = targetWidth;
+    height = targetHeight;
+
+    opaqueTex = makeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    depthTex = makeTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+    accumTex = makeTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+    revealTex = makeTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &opaqueFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, opaqueFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, opaqueTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "OIT Error: opaque framebuffer incomplete" << std::endl;
+    }
+
+    // transparent pass is depth tested against the opaque pass' depth
+    glGenFramebuffers(1, &accumFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
+    GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, buffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "OIT Error: accumulation framebuffer incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    compositeProgram = loadShaderProgram("shaders/fullscreenVertex.glsl", "shaders/oitComposite.glsl");
+    glUseProgram(compositeProgram);
+    glUniform1i(glGetUniformLocation(compositeProgram, "accum"), 0);
+    glUniform1i(glGetUniformLocation(compositeProgram, "reveal"), 1);
+    glGenVertexArrays(1, &VAO);
+}
+
+void WeightedOit::beginOpaque()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, opaqueFBO);
+    glViewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void WeightedOit::beginTransparent()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+
+    // nothing accumulated, everything behind fully revealed
+    const GLfloat accumClear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const GLfloat revealClear[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    glClearBufferfv(GL_COLOR, 0, accumClear);
+    glClearBufferfv(GL_COLOR, 1, revealClear);
+
+    // sums in rgb, product of (1 - alpha) in the alpha channel
+    glDepthMask(GL_FALSE);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void WeightedOit::composite(bool hasTransparent)
+{
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // the opaque image goes to the output as is
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, opaqueFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+
+    if (!hasTransparent)
+    {
+        return;
+    }
+
+    // then the averaged transparent color over it, weighted by how much it covers
+    glUseProgram(compositeProgram);
+    glBindVertexArray(VAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, revealTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    glDisable(GL_DEPTH_TEST);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,33 @@
+#ifndef OIT_H
+#define OIT_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+// weighted blended order independent transparency. opaque geometry renders into its own
+// target, transparent geometry accumulates weighted color and revealage against the same
+// depth buffer with commutative blending, and a full screen pass composites the two into
+// the output framebuffer. no sorting needed, the cost doesn't depend on draw order
+//
+// the lit fragment shader writes
+//   outColor  = (color * alpha * w, 0)
+//   outReveal = (alpha * w, 0, 0, alpha)
+// which one blend function handles for both targets on GL 3.3
+class WeightedOit
+{
+    GLuint opaqueFBO, accumFBO;
+    GLuint opaqueTex, depthTex, accumTex, revealTex;
+    GLuint compositeProgram, VAO;
+    int width, height;
+
+public:
+    // where composite() puts the final image, 0 for the window
+    GLuint outputFBO = 0;
+
+    WeightedOit(int targetWidth, int targetHeight);
+    void beginOpaque();
+    void beginTransparent();
+    void composite(bool hasTransparent);
+};
+
+#endif // OIT_H
@@ -0,0 +1,318 @@
+#include "primitives.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// nodes and weights of the n point Gauss-Legendre rule on [-1, 1], Newton on the
+// Legendre recurrence from the Chebyshev guesses
+static void gaussLegendre(int n, std::vector<double> &nodes, std::vector<double> &weights)
+{
+    nodes.resize(n);
+    weights.resize(n);
+    for (int i = 0; i < (n + 1) / 2; i++)
+    {
+        double x = cos(M_PI * (i + 0.75) / (n + 0.5));
+        double derivative = 1.0;
+        for (int iteration = 0; iteration < 100; iteration++)
+        {
+            double p0 = 1.0, p1 = 0.0;
+            for (int k = 1; k <= n; k++)
+            {
+                double p2 = p1;
+                p1 = p0;
+                p0 = ((2.0 * k - 1.0) * x * p1 - (k - 1.0) * p2) / k;
+            }
+            derivative = n * (x * p0 - p1) / (x * x - 1.0);
+            double step = p0 / derivative;
+            x -= step;
+            if (std::abs(step) < 1e-15)
+            {
+                break;
+            }
+        }
+        nodes[i] = -x;
+        nodes[n - 1 - i] = x;
+        weights[i] = weights[n - 1 - i] = 2.0 / ((1.0 - x * x) * derivative * derivative);
+    }
+}
+
+// about n nodes on [-1, 1] as equal panels of the two point Gauss-Legendre rule. a single
+// high order rule bunches its nodes at the ends, panels keep the spacing even for
+// samples close to the primitive
+static void compositeRule(int n, std::vector<double> &nodes, std::vector<double> &weights)
+{
+    int order = std::min(n, 2);
+    int panels = (n + order - 1) / order;
+    std::vector<double> x, w;
+    gaussLegendre(order, x, w);
+    nodes.clear();
+    weights.clear();
+    for (int p = 0; p < panels; p++)
+    {
+        double center = -1.0 + (2.0 * p + 1.0) / panels;
+        for (int i = 0; i < order; i++)
+        {
+            nodes.push_back(center + x[i] / panels);
+            weights.push_back(w[i] / panels);
+        }
+    }
+}
+
+// two unit vectors perpendicular to normal and each other
+static void planeBasis(const glm::vec3 &normal, glm::vec3 &e1, glm::vec3 &e2)
+{
+    glm::vec3 n = glm::normalize(normal);
+    glm::vec3 helper = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    e1 = glm::normalize(glm::cross(n, helper));
+    e2 = glm::cross(n, e1);
+}
+
+ChargePrimitive ChargePrimitive::line(const glm::vec3 &a, const glm::vec3 &b, float charge)
+{
+    ChargePrimitive p = {LINE, (a + b) * 0.5f, (b - a) * 0.5f, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, charge};
+    return p;
+}
+
+ChargePrimitive ChargePrimitive::ring(const glm::vec3 &center, const glm::vec3 &normal, float radius, float charge)
+{
+    ChargePrimitive p = {RING, center, glm::vec3(0.0f), glm::vec3(0.0f), normal, radius, charge};
+    return p;
+}
+
+ChargePrimitive ChargePrimitive::disk(const glm::vec3 &center, const glm::vec3 &normal, float radius, float charge)
+{
+    ChargePrimitive p = {DISK, center, glm::vec3(0.0f), glm::vec3(0.0f), normal, radius, charge};
+    return p;
+}
+
+ChargePrimitive ChargePrimitive::plate(const glm::vec3 &center, const glm::vec3 &halfU, const glm::vec3 &halfV,
+                                       float charge)
+{
+    ChargePrimitive p = {PLATE, center, halfU, halfV, glm::vec3(0.0f), 0.0f, charge};
+    return p;
+}
+
+ChargePrimitive ChargePrimitive::box(const glm::vec3 &center, const glm::vec3 &halfU, const glm::vec3 &halfV,
+                                     const glm::vec3 &halfW, float charge)
+{
+    ChargePrimitive p = {BOX, center, halfU, halfV, halfW, 0.0f, charge};
+    return p;
+}
+
+void PrimitiveSet::add(const ChargePrimitive &primitive)
+{
+    primitives.push_back(primitive);
+}
+
+void PrimitiveSet::clear()
+{
+    primitives.clear();
+    nodes.clear();
+    generated = 0;
+}
+
+size_t PrimitiveSet::size() const
+{
+    return primitives.size();
+}
+
+bool PrimitiveSet::empty() const
+{
+    return primitives.empty();
+}
+
+const ChargePrimitive &PrimitiveSet::operator[](size_t i) const
+{
+    return primitives[i];
+}
+
+const ChargeSet &PrimitiveSet::quadrature()
+{
+    for (; generated < primitives.size(); generated++)
+    {
+        generate(primitives[generated]);
+    }
+    return nodes;
+}
+
+void PrimitiveSet::generate(const ChargePrimitive &primitive)
+{
+    // nodes along each of the primitive's dimensions, shrunk evenly to fit maxNodes
+    float lengths[3];
+    int dimensions;
+    switch (primitive.type)
+    {
+    case ChargePrimitive::LINE:
+        dimensions = 1;
+        lengths[0] = 2.0f * glm::length(primitive.u);
+        break;
+    case ChargePrimitive::RING:
+        dimensions = 1;
+        lengths[0] = 2.0f * (float)M_PI * primitive.radius;
+        break;
+    case ChargePrimitive::DISK:
+        dimensions = 2;
+        lengths[0] = primitive.radius;
+        lengths[1] = 2.0f * (float)M_PI * primitive.radius;
+        break;
+    case ChargePrimitive::PLATE:
+        dimensions = 2;
+        lengths[0] = 2.0f * glm::length(primitive.u);
+        lengths[1] = 2.0f * glm::length(primitive.v);
+        break;
+    default:
+        dimensions = 3;
+        lengths[0] = 2.0f * glm::length(primitive.u);
+        lengths[1] = 2.0f * glm::length(primitive.v);
+        lengths[2] = 2.0f * glm::length(primitive.w);
+        break;
+    }
+
+    double wanted = 1.0;
+    for (int d = 0; d < dimensions; d++)
+    {
+        wanted *= std::max(1.0f, lengths[d] / resolution);
+    }
+    double shrink = wanted > maxNodes ? pow(maxNodes / wanted, 1.0 / dimensions) : 1.0;
+    int counts[3] = {1, 1, 1};
+    for (int d = 0; d < dimensions; d++)
+    {
+        counts[d] = std::max(1, (int)ceil(std::max(1.0f, lengths[d] / resolution) * shrink));
+    }
+
+    float q = primitive.charge;
+    std::vector<double> s, ws, t, wt, r, wr;
+    glm::vec3 e1, e2;
+    switch (primitive.type)
+    {
+    case ChargePrimitive::LINE:
+        compositeRule(counts[0], s, ws);
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            nodes.add(primitive.center + (float)s[i] * primitive.u, q * (float)(ws[i] * 0.5));
+        }
+        break;
+
+    case ChargePrimitive::RING:
+        planeBasis(primitive.w, e1, e2);
+        counts[0] = std::max(counts[0], 3);
+        for (int i = 0; i < counts[0]; i++)
+        {
+            float angle = 2.0f * (float)M_PI * i / counts[0];
+            nodes.add(primitive.center + primitive.radius * (cos(angle) * e1 + sin(angle) * e2), q / counts[0]);
+        }
+        break;
+
+    case ChargePrimitive::DISK:
+    {
+        // panels in radius with the r dr area element, each circle as a ring, every other
+        // circle turned by half a step
+        planeBasis(primitive.w, e1, e2);
+        compositeRule(counts[0], s, ws);
+        float area = (float)M_PI * primitive.radius * primitive.radius;
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            float radius = (float)(s[i] + 1.0) * 0.5f * primitive.radius;
+            int around = std::max(3, (int)ceil(counts[1] * radius / primitive.radius));
+            float share = (float)(ws[i] * 0.5) * primitive.radius * radius * 2.0f * (float)M_PI / around / area;
+            for (int j = 0; j < around; j++)
+            {
+                float angle = 2.0f * (float)M_PI * (j + 0.5f * (i & 1)) / around;
+                nodes.add(primitive.center + radius * (cos(angle) * e1 + sin(angle) * e2), q * share);
+            }
+        }
+        break;
+    }
+
+    case ChargePrimitive::PLATE:
+        compositeRule(counts[0], s, ws);
+        compositeRule(counts[1], t, wt);
+        for (size_t j = 0; j < t.size(); j++)
+        {
+            for (size_t i = 0; i < s.size(); i++)
+            {
+                glm::vec3 p = primitive.center + (float)s[i] * primitive.u + (float)t[j] * primitive.v;
+                nodes.add(p, q * (float)(ws[i] * wt[j] * 0.25));
+            }
+        }
+        break;
+
+    case ChargePrimitive::BOX:
+        compositeRule(counts[0], s, ws);
+        compositeRule(counts[1], t, wt);
+        compositeRule(counts[2], r, wr);
+        for (size_t k = 0; k < r.size(); k++)
+        {
+            for (size_t j = 0; j < t.size(); j++)
+            {
+                for (size_t i = 0; i < s.size(); i++)
+                {
+                    glm::vec3 p = primitive.center + (float)s[i] * primitive.u + (float)t[j] * primitive.v +
+                                  (float)r[k] * primitive.w;
+                    nodes.add(p, q * (float)(ws[i] * wt[j] * wr[k] * 0.125));
+                }
+            }
+        }
+        break;
+    }
+}
+
+void loadPrimitives(const std::string &path, PrimitiveSet &primitives)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        throw std::runtime_error("Primitive Error: could not open " + path);
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type))
+        {
+            continue;
+        }
+
+        // how many numbers each type takes, charge last
+        int expected = type == "line" ? 7 : type == "ring" || type == "disk" ? 8 : type == "plate" ? 10
+                                                                                 : type == "box" ? 13 : 0;
+        float v[13];
+        int read = 0;
+        while (read < expected && fields >> v[read])
+        {
+            read++;
+        }
+        std::string extra;
+        if (expected == 0 || read != expected || fields >> extra)
+        {
+            throw std::runtime_error("Primitive Error: " + path + " line " + std::to_string(lineNumber) +
+                                     " is not a line, ring, disk, plate or box");
+        }
+
+        glm::vec3 a = glm::vec3(v[0], v[1], v[2]);
+        glm::vec3 b = glm::vec3(v[3], v[4], v[5]);
+        // rings and disks need a direction to face and a size
+        if ((type == "ring" || type == "disk") && (b == glm::vec3(0.0f) || !(v[6] > 0.0f)))
+        {
+            throw std::runtime_error("Primitive Error: " + path + " line " + std::to_string(lineNumber) +
+                                     " needs a nonzero normal and a positive radius");
+        }
+        if (type == "line")
+            primitives.add(ChargePrimitive::line(a, b, v[6]));
+        else if (type == "ring")
+            primitives.add(ChargePrimitive::ring(a, b, v[6], v[7]));
+        else if (type == "disk")
+            primitives.add(ChargePrimitive::disk(a, b, v[6], v[7]));
+        else if (type == "plate")
+            primitives.add(ChargePrimitive::plate(a, b, glm::vec3(v[6], v[7], v[8]), v[9]));
+        else
+            primitives.add(ChargePrimitive::box(a, b, glm::vec3(v[6], v[7], v[8]), glm::vec3(v[9], v[10], v[11]),
+                                                v[12]));
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+
+// a charge spread evenly over a line segment, ring, disk, parallelogram plate or box.
+// build them with the named constructors, the vectors mean different things per type
+struct ChargePrimitive
+{
+    enum Type
+    {
+        LINE,
+        RING,
+        DISK,
+        PLATE,
+        BOX
+    };
+
+    Type type;
+    glm::vec3 center;
+    // half edges for lines (u), plates (u, v) and boxes (u, v, w), the normal for rings
+    // and disks (w)
+    glm::vec3 u, v, w;
+    float radius;
+    float charge;
+
+    static ChargePrimitive line(const glm::vec3 &a, const glm::vec3 &b, float charge);
+    static ChargePrimitive ring(const glm::vec3 &center, const glm::vec3 &normal, float radius, float charge);
+    static ChargePrimitive disk(const glm::vec3 &center, const glm::vec3 &normal, float radius, float charge);
+    static ChargePrimitive plate(const glm::vec3 &center, const glm::vec3 &halfU, const glm::vec3 &halfV, float charge);
+    static ChargePrimitive box(const glm::vec3 &center, const glm::vec3 &halfU, const glm::vec3 &halfV,
+                               const glm::vec3 &halfW, float charge);
+};
+
+// primitives and their quadrature nodes. every primitive is integrated with panels of
+// Gauss-Legendre rules (trapezoid around rings and disks, where it converges fastest)
+// with about one node per resolution units and at most maxNodes in all, so its field is
+// accurate from a couple of node spacings away. the nodes are point charges weighted by
+// their share of the charge, kept as a ChargeSet so they go through the same kernels as
+// the user's charges, and are only generated for primitives added since the last call
+class PrimitiveSet
+{
+    std::vector<ChargePrimitive> primitives;
+    ChargeSet nodes;
+    size_t generated = 0;
+
+    void generate(const ChargePrimitive &primitive);
+
+public:
+    float resolution = 5.0f;
+    int maxNodes = 4096;
+
+    void add(const ChargePrimitive &primitive);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    const ChargePrimitive &operator[](size_t i) const;
+
+    const ChargeSet &quadrature();
+};
+
+// reads primitives from a text file, one per line, blank lines and # comments skipped:
+//   line  ax ay az  bx by bz  q
+//   ring  cx cy cz  nx ny nz  radius  q
+//   disk  cx cy cz  nx ny nz  radius  q
+//   plate cx cy cz  ux uy uz  vx vy vz  q        (u and v are half edges)
+//   box   cx cy cz  ux uy uz  vx vy vz  wx wy wz  q
+// throws std::runtime_error naming the line if one can't be read
+void loadPrimitives(const std::string &path, PrimitiveSet &primitives);
+
+#endif // PRIMITIVES_H
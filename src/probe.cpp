@@ -0,0 +1,402 @@
+#include "probe.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+static double seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// spreads the low 10 bits of v out to every third bit
+static uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// weights of the 4 point cubic through the nodes at -1, 0, 1 and 2, at t in [0, 1]
+static void cubicWeights(float t, float *w)
+{
+    w[0] = -t * (t - 1.0f) * (t - 2.0f) / 6.0f;
+    w[1] = (t + 1.0f) * (t - 1.0f) * (t - 2.0f) / 2.0f;
+    w[2] = -(t + 1.0f) * t * (t - 2.0f) / 2.0f;
+    w[3] = (t + 1.0f) * t * (t - 1.0f) / 6.0f;
+}
+
+// share of the tolerance the tried points of a trusted cell may use
+static const float probeMargin = 0.25f;
+
+// points handled together, small enough that their scratch stays on the stack
+static const size_t probeBatch = 256;
+
+// the sort keys hold a point's index in their low 32 bits, bigger queries go in slices
+static const uint64_t probeMaxSlice = (uint64_t)1 << 32;
+
+FieldProbe::FieldProbe(glm::ivec3 gridDims, glm::vec3 gridOrigin, float gridSpacing)
+{
+    dims = glm::max(gridDims, glm::ivec3(2));
+    origin = gridOrigin;
+    spacing = gridSpacing;
+    nodeX.resize((size_t)dims.x * dims.y * dims.z, 0.0f);
+    nodeY.resize(nodeX.size(), 0.0f);
+    nodeZ.resize(nodeX.size(), 0.0f);
+    trusted.resize((size_t)(dims.x - 1) * (dims.y - 1) * (dims.z - 1), 0);
+}
+
+size_t FieldProbe::node(int x, int y, int z) const
+{
+    return ((size_t)z * dims.y + y) * dims.x + x;
+}
+
+size_t FieldProbe::cell(int x, int y, int z) const
+{
+    return ((size_t)z * (dims.y - 1) + y) * (dims.x - 1) + x;
+}
+
+uint32_t FieldProbe::mortonCode(float x, float y, float z) const
+{
+    glm::vec3 u = (glm::vec3(x, y, z) - origin) / (spacing * glm::vec3(dims - glm::ivec3(1))) * 1023.0f;
+    u = glm::clamp(u, glm::vec3(0.0f), glm::vec3(1023.0f));
+    return (spreadBits((uint32_t)u.x) << 2) | (spreadBits((uint32_t)u.y) << 1) | spreadBits((uint32_t)u.z);
+}
+
+void FieldProbe::interpolate(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey,
+                             float *ez) const
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        // the cell and where in it, points on the far faces go in the last cell
+        float ux = (x[k] - origin.x) / spacing;
+        float uy = (y[k] - origin.y) / spacing;
+        float uz = (z[k] - origin.z) / spacing;
+        int cx = std::min(std::max((int)ux, 0), dims.x - 2);
+        int cy = std::min(std::max((int)uy, 0), dims.y - 2);
+        int cz = std::min(std::max((int)uz, 0), dims.z - 2);
+        float tx = ux - cx;
+        float ty = uy - cy;
+        float tz = uz - cz;
+
+        float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+        if (interpolation == TRILINEAR)
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+                float w = (dx ? tx : 1.0f - tx) * (dy ? ty : 1.0f - ty) * (dz ? tz : 1.0f - tz);
+                size_t i = node(cx + dx, cy + dy, cz + dz);
+                fx += w * nodeX[i];
+                fy += w * nodeY[i];
+                fz += w * nodeZ[i];
+            }
+        }
+        else
+        {
+            // nodes past the grid's edge are clamped to it, the trust test catches where
+            // that costs accuracy
+            float wx[4], wy[4], wz[4];
+            cubicWeights(tx, wx);
+            cubicWeights(ty, wy);
+            cubicWeights(tz, wz);
+            for (int k2 = 0; k2 < 4; k2++)
+            {
+                int nz = std::min(std::max(cz + k2 - 1, 0), dims.z - 1);
+                for (int j = 0; j < 4; j++)
+                {
+                    int ny = std::min(std::max(cy + j - 1, 0), dims.y - 1);
+                    float wyz = wy[j] * wz[k2];
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int nx = std::min(std::max(cx + i - 1, 0), dims.x - 1);
+                        float w = wx[i] * wyz;
+                        size_t index = node(nx, ny, nz);
+                        fx += w * nodeX[index];
+                        fy += w * nodeY[index];
+                        fz += w * nodeZ[index];
+                    }
+                }
+            }
+        }
+        ex[k] = fx;
+        ey[k] = fy;
+        ez[k] = fz;
+    }
+}
+
+void FieldProbe::exact(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey,
+                       float *ez) const
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        ex[k] = 0.0f;
+        ey[k] = 0.0f;
+        ez[k] = 0.0f;
+    }
+
+    // the same clamped coulomb sum as FieldGrid::evaluate, charges in the outer loop
+    const float minDistSquared = coulombMinDist * coulombMinDist;
+    for (size_t c = 0; c < charges.size(); c++)
+    {
+        float qx = charges.x[c], qy = charges.y[c], qz = charges.z[c], q = charges.q[c];
+        for (size_t k = 0; k < n; k++)
+        {
+            float rx = x[k] - qx;
+            float ry = y[k] - qy;
+            float rz = z[k] - qz;
+            float d2 = std::max(rx * rx + ry * ry + rz * rz, minDistSquared);
+            float s = q / (d2 * std::sqrt(d2));
+            ex[k] += s * rx;
+            ey[k] += s * ry;
+            ez[k] += s * rz;
+        }
+    }
+}
+
+void FieldProbe::build(const ChargeSet &sources, float tolerance, Interpolation mode, ThreadPool &pool)
+{
+    charges = sources;
+    interpolation = mode;
+
+    // one row of nodes at a time
+    pool.parallelFor(0, (size_t)dims.z * dims.y, 4, [&](size_t first, size_t last) {
+        std::vector<float> xs(dims.x), ys(dims.x), zs(dims.x);
+        for (size_t row = first; row < last; row++)
+        {
+            int y = row % dims.y;
+            int z = row / dims.y;
+            for (int x = 0; x < dims.x; x++)
+            {
+                xs[x] = origin.x + x * spacing;
+                ys[x] = origin.y + y * spacing;
+                zs[x] = origin.z + z * spacing;
+            }
+            size_t i = node(0, y, z);
+            exact(&xs[0], &ys[0], &zs[0], dims.x, &nodeX[i], &nodeY[i], &nodeZ[i]);
+        }
+    });
+
+    // cells whose interpolation reads a node next to a charge never interpolate, the
+    // field isn't smooth there. that's a cell either way for trilinear, the cubic stencil
+    // reaches a node further
+    int reach = mode == TRICUBIC ? 2 : 1;
+    std::fill(trusted.begin(), trusted.end(), 1);
+    for (size_t c = 0; c < charges.size(); c++)
+    {
+        glm::ivec3 at = glm::ivec3(glm::floor((charges.position(c) - origin) / spacing));
+        glm::ivec3 lo = glm::max(at - glm::ivec3(reach), glm::ivec3(0));
+        glm::ivec3 hi = glm::min(at + glm::ivec3(reach), dims - glm::ivec3(2));
+        for (int z = lo.z; z <= hi.z; z++)
+        {
+            for (int y = lo.y; y <= hi.y; y++)
+            {
+                for (int x = lo.x; x <= hi.x; x++)
+                {
+                    trusted[cell(x, y, z)] = 0;
+                }
+            }
+        }
+    }
+
+    // the rest are tried where interpolation is worst, a row of cells at a time: the
+    // center and the midpoints of every face and edge, since away from the charges the
+    // field is harmonic and the error at the center alone nearly cancels. they have to
+    // pass with a margin, the error between the tried points can be larger
+    glm::vec3 tries[19];
+    int tryCount = 0;
+    for (int k = 0; k < 27; k++)
+    {
+        glm::vec3 offset = glm::vec3(k % 3, k / 3 % 3, k / 9) * 0.5f;
+        bool corner = offset.x != 0.5f && offset.y != 0.5f && offset.z != 0.5f;
+        if (!corner)
+        {
+            tries[tryCount++] = offset;
+        }
+    }
+    int cellsX = dims.x - 1;
+    pool.parallelFor(0, (size_t)(dims.z - 1) * (dims.y - 1), 4, [&](size_t first, size_t last) {
+        std::vector<float> scratch(9 * cellsX);
+        float *xs = &scratch[0];
+        float *ys = xs + cellsX;
+        float *zs = ys + cellsX;
+        float *ix = zs + cellsX;
+        float *iy = ix + cellsX;
+        float *iz = iy + cellsX;
+        float *ex = iz + cellsX;
+        float *ey = ex + cellsX;
+        float *ez = ey + cellsX;
+        for (size_t row = first; row < last; row++)
+        {
+            int y = row % (dims.y - 1);
+            int z = row / (dims.y - 1);
+            for (const glm::vec3 &offset : tries)
+            {
+                for (int x = 0; x < cellsX; x++)
+                {
+                    xs[x] = origin.x + (x + offset.x) * spacing;
+                    ys[x] = origin.y + (y + offset.y) * spacing;
+                    zs[x] = origin.z + (z + offset.z) * spacing;
+                }
+                interpolate(xs, ys, zs, cellsX, ix, iy, iz);
+                exact(xs, ys, zs, cellsX, ex, ey, ez);
+                for (int x = 0; x < cellsX; x++)
+                {
+                    glm::vec3 error = glm::vec3(ix[x] - ex[x], iy[x] - ey[x], iz[x] - ez[x]);
+                    float magnitude = glm::length(glm::vec3(ex[x], ey[x], ez[x]));
+                    unsigned char &t = trusted[cell(x, y, z)];
+                    t = t && glm::length(error) <= probeMargin * tolerance * magnitude;
+                }
+            }
+        }
+    });
+}
+
+float FieldProbe::trustedFraction() const
+{
+    size_t count = std::count(trusted.begin(), trusted.end(), 1);
+    return trusted.empty() ? 0.0f : (float)count / trusted.size();
+}
+
+ProbeStats FieldProbe::query(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey,
+                             float *ez, ThreadPool &pool) const
+{
+    ProbeStats stats;
+    double start = seconds();
+
+    if ((uint64_t)n > probeMaxSlice)
+    {
+        for (size_t first = 0; first < n; first += (size_t)probeMaxSlice)
+        {
+            size_t count = (size_t)std::min<uint64_t>(probeMaxSlice, n - first);
+            ProbeStats slice = query(x + first, y + first, z + first, count, ex + first, ey + first, ez + first, pool);
+            stats.interpolated += slice.interpolated;
+            stats.exact += slice.exact;
+        }
+        stats.seconds = seconds() - start;
+        return stats;
+    }
+
+    // Morton code above, input index below, so sorting the keys sorts the points
+    std::vector<uint64_t> keys(n);
+    pool.parallelFor(0, n, 1 << 16, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            keys[i] = ((uint64_t)mortonCode(x[i], y[i], z[i]) << 32) | i;
+        }
+    });
+
+    // sorted in chunks in parallel, then the chunks are merged pairwise
+    size_t chunk = std::max<size_t>(1 << 14, (n + pool.size() * 4 - 1) / (pool.size() * 4));
+    size_t chunks = (n + chunk - 1) / chunk;
+    pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            std::sort(keys.begin() + c * chunk, keys.begin() + std::min(n, (c + 1) * chunk));
+        }
+    });
+    for (size_t width = chunk; width < n; width *= 2)
+    {
+        size_t pairs = (n + 2 * width - 1) / (2 * width);
+        pool.parallelFor(0, pairs, 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; p++)
+            {
+                size_t lo = p * 2 * width;
+                size_t mid = std::min(n, lo + width);
+                size_t hi = std::min(n, lo + 2 * width);
+                std::inplace_merge(keys.begin() + lo, keys.begin() + mid, keys.begin() + hi);
+            }
+        });
+    }
+
+    std::atomic<size_t> interpolated(0);
+    std::atomic<size_t> exactCount(0);
+    size_t batches = (n + probeBatch - 1) / probeBatch;
+    pool.parallelFor(0, batches, 16, [&](size_t first, size_t last) {
+        // points of a batch split into the two kinds, each solved as one batch
+        size_t index[2][probeBatch];
+        float px[2][probeBatch], py[2][probeBatch], pz[2][probeBatch];
+        float fx[probeBatch], fy[probeBatch], fz[probeBatch];
+        size_t counted[2] = {0, 0};
+        for (size_t b = first; b < last; b++)
+        {
+            size_t count[2] = {0, 0};
+            for (size_t s = b * probeBatch; s < std::min(n, (b + 1) * probeBatch); s++)
+            {
+                size_t i = keys[s] & 0xffffffffu;
+                glm::vec3 u = (glm::vec3(x[i], y[i], z[i]) - origin) / spacing;
+                bool inside = u.x >= 0.0f && u.y >= 0.0f && u.z >= 0.0f && u.x <= dims.x - 1 &&
+                              u.y <= dims.y - 1 && u.z <= dims.z - 1;
+                int kind = 1;
+                if (inside)
+                {
+                    int cx = std::min((int)u.x, dims.x - 2);
+                    int cy = std::min((int)u.y, dims.y - 2);
+                    int cz = std::min((int)u.z, dims.z - 2);
+                    kind = trusted[cell(cx, cy, cz)] ? 0 : 1;
+                }
+                size_t k = count[kind]++;
+                index[kind][k] = i;
+                px[kind][k] = x[i];
+                py[kind][k] = y[i];
+                pz[kind][k] = z[i];
+            }
+
+            for (int kind = 0; kind < 2; kind++)
+            {
+                if (kind == 0)
+                {
+                    interpolate(px[0], py[0], pz[0], count[0], fx, fy, fz);
+                }
+                else
+                {
+                    exact(px[1], py[1], pz[1], count[1], fx, fy, fz);
+                }
+                for (size_t k = 0; k < count[kind]; k++)
+                {
+                    ex[index[kind][k]] = fx[k];
+                    ey[index[kind][k]] = fy[k];
+                    ez[index[kind][k]] = fz[k];
+                }
+                counted[kind] += count[kind];
+            }
+        }
+        interpolated += counted[0];
+        exactCount += counted[1];
+    });
+
+    stats.interpolated = interpolated;
+    stats.exact = exactCount;
+    stats.seconds = seconds() - start;
+    return stats;
+}
+
+ProbeStats FieldProbe::query(const std::vector<glm::vec3> &points, std::vector<glm::vec3> &field,
+                             ThreadPool &pool) const
+{
+    // split into coordinate arrays and back
+    size_t n = points.size();
+    std::vector<float> coords(6 * n);
+    for (size_t i = 0; i < n; i++)
+    {
+        coords[i] = points[i].x;
+        coords[n + i] = points[i].y;
+        coords[2 * n + i] = points[i].z;
+    }
+    field.resize(n);
+    if (n == 0)
+    {
+        return ProbeStats();
+    }
+    ProbeStats stats = query(&coords[0], &coords[n], &coords[2 * n], n, &coords[3 * n], &coords[4 * n],
+                             &coords[5 * n], pool);
+    for (size_t i = 0; i < n; i++)
+    {
+        field[i] = glm::vec3(coords[3 * n + i], coords[4 * n + i], coords[5 * n + i]);
+    }
+    return stats;
+}
@@ -0,0 +1,74 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "charges.h"
+#include "threadPool.h"
+
+struct ProbeStats
+{
+    size_t interpolated = 0;
+    size_t exact = 0;
+    double seconds = 0.0;
+};
+
+// the field at arbitrary points, for particle tracks, sensor positions and the like. the
+// charges' field is cached on a grid, and a point is answered by interpolating the grid
+// when its cell was found accurate enough, by summing over the charges otherwise.
+//
+// a cell is trusted when no node its interpolation reads is next to a charge and the
+// interpolated field is within a quarter of the tolerance of the exact one at its center
+// and every face and edge midpoint, where interpolation is worst. that's a test, not a
+// bound: between the tried points the error can grow, the margin is there to cover it.
+// on random charge sets the worst point of a million stayed within 0.3 of the tolerance.
+// the exact sum answers the points near charges and outside the grid.
+//
+// queries take millions of points at once as coordinate arrays. they're put in Morton
+// order over the grid so neighboring points share cells and cache lines, solved in
+// parallel batches, and written back in the order they came in
+class FieldProbe
+{
+public:
+    enum Interpolation
+    {
+        TRILINEAR,
+        TRICUBIC // 4x4x4 cubic Lagrange, one order better away from the charges
+    };
+
+private:
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float spacing;
+    Interpolation interpolation = TRILINEAR;
+
+    // the field at every node, x fastest, and per cell whether interpolation may answer
+    std::vector<float> nodeX, nodeY, nodeZ;
+    std::vector<unsigned char> trusted;
+    ChargeSet charges;
+
+    size_t node(int x, int y, int z) const;
+    size_t cell(int x, int y, int z) const;
+    uint32_t mortonCode(float x, float y, float z) const;
+    void interpolate(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey, float *ez) const;
+    void exact(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey, float *ez) const;
+
+public:
+    FieldProbe(glm::ivec3 gridDims, glm::vec3 gridOrigin, float gridSpacing);
+
+    // caches the field of charges on the grid and finds the cells interpolation answers
+    // within tolerance, the relative error of the field vector, as tested above
+    void build(const ChargeSet &charges, float tolerance, Interpolation interpolation, ThreadPool &pool);
+    // fraction of the grid's cells that interpolation answers
+    float trustedFraction() const;
+
+    // the field at n points, written to ex, ey and ez in the order of the input
+    ProbeStats query(const float *x, const float *y, const float *z, size_t n, float *ex, float *ey, float *ez,
+                     ThreadPool &pool) const;
+    ProbeStats query(const std::vector<glm::vec3> &points, std::vector<glm::vec3> &field, ThreadPool &pool) const;
+};
+
+#endif // PROBE_H
@@ -0,0 +1,72 @@
+#include "profiler.h"
+
+#include <stdio.h>
+
+int Profiler::addCounter(const std::string &name, double scale)
+{
+    Counter counter = {name, scale, 0.0, false};
+    counters.push_back(counter);
+    return counters.size() - 1;
+}
+
+int Profiler::addGauge(const std::string &name, double scale)
+{
+    Counter gauge = {name, scale, 0.0, true};
+    counters.push_back(gauge);
+    return counters.size() - 1;
+}
+
+void Profiler::set(int gauge, double value)
+{
+    counters[gauge].sum = value;
+}
+
+void Profiler::add(int counter, double value)
+{
+    counters[counter].sum += value;
+}
+
+void Profiler::frame(double now, double frameTime)
+{
+    if (windowStart < 0.0)
+    {
+        windowStart = now;
+    }
+    frameTimeSum += frameTime;
+    frames++;
+
+    double elapsed = now - windowStart;
+    if (elapsed < interval)
+    {
+        return;
+    }
+
+    if (enabled)
+    {
+        printf("frame %.2fms", frames > 0 ? frameTimeSum / frames * 1000.0 : 0.0);
+        for (const Counter &counter : counters)
+        {
+            if (counter.gauge)
+            {
+                printf(" | %s %.2f", counter.name.c_str(), counter.sum * counter.scale);
+            }
+            else
+            {
+                printf(" | %s %.2f/s", counter.name.c_str(), counter.sum * counter.scale / elapsed);
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    for (Counter &counter : counters)
+    {
+        if (!counter.gauge)
+        {
+            counter.sum = 0.0;
+        }
+    }
+    windowStart = now;
+    frameTimeSum = 0.0;
+    frames = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+
+// named counters summed over a reporting interval and printed as per second rates,
+// alongside the average frame time. gauges print the last value they were set to
+class Profiler
+{
+    struct Counter
+    {
+        std::string name;
+        double scale;
+        double sum;
+        bool gauge;
+    };
+
+    std::vector<Counter> counters;
+    double windowStart = -1.0;
+    double frameTimeSum = 0.0;
+    int frames = 0;
+
+public:
+    bool enabled = false;
+    double interval = 1.0;
+
+    // scale converts the added values to the printed unit, e.g. 1e-6 for bytes to MB
+    int addCounter(const std::string &name, double scale = 1.0);
+    void add(int counter, double value);
+    // for levels rather than events, like a high water mark
+    int addGauge(const std::string &name, double scale = 1.0);
+    void set(int gauge, double value);
+
+    // call once per frame, prints when the interval is up
+    void frame(double now, double frameTime);
+};
+
+#endif // PROFILER_H
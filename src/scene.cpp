@@ -0,0 +1,381 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+const char sceneMagic[4] = {'E', 'F', 'S', 'C'};
+const uint32_t sceneVersion = 1;
+
+struct SceneHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    uint64_t reserved[2];
+};
+
+// a read only view of a whole file, unmapped when it goes out of scope
+struct MappedFile
+{
+    const char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Scene Error: could not open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Scene Error: could not stat " + path);
+        }
+        size = st.st_size;
+        if (size > 0)
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Scene Error: could not map " + path);
+            }
+            data = (const char *)mapped;
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+        {
+            munmap((void *)data, size);
+        }
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+bool isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+const char *skipSeparators(const char *p, const char *end)
+{
+    while (p < end && isSeparator(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+const char *nextLine(const char *p, const char *end)
+{
+    const char *newline = (const char *)memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+
+// true if the line starting at p holds a charge rather than nothing or a comment
+bool isDataLine(const char *p, const char *end)
+{
+    p = skipSeparators(p, end);
+    return p < end && *p != '\n' && *p != '#';
+}
+
+// decimal float with optional sign, fraction and exponent. works on a range that isn't
+// nul terminated and doesn't depend on the locale, unlike strtof
+bool parseFloat(const char *&p, const char *end, float &out)
+{
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const uint64_t maxMantissa = 100000000000000000ULL;
+
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = *s == '-';
+        s++;
+    }
+
+    // digits past what the mantissa holds only move the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; s < end && isDigit(*s); s++, digits++)
+    {
+        if (mantissa < maxMantissa)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.')
+    {
+        for (s++; s < end && isDigit(*s); s++, digits++)
+        {
+            if (mantissa < maxMantissa)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0)
+    {
+        return false;
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        s++;
+        bool negativeExp = false;
+        if (s < end && (*s == '-' || *s == '+'))
+        {
+            negativeExp = *s == '-';
+            s++;
+        }
+        int e = 0;
+        int expDigits = 0;
+        for (; s < end && isDigit(*s); s++, expDigits++)
+        {
+            if (e < 10000)
+            {
+                e = e * 10 + (*s - '0');
+            }
+        }
+        if (expDigits == 0)
+        {
+            return false;
+        }
+        exponent += negativeExp ? -e : e;
+    }
+
+    // exact powers of ten keep the result correctly rounded in the common cases
+    double value = (double)mantissa;
+    int absExp = std::abs(exponent);
+    double scale = absExp <= 22 ? powers[absExp] : pow(10.0, absExp);
+    value = exponent < 0 ? value / scale : value * scale;
+
+    out = (float)(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+// parses one "x y z q" line at p into slot i, returns false if it's malformed
+bool parseLine(const char *p, const char *end, ChargeSet &charges, size_t i)
+{
+    float values[4];
+    for (int v = 0; v < 4; v++)
+    {
+        p = skipSeparators(p, end);
+        if (!parseFloat(p, end, values[v]))
+        {
+            return false;
+        }
+        if (p < end && !isSeparator(*p) && *p != '\n' && *p != '#')
+        {
+            return false;
+        }
+    }
+    p = skipSeparators(p, end);
+    if (p < end && *p != '\n' && *p != '#')
+    {
+        return false;
+    }
+
+    charges.x[i] = values[0];
+    charges.y[i] = values[1];
+    charges.z[i] = values[2];
+    charges.q[i] = values[3];
+    return true;
+}
+
+void loadBinary(const MappedFile &file, const std::string &path, ChargeSet &charges, ThreadPool &pool)
+{
+    SceneHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    uint64_t payload = file.size - sizeof(header);
+    if (header.version != sceneVersion || header.count > payload / (4 * sizeof(float)) ||
+        header.count * 4 * sizeof(float) != payload)
+    {
+        throw std::runtime_error("Scene Error: " + path + " has a bad header");
+    }
+
+    size_t count = header.count;
+    const float *arrays = (const float *)(file.data + sizeof(header));
+    madvise((void *)file.data, file.size, MADV_SEQUENTIAL);
+
+    charges.x.resize(count);
+    charges.y.resize(count);
+    charges.z.resize(count);
+    charges.q.resize(count);
+
+    // the file already is the SoA, so each chunk is four straight copies
+    pool.parallelFor(0, count, 1 << 16, [&](size_t first, size_t last) {
+        size_t bytes = (last - first) * sizeof(float);
+        memcpy(&charges.x[first], arrays + 0 * count + first, bytes);
+        memcpy(&charges.y[first], arrays + 1 * count + first, bytes);
+        memcpy(&charges.z[first], arrays + 2 * count + first, bytes);
+        memcpy(&charges.q[first], arrays + 3 * count + first, bytes);
+    });
+}
+
+void loadText(const MappedFile &file, const std::string &path, ChargeSet &charges, ThreadPool &pool)
+{
+    const char *data = file.data;
+    const char *end = file.data + file.size;
+
+    // split at line starts into a few chunks per thread
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(pool.size() * 4, file.size / (64 * 1024)));
+    std::vector<size_t> bounds(chunkCount + 1);
+    bounds[0] = 0;
+    bounds[chunkCount] = file.size;
+    for (size_t c = 1; c < chunkCount; c++)
+    {
+        size_t pos = std::max(bounds[c - 1], c * file.size / chunkCount);
+        if (pos > 0 && data[pos - 1] != '\n')
+        {
+            pos = nextLine(data + pos, end) - data;
+        }
+        bounds[c] = pos;
+    }
+
+    // count the charges in each chunk so every chunk knows where its output starts
+    std::vector<size_t> counts(chunkCount);
+    pool.parallelFor(0, chunkCount, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            size_t n = 0;
+            const char *chunkEnd = data + bounds[c + 1];
+            for (const char *p = data + bounds[c]; p < chunkEnd; p = nextLine(p, chunkEnd))
+            {
+                n += isDataLine(p, chunkEnd);
+            }
+            counts[c] = n;
+        }
+    });
+
+    std::vector<size_t> offsets;
+    size_t total = parallelExclusiveScan(pool, counts, offsets);
+    charges.x.resize(total);
+    charges.y.resize(total);
+    charges.z.resize(total);
+    charges.q.resize(total);
+
+    // parse straight into place, remembering the earliest bad line
+    std::atomic<size_t> errorAt(file.size);
+    pool.parallelFor(0, chunkCount, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            size_t i = offsets[c];
+            const char *chunkEnd = data + bounds[c + 1];
+            for (const char *p = data + bounds[c]; p < chunkEnd; p = nextLine(p, chunkEnd))
+            {
+                if (!isDataLine(p, chunkEnd))
+                {
+                    continue;
+                }
+                if (!parseLine(p, chunkEnd, charges, i++))
+                {
+                    size_t at = p - data;
+                    size_t seen = errorAt.load();
+                    while (at < seen && !errorAt.compare_exchange_weak(seen, at))
+                    {
+                    }
+                    break;
+                }
+            }
+        }
+    });
+
+    if (errorAt.load() < file.size)
+    {
+        size_t line = 1 + std::count(data, data + errorAt.load(), '\n');
+        charges.clear();
+        throw std::runtime_error("Scene Error: " + path + " line " + std::to_string(line) + " is not \"x y z q\"");
+    }
+}
+
+} // namespace
+
+void loadScene(const std::string &path, ChargeSet &charges, ThreadPool &pool)
+{
+    MappedFile file(path);
+    charges.clear();
+    if (file.size >= sizeof(SceneHeader) && memcmp(file.data, sceneMagic, sizeof(sceneMagic)) == 0)
+    {
+        loadBinary(file, path, charges, pool);
+    }
+    else if (file.size > 0)
+    {
+        loadText(file, path, charges, pool);
+    }
+}
+
+void saveScene(const std::string &path, const ChargeSet &charges)
+{
+    bool text = path.size() >= 4 && path.compare(path.size() - 4, 4, ".txt") == 0;
+    FILE *out = fopen(path.c_str(), text ? "w" : "wb");
+    if (!out)
+    {
+        throw std::runtime_error("Scene Error: could not open " + path + " for writing");
+    }
+
+    size_t count = charges.size();
+    if (text)
+    {
+        fprintf(out, "# x y z q\n");
+        for (size_t i = 0; i < count; i++)
+        {
+            fprintf(out, "%.9g %.9g %.9g %.9g\n", charges.x[i], charges.y[i], charges.z[i], charges.q[i]);
+        }
+    }
+    else
+    {
+        SceneHeader header = {};
+        memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+        header.version = sceneVersion;
+        header.count = count;
+        fwrite(&header, sizeof(header), 1, out);
+        if (count > 0)
+        {
+            fwrite(&charges.x[0], sizeof(float), count, out);
+            fwrite(&charges.y[0], sizeof(float), count, out);
+            fwrite(&charges.z[0], sizeof(float), count, out);
+            fwrite(&charges.q[0], sizeof(float), count, out);
+        }
+    }
+
+    bool failed = ferror(out) != 0;
+    if (fclose(out) != 0 || failed)
+    {
+        throw std::runtime_error("Scene Error: could not write " + path);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+
+#include "charges.h"
+#include "threadPool.h"
+
+// scene files hold a charge set in one of two formats.
+//
+// binary: a 32 byte header (magic "EFSC", uint32 version, uint64 count, 16 reserved
+// bytes) followed by the x, y, z and q arrays back to back as little endian floats, the
+// same layout as ChargeSet so loading is a straight copy out of the mapped file.
+//
+// text: one charge per line as "x y z q", separated by spaces, tabs or commas. blank
+// lines and lines starting with # are skipped.
+
+// loads the scene into charges, replacing what was there. the format is picked from the
+// file's first bytes. throws std::runtime_error if the file can't be read or parsed
+void loadScene(const std::string &path, ChargeSet &charges, ThreadPool &pool);
+
+// writes text if the path ends in .txt, binary otherwise
+void saveScene(const std::string &path, const ChargeSet &charges);
+
+#endif // SCENE_H
@@ -0,0 +1,81 @@
+#include "shader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+
+static GLuint compileShader(const char *filepath, GLenum type)
+{
+    FILE *file = fopen(filepath, "rb");
+    if (!file)
+    {
+        std::cout << "Shader Error: could not open " << filepath << std::endl;
+        return 0;
+    }
+
+    long len;
+    if (fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) == -1L)
+    {
+        fclose(file);
+        return 0;
+    }
+    rewind(file);
+
+    char *buffer = (char *)malloc(len);
+    if (fread(buffer, 1, len, file) != (size_t)len)
+    {
+        fclose(file);
+        free(buffer);
+        return 0;
+    }
+    fclose(file);
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, (const char *const *)&buffer, (GLint *)&len);
+    free(buffer);
+    glCompileShader(shader);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "Shader Error " << filepath << ": " << infoLog << std::endl;
+    }
+    return shader;
+}
+
+GLuint loadShaderProgram(const char *vertexPath, const char *fragmentPath)
+{
+    GLuint vertexShader = compileShader(vertexPath, GL_VERTEX_SHADER);
+    GLuint fragmentShader = compileShader(fragmentPath, GL_FRAGMENT_SHADER);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindFragDataLocation(program, 0, "outColor");
+    glBindFragDataLocation(program, 1, "outReveal");
+    glBindAttribLocation(program, ATTRIB_POSITION, "position");
+    glBindAttribLocation(program, ATTRIB_NORMAL, "normal");
+    glBindAttribLocation(program, ATTRIB_TEXCOORDS, "texCoords");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_MODEL, "instanceModel");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_COLOR, "instanceColor");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_POSITION, "instancePosition");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_DIRECTION, "instanceDirection");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_ALPHA, "instanceAlpha");
+    glLinkProgram(program);
+
+    GLint success;
+    GLchar infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "Shader Error link: " << infoLog << std::endl;
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
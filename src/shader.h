@@ -0,0 +1,25 @@
+#ifndef SHADER_H
+#define SHADER_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+// fixed attribute locations so every program can share a mesh's VAO
+enum AttribLocation
+{
+    ATTRIB_POSITION = 0,
+    ATTRIB_NORMAL = 1,
+    ATTRIB_TEXCOORDS = 2,
+    ATTRIB_INSTANCE_MODEL = 3, // a mat4 takes locations 3 to 6
+    ATTRIB_INSTANCE_COLOR = 7,
+
+    // packed instances (Model::PackedInstance) use the matrix's locations in their own VAO
+    ATTRIB_INSTANCE_POSITION = 3,
+    ATTRIB_INSTANCE_DIRECTION = 4,
+    ATTRIB_INSTANCE_ALPHA = 5
+};
+
+// loads, compiles and links a vertex/fragment pair, printing any errors
+GLuint loadShaderProgram(const char *vertexPath, const char *fragmentPath);
+
+#endif // SHADER_H
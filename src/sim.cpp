@@ -9,36 +9,270 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <string.h>
+#include <chrono>
+#include <memory>
 
 #include "Camera.h"
 #include "model.h"
+#include "chargeClusters.h"
+#include "field.h"
+#include "volume.h"
+#include "culling.h"
+#include "threadPool.h"
+#include "oit.h"
+#include "charges.h"
+#include "solver.h"
+#include "frameScheduler.h"
+#include "streamBuffer.h"
+#include "profiler.h"
+#include "scene.h"
+#include "inputLog.h"
+#include "headless.h"
+#include "frameCapture.h"
+#include "frameArena.h"
+#include "heapStats.h"
+#include "ewald.h"
+#include "multigrid.h"
+#include "primitives.h"
+#include "conductor.h"
+#include "currents.h"
+#include "chargeBvh.h"
 
 using namespace std;
 
 
 static GLuint load_shader(char *filepath, GLenum type);
 static float lerp(float a, float b, float f);
-static float mapNum(float s, float a1, float a2, float b1, float b2);
+static double wallClock();
+static int printEwaldReport(const char *loadPath, const glm::vec3 &cell, const EwaldParams &params);
 
-int main()
+int main(int argc, char *argv[])
 {
-  //init settings
-  glfwInit();
-  
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); 
-  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  // camera and simulation updates run at a fixed 120Hz, rendering interpolates between them
+  FrameScheduler scheduler = FrameScheduler(1.0 / 120.0);
+  Profiler profiler;
+  const char *loadPath = nullptr;
+  const char *savePath = nullptr;
+  InputLog input;
+  int headlessFrames = 0;
+  const char *capturePattern = "frame%05d.ppm";
+  bool checkAllocs = false;
+  bool periodic = false;
+  bool ewaldReport = false;
+  EwaldParams ewaldParams;
+  const char *densityPath = nullptr;
+  const char *primitivesPath = nullptr;
+  const char *currentsPath = nullptr;
+  float densityScale = 1.0f;
+
+  // conductor meshes and the potential each is held at, optionally moved and scaled
+  struct ConductorArg
+  {
+    const char *path;
+    float potential;
+    glm::vec3 offset;
+    float scale;
+  };
+  std::vector<ConductorArg> conductorArgs;
 
-  GLFWwindow* window = glfwCreateWindow(1920, 1080, "Electric Field Simulator", nullptr, nullptr); // Windowed
+  // the arrow lattice's size. the periodic cell is one spacing wider so the lattice tiles
+  int edgeSize = 10;
+  int edgeSpace = 20;
+  glm::vec3 periodicCell = glm::vec3((float)(edgeSize * edgeSpace));
+
+  //command line settings
+  for(int i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--no-vsync") == 0)
+    {
+      scheduler.vsync = false;
+    }
+    else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+    {
+      scheduler.targetFrameTime = 1.0 / atof(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--profile") == 0)
+    {
+      profiler.enabled = true;
+    }
+    else if(strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+    {
+      loadPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+    {
+      savePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+    {
+      headlessFrames = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+    {
+      capturePattern = argv[++i];
+    }
+    else if(strcmp(argv[i], "--check-allocs") == 0)
+    {
+      checkAllocs = true;
+    }
+    else if(strcmp(argv[i], "--periodic") == 0)
+    {
+      periodic = true;
+    }
+    else if(strcmp(argv[i], "--pme-mesh") == 0 && i + 1 < argc)
+    {
+      ewaldParams.meshSize = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--pme-order") == 0 && i + 1 < argc)
+    {
+      ewaldParams.order = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--pme-cutoff") == 0 && i + 1 < argc)
+    {
+      ewaldParams.cutoff = atof(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--pme-splitting") == 0 && i + 1 < argc)
+    {
+      ewaldParams.splitting = atof(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--pme-report") == 0)
+    {
+      ewaldReport = true;
+    }
+    else if(strcmp(argv[i], "--density") == 0 && i + 1 < argc)
+    {
+      densityPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--density-scale") == 0 && i + 1 < argc)
+    {
+      densityScale = atof(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--primitives") == 0 && i + 1 < argc)
+    {
+      primitivesPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--currents") == 0 && i + 1 < argc)
+    {
+      currentsPath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--conductor") == 0 && i + 2 < argc)
+    {
+      ConductorArg conductor = {argv[i + 1], (float)atof(argv[i + 2]), glm::vec3(0.0f), 1.0f};
+      conductorArgs.push_back(conductor);
+      i += 2;
+    }
+    else if(strcmp(argv[i], "--conductor-transform") == 0 && i + 4 < argc && !conductorArgs.empty())
+    {
+      // applies to the conductor before it
+      conductorArgs.back().offset = glm::vec3(atof(argv[i + 1]), atof(argv[i + 2]), atof(argv[i + 3]));
+      conductorArgs.back().scale = atof(argv[i + 4]);
+      i += 4;
+    }
+    else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+    {
+      try
+      {
+        input.record(argv[++i]);
+      }
+      catch(const std::exception &e)
+      {
+        cerr << e.what() << endl;
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+    {
+      try
+      {
+        input.replay(argv[++i]);
+      }
+      catch(const std::exception &e)
+      {
+        cerr << e.what() << endl;
+        return 1;
+      }
+    }
+  }
+
+  if(periodic && densityPath)
+  {
+    cerr << "--periodic and --density can't be combined" << endl;
+    return 1;
+  }
+  if(!conductorArgs.empty() && (periodic || densityPath))
+  {
+    cerr << "--conductor can't be combined with --periodic or --density" << endl;
+    return 1;
+  }
+  if(currentsPath && periodic)
+  {
+    cerr << "--currents can't be combined with --periodic" << endl;
+    return 1;
+  }
+  if(!FrameCapture::validPattern(capturePattern))
+  {
+    cerr << "--capture needs exactly one %d for the frame number, any other % written as %%" << endl;
+    return 1;
+  }
 
-  glfwMakeContextCurrent(window);
+  // measures PME settings on the scene instead of running the simulator
+  if(ewaldReport)
+  {
+    return printEwaldReport(loadPath, periodicCell, ewaldParams);
+  }
+
+  // replays run flat out so the report measures the frames, not the display
+  if(input.mode == InputLog::REPLAY)
+  {
+    scheduler.vsync = false;
+    scheduler.targetFrameTime = 0.0;
+  }
+
+  //init settings, headless runs get an EGL context and no window
+  GLFWwindow* window = nullptr;
+  std::unique_ptr<HeadlessContext> headlessContext;
+  if(headlessFrames > 0)
+  {
+    try
+    {
+      headlessContext.reset(new HeadlessContext());
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+  else
+  {
+    glfwInit();
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); 
+    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+    window = glfwCreateWindow(1920, 1080, "Electric Field Simulator", nullptr, nullptr); // Windowed
+
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(scheduler.vsync ? 1 : 0);
+  }
   
-  //init OpenGL and link functions in a dynamic way
+  //init OpenGL and link functions in a dynamic way. with no GLX display glewInit returns
+  //an error, but only after the GL entry points are loaded, which is all we use
   glewExperimental = GL_TRUE;
   glewInit();
 
+  // headless frames are drawn offscreen and read back to an image sequence
+  std::unique_ptr<FrameCapture> capture;
+  if(!window)
+  {
+    capture.reset(new FrameCapture(1920, 1080, capturePattern));
+    glViewport(0, 0, 1920, 1080);
+  }
+
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -49,212 +283,617 @@ int main()
     cerr << "OpenGL error: " << err << endl;
   }
 
-  //camera initial settings
+  //camera initial settings, the projection's aspect ratio follows the framebuffer
   Camera cam;
-  cam = Camera();
-  cam.view = glm::lookAt(
+  int framebufferWidth = 1920;
+  int framebufferHeight = 1080;
+  int windowWidth = framebufferWidth;
+  int windowHeight = framebufferHeight;
+  if(window)
+  {
+    // cursor positions are in window coordinates, which HiDPI screens scale down from pixels
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+  }
+  cam.setViewport(framebufferWidth, framebufferHeight, windowWidth, windowHeight);
+  cam.lookAt(
     glm::vec3(150.0f, 150.0f, 150.0f), // position
     glm::vec3(50.0f, 50.0f, 50.0f), // camera center
     glm::vec3(0.0f, 0.0f, 1.0f) // up axis
     );
+  cam.update();
 
   //init models for the point charges and field arrows, and the corresponding arrays that keep track of their data
   Model charge = Model(false);
   charge.loadFromObj("assets/sphere.obj", 0);
-  std::vector<glm::vec3> positiveCharges;
-  std::vector<glm::vec3> negativeCharges;
+  ChargeSet charges;
 
   Model arrow = Model(true);
   arrow.loadFromObj("assets/arrow.obj", 0);
+
+  // magnetic arrows are the same mesh with a green glow of their own
+  Model magneticArrow = Model(true);
+  magneticArrow.loadFromObj("assets/arrow.obj", 0);
+
+  // charges only light arrow fragments within this distance, binned per view cluster
+  ChargeClusters clusters = ChargeClusters(100.0f, 1);
+
+  // per frame instance lists for the charges and arrows, and the ring they're streamed through
+  std::vector<Model::Instance> chargeInstances;
+  std::vector<Model::PackedInstance> arrowInstances;
+  std::vector<Model::PackedInstance> magneticInstances;
+  StreamBuffer instanceStream(GL_ARRAY_BUFFER, 1 << 20);
+  int uploadCounter = profiler.addCounter("instance upload MB", 1e-6);
+  int heapAllocCounter = profiler.addCounter("render heap allocs");
+  int heapBytesCounter = profiler.addCounter("render heap MB", 1e-6);
+
+  // the arrow lattice
+  Lattice lattice = {edgeSize, (float)edgeSpace};
+
+  // scratch for the current frame only, reset at the bottom of the loop
+  FrameArena frameArena;
+
+  ThreadPool pool;
+  ArrowCuller culler = ArrowCuller(pool, frameArena);
+  ArrowCuller magneticCuller = ArrowCuller(pool, frameArena);
+
+  // arrows are blended order independently, no sorting
+  GLint targetSize[4];
+  glGetIntegerv(GL_VIEWPORT, targetSize);
+  WeightedOit oit = WeightedOit(targetSize[2], targetSize[3]);
+  arrow.setIntUniform("weightedOit", 1);
+  arrow.setVec3Uniform("instanceTint", glm::vec3(1.0f));
+  magneticArrow.setIntUniform("weightedOit", 1);
+  magneticArrow.setVec3Uniform("instanceTint", glm::vec3(0.3f, 0.6f, 0.3f));
+  magneticArrow.setVec3Uniform("emissive", glm::vec3(0.1f, 0.5f, 0.2f));
+  if(capture)
+  {
+    oit.outputFBO = capture->framebuffer;
+  }
+
+  // volume rendering of the field magnitude over the same region as the lattice
+  FieldGrid volumeGrid = FieldGrid(glm::ivec3(64), glm::vec3(0.0f), (edgeSize - 1) * edgeSpace / 63.0f);
+  VolumeRenderer volume = VolumeRenderer(volumeGrid);
+  bool volumeMode = false;
+  unsigned long volumeVersion = 0;
+  int volumeKeyDown = 0;
+  int directionKeyDown = 0;
+
+  // the field is solved on its own thread, the loop below draws whatever finished last
+  FieldSolver solver(volumeGrid);
+  if(periodic)
+  {
+    try
+    {
+      solver.setPeriodic(periodicCell, ewaldParams);
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+
+  // a density volume's field is solved once and added to every solve after
+  bool hasBackground = false;
+  if(densityPath)
+  {
+    DensityGrid density;
+    try
+    {
+      loadCubeDensity(densityPath, densityScale, density);
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+
+    PoissonMultigrid multigrid(density.dims, density.spacing);
+    MultigridStats stats = multigrid.solve(density, 1e-5, 50, pool);
+    printf("multigrid: %dx%dx%d density, %d V-cycles, residual %.2e -> %.2e, %.3f per cycle, %.1f ms per cycle\n",
+           density.dims.x, density.dims.y, density.dims.z, stats.cycles, stats.residuals.front(),
+           stats.residuals.back(), stats.convergenceRate(), stats.secondsPerCycle * 1e3);
+
+    std::shared_ptr<FieldGrid> background = std::make_shared<FieldGrid>(density.dims, density.origin, density.spacing);
+    multigrid.field(*background, pool);
+    solver.setBackground(background);
+    hasBackground = true;
+  }
+
+  // conductors are drawn as their meshes and solved on the solver thread, their panels
+  // against the charges of every request
+  std::vector<Model> conductorModels;
+  bool hasConductors = !conductorArgs.empty();
+  if(hasConductors)
+  {
+    std::shared_ptr<ConductorSet> conductors = std::make_shared<ConductorSet>();
+    try
+    {
+      for(const ConductorArg &arg : conductorArgs)
+      {
+        conductors->load(arg.path, arg.potential, arg.offset, arg.scale);
+        conductorModels.push_back(Model(false));
+        conductorModels.back().loadFromObj(arg.path, 0);
+        conductorModels.back().model = glm::scale(glm::translate(glm::mat4(1), arg.offset), glm::vec3(arg.scale));
+      }
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+    printf("conductors: %zu panels on %zu conductors\n", conductors->size(), conductors->conductorCount());
+    solver.setConductors(conductors);
+  }
+
+  // wires only show through their magnetic arrows
+  bool hasCurrents = false;
+  if(currentsPath)
+  {
+    std::shared_ptr<CurrentSet> currents = std::make_shared<CurrentSet>();
+    try
+    {
+      loadCurrents(currentsPath, *currents);
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+    solver.setCurrents(currents);
+    hasCurrents = !currents->empty();
+  }
+
+  // work is only redone when its inputs change: the field when the charges or mode do,
+  // the instance lists when the charges, field or view do
+  bool fieldDirty = hasBackground || hasConductors || hasCurrents;
+  bool chargesChanged = true;
+  unsigned long drawnVersion = 0;
+  int recomputedCounter = profiler.addCounter("field recomputed frames");
+  int reusedCounter = profiler.addCounter("field reused frames");
+  int solveCounter = profiler.addCounter("field solves");
+  int brickUploadCounter = profiler.addCounter("volume bricks uploaded");
+  int allocCounter = profiler.addCounter("heap allocs all threads");
+  int captureCounter = profiler.addCounter("frames written");
+  int arrowsGauge = profiler.addGauge("arrows drawn");
+  int culledGauge = profiler.addGauge("arrow bricks culled");
+  int arenaGauge = profiler.addGauge("frame arena high water KB", 1.0 / 1024.0);
+  // only set when there are conductors to solve for
+  int gmresGauge = hasConductors ? profiler.addGauge("conductor GMRES iterations") : -1;
+  int conductorMsGauge = hasConductors ? profiler.addGauge("conductor solve ms") : -1;
+  std::vector<int> lodGauges;
+  for(size_t l = 0; l < charge.lodDrawn.size(); l++)
+  {
+    lodGauges.push_back(profiler.addGauge("charges at lod " + std::to_string(l)));
+  }
+  unsigned long solvesSeen = 0;
+  unsigned long allocsSeen = heapStatsTotal().allocations;
+  int framesSeen = 0;
+
+  // start from a saved scene instead of an empty one
+  if(loadPath)
+  {
+    try
+    {
+      loadScene(loadPath, charges, pool);
+      fieldDirty = fieldDirty || !charges.empty();
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+    }
+  }
+
+  // electrodes and other extended charges, solved as their cached quadrature nodes
+  PrimitiveSet primitives;
+  ChargeSet fieldSources;
+  if(primitivesPath)
+  {
+    try
+    {
+      loadPrimitives(primitivesPath, primitives);
+      fieldDirty = fieldDirty || !primitives.empty();
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+    }
+  }
   
-  float lastTime;
+  // clicking picks the charge under the cursor. the hierarchy is built up front so the
+  // first click doesn't wait on it, charges placed later are picked without a rebuild
+  ChargeBvh chargeBvh;
+  chargeBvh.build(charges);
+  bool hasSelection = false;
+  size_t selected = 0;
+  float dragDist = 0.0f;
+  int pickButtonDown = 0;
+
   int posChargeKeyDown = 0;
   int negChargeKeyDown = 0;
   
   // setup camera movement vars
   double xpos, ypos;
   glm::vec3 cursorPos;
+
+  // the cursor ray, only recomputed when the cursor or camera moved
+  glm::vec3 v0, dir;
+  double rayX = -1.0, rayY = -1.0;
+  unsigned long rayCameraVersion = 0;
   
-  glm::vec3 position = glm::vec3( 0, 0, 0);
   float speed = 3.0f; // 3 units / second
   float pitch = 0.0f;
   float yaw = 0.0f;
+  float prevPitch = pitch;
+  float prevYaw = yaw;
   float cursorDist = 150.0f;
   
   //main loop
-  while(!glfwWindowShouldClose(window))
+  // headless frames are a fixed 60th of a second apart unless a replay says otherwise
+  const double headlessStep = 1.0 / 60.0;
+  int frameCount = 0;
+  double runStart = wallClock();
+  while(window ? !glfwWindowShouldClose(window) : frameCount < headlessFrames)
   {
-    glfwSwapBuffers(window);
-    glfwPollEvents();
-
-    double currentTime = glfwGetTime();
-    float deltaTime = currentTime - lastTime;
+    double now = window ? glfwGetTime() : wallClock();
+    HeapStats heapBefore = heapStatsThisThread();
+    if(window)
+    {
+      glfwPollEvents();
+    }
 
-    glfwGetCursorPos(window,&xpos, &ypos);
+    // the window's input, or the next recorded frame. replays step the scheduler with the
+    // recorded timestamps so every frame runs the same fixed steps it did when recorded
+    if(!input.poll(window, now))
+    {
+      break;
+    }
+    bool fixedClock = !window && input.mode != InputLog::REPLAY;
+    int steps = scheduler.beginFrame(fixedClock ? frameCount * headlessStep : input.time());
 
-    GLint viewportraw[4];
-    glGetIntegerv(GL_VIEWPORT, viewportraw);
-    glm::vec4 viewport = glm::vec4(viewportraw[0], viewportraw[1], viewportraw[2], viewportraw[3]);
- 
-    // NORMALISED DEVICE SPACE
-    //xpos = xpos / 1920;
-    ypos = 1080 - ypos;
-    //ypos = ypos / 1080;
-
-    glm::vec3 v0 = glm::unProject(glm::vec3(xpos, ypos, 0.0f), cam.view, cam.proj, viewport);
-    glm::vec3 v1 = glm::unProject(glm::vec3(xpos, ypos, 1.0f), cam.view, cam.proj, viewport);
-    glm::vec3 dir = glm::normalize((v1 - v0));
- 
-    cursorPos = position + (dir * cursorDist);
+    input.cursor(xpos, ypos);
     
     /////////////////////////////////////////////////////////////////////////
     //recalculate camera position and direction based on mouse input and keys
     /////////////////////////////////////////////////////////////////////////
     
-    if (glfwGetKey(window,GLFW_KEY_W ) == GLFW_PRESS)
+    float pitchInput = 0.0f;
+    float yawInput = 0.0f;
+    if (input.key(GLFW_KEY_W) == GLFW_PRESS)
     {
-      pitch += speed * deltaTime;
+      pitchInput += 1.0f;
     }
-    if (glfwGetKey(window,GLFW_KEY_S ) == GLFW_PRESS)
+    if (input.key(GLFW_KEY_S) == GLFW_PRESS)
     {
-      pitch -= speed * deltaTime;
+      pitchInput -= 1.0f;
     }
-    if (glfwGetKey(window,GLFW_KEY_D ) == GLFW_PRESS)
+    if (input.key(GLFW_KEY_D) == GLFW_PRESS)
     {
-      yaw -= speed * deltaTime;
+      yawInput -= 1.0f;
     }
-    if (glfwGetKey(window,GLFW_KEY_A ) == GLFW_PRESS)
+    if (input.key(GLFW_KEY_A) == GLFW_PRESS)
     {
-      yaw += speed * deltaTime;
+      yawInput += 1.0f;
     }
-    
-    position.x = 50 + (cos(yaw)  * sin(pitch) * 200);
-    position.y = 50 + (sin(yaw) * sin(pitch) * 200);
-    position.z = 50 + (cos(pitch) * 200);
-
-    cam.view = glm::lookAt(
-        position,             // position
-        glm::vec3(50.0f, 50.0f, 50.0f), // camera center
-        glm::vec3(0.0f, 0.0f, 1.0f)                    // up axis
-    );
+
+    // advance the orbit in fixed steps so camera speed doesn't depend on frame rate
+    for(int i = 0; i < steps; i++)
+    {
+      prevPitch = pitch;
+      prevYaw = yaw;
+      pitch += speed * scheduler.fixedStep * pitchInput;
+      yaw += speed * scheduler.fixedStep * yawInput;
+    }
+
+    // and draw in between the last two steps
+    float alpha = scheduler.alpha();
+    float drawPitch = prevPitch + (pitch - prevPitch) * alpha;
+    float drawYaw = prevYaw + (yaw - prevYaw) * alpha;
+
+    // nothing is rebuilt unless the orbit actually moved
+    cam.orbit(glm::vec3(50.0f, 50.0f, 50.0f), 200.0f, drawYaw, drawPitch);
+    bool viewChanged = cam.update();
+    const glm::vec4 &viewport = cam.viewport();
+
+    if(xpos != rayX || ypos != rayY || rayCameraVersion != cam.version())
+    {
+      cam.cursorRay(xpos, ypos, v0, dir);
+      rayX = xpos;
+      rayY = ypos;
+      rayCameraVersion = cam.version();
+    }
+    cursorPos = cam.position() + (dir * cursorDist);
 	
     //add charges to the scene based on key presses
-    if(glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+    if(input.key(GLFW_KEY_F) == GLFW_PRESS)
     {
       posChargeKeyDown = 1;
     }
-    if(glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+    if(input.key(GLFW_KEY_G) == GLFW_PRESS)
     {
       negChargeKeyDown = 1;
     }
     
-    if(glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE && posChargeKeyDown == 1 && positiveCharges.size() < 10)
+    if(input.key(GLFW_KEY_F) == GLFW_RELEASE && posChargeKeyDown == 1)
     {
-      positiveCharges.push_back(cursorPos);
-      arrow.setIntUniform("activeReds", positiveCharges.size());
-      arrow.setVec3Uniform("redPositions", glm::value_ptr(positiveCharges[0]));
+      charges.add(cursorPos, 1.0f);
+      clusters.markDirty();
+      fieldDirty = true;
+      chargesChanged = true;
       posChargeKeyDown = 0;
     }
-    if(glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE && negChargeKeyDown == 1 && negativeCharges.size() < 10)
+    if(input.key(GLFW_KEY_G) == GLFW_RELEASE && negChargeKeyDown == 1)
     {
-      negativeCharges.push_back(cursorPos);
-      arrow.setIntUniform("activeBlues", negativeCharges.size());
-      arrow.setVec3Uniform("bluePositions", glm::value_ptr(negativeCharges[0]));
+      charges.add(cursorPos, -1.0f);
+      clusters.markDirty();
+      fieldDirty = true;
+      chargesChanged = true;
       negChargeKeyDown = 0;
     }
 
+    // left click selects the closest charge along the cursor ray, or clears the selection.
+    // holding the button drags it along with the ray at the depth it was picked at, the
+    // solver only updates the arrows for the one charge that moved
+    bool dragMoved = false;
+    if(input.button(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && pickButtonDown == 0)
+    {
+      pickButtonDown = 1;
+      chargeBvh.sync(charges);
+      PickHit hit;
+      hasSelection = chargeBvh.pick(charges, v0, dir, hit);
+      selected = hit.index;
+      if(hasSelection)
+      {
+        dragDist = glm::dot(charges.position(selected) - v0, dir);
+      }
+      chargesChanged = true;
+    }
+    else if(input.button(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && hasSelection)
+    {
+      glm::vec3 target = v0 + dir * dragDist;
+      if(target != charges.position(selected))
+      {
+        charges.x[selected] = target.x;
+        charges.y[selected] = target.y;
+        charges.z[selected] = target.z;
+        chargeBvh.refit(charges, selected);
+        clusters.markDirty();
+        fieldDirty = true;
+        dragMoved = true;
+      }
+    }
+    if(input.button(GLFW_MOUSE_BUTTON_LEFT) == GLFW_RELEASE)
+    {
+      pickButtonDown = 0;
+    }
+
+    //V switches between arrows and volume rendering, C colors the volume by field direction
+    if(input.key(GLFW_KEY_V) == GLFW_PRESS)
+    {
+      volumeKeyDown = 1;
+    }
+    if(input.key(GLFW_KEY_V) == GLFW_RELEASE && volumeKeyDown == 1)
+    {
+      volumeMode = !volumeMode;
+      fieldDirty = true;
+      volumeKeyDown = 0;
+    }
+    if(input.key(GLFW_KEY_C) == GLFW_PRESS)
+    {
+      directionKeyDown = 1;
+    }
+    if(input.key(GLFW_KEY_C) == GLFW_RELEASE && directionKeyDown == 1)
+    {
+      volume.useDirection = !volume.useDirection;
+      directionKeyDown = 0;
+    }
+
+    // at most one solve request per frame, however many edits happened
+    if(fieldDirty)
+    {
+      if(primitives.empty())
+      {
+        solver.submit(charges, lattice, volumeMode);
+      }
+      else
+      {
+        fieldSources = charges;
+        fieldSources.append(primitives.quadrature());
+        solver.submit(fieldSources, lattice, volumeMode);
+      }
+      fieldDirty = false;
+    }
+
+    // offline frames show the field of their own charges, not whatever finished last
+    if(!window)
+    {
+      solver.waitForLatest();
+    }
+
+    // rebin the charges for lighting, this is a no-op unless the charges or view changed
+    clusters.update(charges, cam, viewport[2], viewport[3]);
+
     /////////////
     //draw code//
     /////////////
     
-    // Clear the screen to black
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Clear the screen to black, opaque geometry goes first
+    oit.beginOpaque();
 
+    //render point charges in the list, instanced and grouped by level of detail
+    if(chargesChanged)
+    {
+      chargeInstances.clear();
+      for(size_t i = 0; i < charges.size(); i++)
+      {
+        Model::Instance inst;
+        inst.model = glm::scale(glm::translate(glm::mat4(1), charges.position(i)), glm::vec3(2.0f, 2.0f, 2.0f));
+        inst.color = charges.q[i] > 0.0f ? glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        if(hasSelection && i == selected)
+        {
+          inst.color = glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+        }
+        chargeInstances.push_back(inst);
+      }
 
-    //render point charges in the list
-    for(glm::vec3 pos : positiveCharges)
+      // primitives show as their quadrature nodes, smaller than a point charge
+      const ChargeSet &nodes = primitives.quadrature();
+      for(size_t i = 0; i < nodes.size(); i++)
+      {
+        Model::Instance inst;
+        inst.model = glm::scale(glm::translate(glm::mat4(1), nodes.position(i)), glm::vec3(0.75f, 0.75f, 0.75f));
+        inst.color = nodes.q[i] > 0.0f ? glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        chargeInstances.push_back(inst);
+      }
+    }
+    else if(dragMoved)
     {
-      charge.model = glm::mat4(1);
-      charge.model = glm::translate(charge.model, pos);
-      charge.model = glm::scale(charge.model, glm::vec3(2.0f, 2.0f, 2.0f));
-      charge.render(cam, 1.0f, 0.0f, 0.0f, 1.0f);
+      // charges come first in the instances, in order
+      chargeInstances[selected].model = glm::scale(glm::translate(glm::mat4(1), charges.position(selected)),
+                                                   glm::vec3(2.0f, 2.0f, 2.0f));
     }
-    for(glm::vec3 pos : negativeCharges)
+    charge.renderInstanced(cam, chargeInstances, viewport[3], instanceStream,
+                           chargesChanged || dragMoved || viewChanged);
+    for(Model &conductor : conductorModels)
     {
-      charge.model = glm::mat4(1);
-      charge.model = glm::translate(charge.model, pos);
-      charge.model = glm::scale(charge.model, glm::vec3(2.0f, 2.0f, 2.0f));
-      charge.render(cam, 0.0f, 0.0f, 1.0f, 1.0f);
+      conductor.render(cam, 0.6f, 0.6f, 0.6f, 1.0f);
+    }
+    bool steadyFrame = !chargesChanged && !dragMoved;
+    chargesChanged = false;
+
+    // newest completed solve, this never waits on the solver thread
+    const FieldFrame &frame = solver.latest();
+    steadyFrame = steadyFrame && frame.version == drawnVersion;
+    profiler.add(frame.version != drawnVersion ? recomputedCounter : reusedCounter, 1);
+    if(hasConductors && frame.version != drawnVersion)
+    {
+      profiler.set(gmresGauge, frame.conductorStats.iterations);
+      profiler.set(conductorMsGauge, frame.conductorStats.seconds * 1e3);
+      // the charges only once the solve settles, not for every step of a drag
+      bool dragging = hasSelection && input.button(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+      if(!dragging)
+      {
+        printf("conductors: %d GMRES iterations, residual %.2e, %.1f ms, charge", frame.conductorStats.iterations,
+               frame.conductorStats.residual, frame.conductorStats.seconds * 1e3);
+        for(float q : frame.conductorCharges)
+        {
+          printf(" %.4g", q);
+        }
+        printf("\n");
+      }
     }
+    drawnVersion = frame.version;
 
-    int edgeSize = 10;
-    int edgeSpace = 20;
-    if(positiveCharges.size() > 0 || negativeCharges.size() > 0)
+    if(volumeMode)
     {
-      for(int x = 0; x < edgeSize; x++)
+      // only bricks whose values moved get re-uploaded
+      if(frame.hasGrid && frame.version != volumeVersion)
       {
-	  for(int y = 0; y < edgeSize; y++)
-	  {
-	      for(int z = 0; z < edgeSize; z++)
-	      {
-
-		float dist = 10000.0f;
-		int chargeSign = 0;
-		
-		glm::vec3 arrowPos = glm::vec3(x * edgeSpace, y * edgeSpace, z * edgeSpace);
-		glm::vec3 closestCharge = glm::vec3(0.0f, 0.0f, 0.0f);
-		glm::vec3 direction = glm::vec3(0.0f, 0.0f, 0.0f);
-		
-		for(glm::vec3 pos : positiveCharges)
-		{
-		  direction +=  glm::normalize(arrowPos - pos);
-		  float tempDist = sqrt(pow(arrowPos.x - pos.x, 2) + pow(arrowPos.y - pos.y, 2) + pow(arrowPos.z - pos.z, 2));
-		  if(tempDist < dist)
-		  {
-		    dist = tempDist;
-		    closestCharge = pos;
-		    chargeSign = 1;
-		  }
-		}
-		
-		for(glm::vec3 pos : negativeCharges)
-		{
-		  direction +=  glm::normalize(pos - arrowPos);
-		  float tempDist = sqrt(pow(arrowPos.x - pos.x, 2) + pow(arrowPos.y - pos.y, 2) + pow(arrowPos.z - pos.z, 2));
-		  if(tempDist < dist)
-		  {
-		    dist = tempDist;
-		    closestCharge = pos;
-		    chargeSign = -1;
-		  }
-		}
-		
-		glm::mat4 arrowTransform = glm::lookAt(arrowPos, arrowPos - direction, glm::vec3(0, 0, 1));
-		
-		arrow.model = glm::mat4(1);
-		  
-		arrow.model *= glm::mat4(1, 0, 0, 0,
-					 0, 1, 0, 0,
-					 0, 0, 1, 0,
-					 0, 0, -1, 1);
-		arrow.model *= glm::inverse(arrowTransform);
-		
-		float alpha = 0.0f;
-		if(dist <= 50.0f)
-		  alpha = mapNum(dist, 70.0f, 0.0f, 0.0f, 1.0f);
-		if(dist <= 30.0f)
-		  alpha = 1.0f;
-	  
-		arrow.render(cam, 1.0f, 1.0f, 1.0f, alpha);
-	      }
-	  }
+        volume.update(frame.grid);
+        profiler.add(brickUploadCounter, volume.bricksUploaded);
+        volumeVersion = frame.version;
       }
+      volume.render(cam);
+    }
+
+    bool drawArrows = !volumeMode && (!charges.empty() || !primitives.empty() || hasBackground || hasConductors) &&
+                      frame.version > 0;
+    bool drawMagnetic = !volumeMode && frame.hasMagnetic && frame.version > 0;
+    if(drawArrows || drawMagnetic)
+    {
+      oit.beginTransparent();
+    }
+    if(drawArrows)
+    {
+      clusters.bind(arrow);
+
+      // only submit the arrows that can be seen, and only recull when the field or view moved
+      bool arrowsChanged = culler.cull(frame.lattice, frame.arrows, frame.version, cam, arrowInstances);
+      arrow.renderPacked(cam, arrowInstances, culler.positionBias, culler.positionScale, viewport[3],
+                         instanceStream, arrowsChanged);
+    }
+    if(drawMagnetic)
+    {
+      clusters.bind(magneticArrow);
+      bool magneticChanged = magneticCuller.cull(frame.lattice, frame.magnetic, frame.version, cam, magneticInstances);
+      magneticArrow.renderPacked(cam, magneticInstances, magneticCuller.positionBias, magneticCuller.positionScale,
+                                 viewport[3], instanceStream, magneticChanged);
     }
-    lastTime = currentTime;
+    oit.composite(drawArrows || drawMagnetic);
+    instanceStream.endFrame();
+
+    profiler.add(uploadCounter, instanceStream.takeBytesUploaded());
+
+    // once warmed up, a frame where the charges and field didn't change shouldn't touch the heap
+    HeapStats heapAfter = heapStatsThisThread();
+    unsigned long frameAllocs = heapAfter.allocations - heapBefore.allocations;
+    profiler.add(heapAllocCounter, frameAllocs);
+    profiler.add(heapBytesCounter, heapAfter.bytes - heapBefore.bytes);
+    if(checkAllocs && steadyFrame && frameAllocs > 0 && frameCount > 120)
+    {
+      printf("frame %d: %lu heap allocations on the render thread in a steady frame\n", frameCount, frameAllocs);
+    }
+
+    // what the culling, lods and worker threads did, for the profiler line
+    profiler.set(arrowsGauge, (drawArrows ? culler.arrowsDrawn : 0) + (drawMagnetic ? magneticCuller.arrowsDrawn : 0));
+    profiler.set(culledGauge, (drawArrows ? culler.bricksCulled : 0) + (drawMagnetic ? magneticCuller.bricksCulled : 0));
+    for(size_t l = 0; l < lodGauges.size(); l++)
+    {
+      profiler.set(lodGauges[l], charge.lodDrawn[l]);
+    }
+    unsigned long solves = solver.solvesCompleted;
+    profiler.add(solveCounter, solves - solvesSeen);
+    solvesSeen = solves;
+    unsigned long allocs = heapStatsTotal().allocations;
+    profiler.add(allocCounter, allocs - allocsSeen);
+    allocsSeen = allocs;
+    if(capture)
+    {
+      int written = capture->framesWritten;
+      profiler.add(captureCounter, written - framesSeen);
+      framesSeen = written;
+    }
+    profiler.set(arenaGauge, frameArena.highWater);
+    frameArena.reset();
+    profiler.frame(now, scheduler.frameTime);
+
+    if(window)
+    {
+      glfwSwapBuffers(window);
+      scheduler.pace();
+    }
+    else
+    {
+      capture->capture();
+    }
+    frameCount++;
   }
   
-  glfwTerminate();
+  input.finish();
+  if(window)
+  {
+    glfwTerminate();
+  }
+  else
+  {
+    // waits for the writer to finish the last frames
+    capture.reset();
+    double elapsed = wallClock() - runStart;
+    printf("headless: %d frames in %.2fs, %.1f frames/min\n", frameCount, elapsed, frameCount / elapsed * 60.0);
+  }
+
+  if(savePath)
+  {
+    try
+    {
+      saveScene(savePath, charges);
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+    }
+  }
 
   return 0;
 }
@@ -264,10 +903,68 @@ static float lerp(float a, float b, float f)
     return a + f * (b - a);
 }
 
-static float mapNum(float s, float a1, float a2, float b1, float b2)
+static double wallClock()
 {
-    return b1 + (s - a1) * (b2 - b1) / (a2 - a1);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
+
+// PME error against a converged Ewald sum and its cost, over mesh sizes and cutoffs
+// around the given settings
+static int printEwaldReport(const char *loadPath, const glm::vec3 &cell, const EwaldParams &params)
+{
+  ThreadPool pool;
+  ChargeSet charges;
+  if(loadPath)
+  {
+    try
+    {
+      loadScene(loadPath, charges, pool);
+    }
+    catch(const std::exception &e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+  else
+  {
+    // a neutral random cell
+    srand(1);
+    for(int i = 0; i < 1000; i++)
+    {
+      glm::vec3 p = glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX) * cell;
+      charges.add(p, i % 2 == 0 ? 1.0f : -1.0f);
+    }
+  }
+
+  printf("%zu charges, %g x %g x %g cell, order %d\n", charges.size(), cell.x, cell.y, cell.z, params.order);
+  printf("  mesh  cutoff  splitting   setup ms  sample us   rms error   max error\n");
+  int meshes[3] = {params.meshSize / 2, params.meshSize, params.meshSize * 2};
+  float cutoffs[3] = {params.cutoff / 2.0f, params.cutoff, std::min(params.cutoff * 2.0f, 0.5f * std::min(std::min(cell.x, cell.y), cell.z))};
+  for(int c = 0; c < 3; c++)
+  {
+    for(int m = 0; m < 3; m++)
+    {
+      EwaldParams tried = params;
+      tried.meshSize = std::max(meshes[m], params.order);
+      tried.cutoff = cutoffs[c];
+      try
+      {
+        EwaldSolver solver(cell, tried);
+        EwaldAccuracy accuracy = measureEwald(cell, charges, tried, 500, pool);
+        printf("%6d %7.1f %10.4f %10.2f %10.2f %11.2e %11.2e\n", tried.meshSize, tried.cutoff, solver.splitting(),
+               accuracy.setupSeconds * 1e3, accuracy.sampleSeconds * 1e6, accuracy.rmsError, accuracy.maxError);
+      }
+      catch(const std::exception &e)
+      {
+        cerr << e.what() << endl;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
 static GLuint load_shader(char *filepath, GLenum type)
 {
   FILE *file = fopen(filepath, "rb");
@@ -284,7 +981,7 @@ static GLuint load_shader(char *filepath, GLenum type)
   rewind(file);
  
   char *buffer = (char *) malloc(len);
-  if(fread(buffer, 1, len, file) != len) {
+  if(fread(buffer, 1, len, file) != (size_t)len) {
     fclose(file);
     free(buffer);
     return 0;
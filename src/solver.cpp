@@ -0,0 +1,183 @@
+#include "solver.h"
+
+FieldSolver::FieldSolver(const FieldGrid &gridShape)
+    : requests(FieldRequest()), results(FieldFrame(gridShape)), solvesCompleted(0)
+{
+    thread = std::thread(&FieldSolver::run, this);
+}
+
+FieldSolver::~FieldSolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void FieldSolver::setPeriodic(const glm::vec3 &cellSize, const EwaldParams &params)
+{
+    // fails here on the render thread rather than later on the solver's
+    EwaldSolver check(cellSize, params);
+    periodic = true;
+    periodicCell = cellSize;
+    periodicParams = params;
+}
+
+void FieldSolver::setBackground(const std::shared_ptr<const FieldGrid> &field)
+{
+    background = field;
+}
+
+void FieldSolver::setConductors(const std::shared_ptr<ConductorSet> &set)
+{
+    conductors = set;
+}
+
+void FieldSolver::setCurrents(const std::shared_ptr<const CurrentSet> &set)
+{
+    currents = set;
+}
+
+void FieldSolver::submit(const ChargeSet &charges, const Lattice &lattice, bool withGrid)
+{
+    // only this thread writes submitted, the request carries its version so the solver
+    // labels the frame with the request it actually solved
+    unsigned long version = submitted + 1;
+    FieldRequest &request = requests.writeBuffer();
+    request.version = version;
+    request.charges = charges;
+    request.lattice = lattice;
+    request.withGrid = withGrid;
+    request.periodic = periodic;
+    request.cellSize = periodicCell;
+    request.ewald = periodicParams;
+    request.background = background;
+    request.conductors = conductors;
+    request.currents = currents;
+    requests.publish();
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        submitted = version;
+    }
+    wake.notify_one();
+}
+
+const FieldFrame &FieldSolver::latest()
+{
+    results.update();
+    return results.readBuffer();
+}
+
+void FieldSolver::waitForLatest()
+{
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    solvedSignal.wait(lock, [&] { return stopping || solved >= submitted; });
+}
+
+void FieldSolver::run()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            // a request can be picked up and solved before its submit moves submitted on, so
+            // solved may be ahead of submitted for a moment. that's nothing to do
+            wake.wait(lock, [&] { return stopping || submitted > solved; });
+            if (stopping)
+            {
+                return;
+            }
+        }
+
+        // anything submitted while we were busy was folded into the newest request. it's
+        // published before submitted moves on, so it's at least as new as what woke us
+        requests.update();
+        const FieldRequest &request = requests.readBuffer();
+        unsigned long version = request.version;
+        // only this thread writes solved. the newest request was already solved, don't
+        // solve the same inputs again
+        if (version <= solved)
+        {
+            continue;
+        }
+
+        FieldFrame &frame = results.writeBuffer();
+        frame.lattice = request.lattice;
+        frame.hasGrid = request.withGrid;
+        frame.hasMagnetic = request.currents && !request.currents->empty();
+        if (request.periodic)
+        {
+            if (!ewald || !ewald->matches(request.cellSize, request.ewald))
+            {
+                ewald.reset(new EwaldSolver(request.cellSize, request.ewald));
+            }
+            ewald->setCharges(request.charges, pool);
+            evaluateArrows(request.lattice, request.charges, *ewald, frame.arrows, pool);
+            if (request.withGrid)
+            {
+                frame.grid.evaluate(*ewald, pool);
+            }
+        }
+        else if (request.conductors)
+        {
+            // the panels are solved against these charges, then both are the sources
+            ConductorSet &conductorSet = *request.conductors;
+            frame.conductorStats = conductorSet.solve(request.charges, pool);
+            frame.conductorCharges.resize(conductorSet.conductorCount());
+            for (size_t c = 0; c < frame.conductorCharges.size(); c++)
+            {
+                frame.conductorCharges[c] = conductorSet.totalCharge(c);
+            }
+
+            conductorSources = request.charges;
+            conductorSources.append(conductorSet.sources());
+            conductorTree.build(conductorSources);
+            evaluateArrows(request.lattice, conductorTree, conductorSet.theta, frame.arrows, pool);
+            if (request.withGrid)
+            {
+                frame.grid.evaluate(conductorTree, conductorSet.theta, pool);
+            }
+        }
+        else if (request.background)
+        {
+            evaluateArrows(request.lattice, request.charges, *request.background, frame.arrows, pool);
+            if (request.withGrid)
+            {
+                frame.grid.evaluate(request.charges, pool);
+                frame.grid.add(*request.background, pool);
+            }
+        }
+        else
+        {
+            // with currents both kinds of arrows come out of one pass over the lattice
+            if (frame.hasMagnetic)
+            {
+                evaluateArrows(request.lattice, request.charges, *request.currents, frame.arrows, frame.magnetic, pool);
+            }
+            else
+            {
+                incrementalArrows.update(request.lattice, request.charges, frame.arrows, pool);
+            }
+            if (request.withGrid)
+            {
+                frame.grid.evaluate(request.charges, pool);
+            }
+        }
+        if (frame.hasMagnetic && (request.periodic || request.conductors || request.background))
+        {
+            evaluateArrows(request.lattice, *request.currents, frame.magnetic, pool);
+        }
+        frame.version = version;
+        results.publish();
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            solved = version;
+        }
+        solvedSignal.notify_all();
+        solvesCompleted++;
+    }
+}
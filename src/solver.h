@@ -0,0 +1,122 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "charges.h"
+#include "chargeTree.h"
+#include "conductor.h"
+#include "currents.h"
+#include "ewald.h"
+#include "field.h"
+#include "threadPool.h"
+#include "tripleBuffer.h"
+
+// what the render thread hands to the solver
+struct FieldRequest
+{
+    // submit count when this was published, the version of the frame that answers it
+    unsigned long version = 0;
+    ChargeSet charges;
+    Lattice lattice = {0, 0.0f};
+    bool withGrid = false;
+    // periodic requests solve the cell [0, cellSize) and its images with PME
+    bool periodic = false;
+    glm::vec3 cellSize;
+    EwaldParams ewald;
+    // a fixed field added to the charges', from a density volume
+    std::shared_ptr<const FieldGrid> background;
+    // conductors held at their potentials next to the charges, solved on the solver thread
+    std::shared_ptr<ConductorSet> conductors;
+    // wires whose magnetic field is drawn next to the electric one
+    std::shared_ptr<const CurrentSet> currents;
+};
+
+// a completed solve. version is the request it answers, 0 means nothing solved yet
+struct FieldFrame
+{
+    unsigned long version = 0;
+    Lattice lattice = {0, 0.0f};
+    ArrowField arrows;
+    bool hasMagnetic = false;
+    ArrowField magnetic;
+    bool hasGrid = false;
+    FieldGrid grid;
+    // how the conductors' solve went and the net charge that ended up on each
+    ConductorStats conductorStats;
+    std::vector<float> conductorCharges;
+
+    FieldFrame(const FieldGrid &gridShape) : grid(gridShape)
+    {
+    }
+};
+
+// evaluates the field on its own thread so a slow solve never holds up input or
+// drawing. requests and results both go through triple buffers: the render thread
+// submits the newest charges and always draws the newest completed frame without
+// ever waiting on the solver. nothing is solved unless something was submitted, so
+// callers only submit when the charges or lattice actually changed
+class FieldSolver
+{
+    void run();
+
+    ThreadPool pool;
+    // kept between solves so its mesh and influence function are only rebuilt when the
+    // cell or parameters change
+    std::unique_ptr<EwaldSolver> ewald;
+    // the charges and solved panels together, for the conductors' field
+    ChargeSet conductorSources;
+    ChargeTree conductorTree;
+    // plain coulomb arrows, updated in place when only a few charges changed since the
+    // last request, as while one is dragged
+    IncrementalArrows incrementalArrows;
+
+    // copied into every request
+    bool periodic = false;
+    glm::vec3 periodicCell;
+    EwaldParams periodicParams;
+    std::shared_ptr<const FieldGrid> background;
+    std::shared_ptr<ConductorSet> conductors;
+    std::shared_ptr<const CurrentSet> currents;
+
+    TripleBuffer<FieldRequest> requests;
+    TripleBuffer<FieldFrame> results;
+
+    // only used to put the solver to sleep, never held while solving
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable solvedSignal;
+    unsigned long submitted = 0;
+    unsigned long solved = 0;
+    bool stopping = false;
+
+    std::thread thread;
+
+public:
+    std::atomic<unsigned long> solvesCompleted;
+
+    FieldSolver(const FieldGrid &gridShape);
+    ~FieldSolver();
+
+    // render thread side. setPeriodic applies from the next submit on, it throws if
+    // the parameters don't fit the cell
+    void setPeriodic(const glm::vec3 &cellSize, const EwaldParams &params);
+    // a field added to every solve from the next submit on, it's shared and never written
+    void setBackground(const std::shared_ptr<const FieldGrid> &field);
+    // conductors solved with every request from the next submit on. the set belongs to
+    // the solver thread from then on, the caller mustn't touch it again
+    void setConductors(const std::shared_ptr<ConductorSet> &set);
+    // wires whose magnetic arrows are solved along with the electric ones
+    void setCurrents(const std::shared_ptr<const CurrentSet> &set);
+    void submit(const ChargeSet &charges, const Lattice &lattice, bool withGrid);
+    const FieldFrame &latest();
+    // blocks until everything submitted so far is solved, for offline rendering where
+    // each frame has to show the field of its own charges
+    void waitForLatest();
+};
+
+#endif // SOLVER_H
@@ -0,0 +1,144 @@
+#include "streamBuffer.h"
+
+#include <algorithm>
+#include <string.h>
+
+// keeps every write aligned for vertex attribute fetches
+static const size_t writeAlign = 64;
+
+StreamBuffer::StreamBuffer(GLenum bufferTarget, size_t initialRegionSize, int regions)
+{
+    target = bufferTarget;
+    regionCount = regions;
+    persistent = GLEW_ARB_buffer_storage;
+    fences.assign(regionCount, (GLsync)0);
+    create(initialRegionSize);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync fence : fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+    if (persistent && mapped)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void StreamBuffer::create(size_t size)
+{
+    regionSize = (size + writeAlign - 1) / writeAlign * writeAlign;
+    size_t total = regionSize * regionCount;
+
+    // the old buffer may still be in use by the GPU, deleting it only drops our name
+    if (buffer)
+    {
+        if (persistent && mapped)
+        {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    for (GLsync &fence : fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, total, NULL, flags);
+        mapped = (char *)glMapBufferRange(target, 0, total, flags);
+    }
+    else
+    {
+        glBufferData(target, total, NULL, GL_STREAM_DRAW);
+    }
+    region = 0;
+    used = 0;
+}
+
+void StreamBuffer::waitForRegion(int r)
+{
+    if (!fences[r])
+    {
+        return;
+    }
+
+    // normally long signalled, this only blocks if the GPU is a whole ring behind
+    GLenum result = glClientWaitSync(fences[r], 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED)
+    {
+        result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    glDeleteSync(fences[r]);
+    fences[r] = 0;
+}
+
+size_t StreamBuffer::write(const void *data, size_t bytes)
+{
+    size_t aligned = (bytes + writeAlign - 1) / writeAlign * writeAlign;
+
+    // outgrew the region, start over in a bigger buffer
+    if (used + aligned > regionSize)
+    {
+        create(std::max(regionSize * 2, used + aligned));
+    }
+
+    if (used == 0)
+    {
+        waitForRegion(region);
+    }
+
+    size_t offset = region * regionSize + used;
+    glBindBuffer(target, buffer);
+    if (persistent)
+    {
+        memcpy(mapped + offset, data, bytes);
+    }
+    else
+    {
+        // the fence already guarantees the GPU is done with this range
+        void *dst = glMapBufferRange(target, offset, bytes,
+                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        memcpy(dst, data, bytes);
+        glUnmapBuffer(target);
+    }
+
+    used += aligned;
+    bytesUploaded += bytes;
+    return offset;
+}
+
+void StreamBuffer::endFrame()
+{
+    if (used == 0)
+    {
+        return;
+    }
+
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % regionCount;
+    used = 0;
+}
+
+size_t StreamBuffer::takeBytesUploaded()
+{
+    size_t bytes = bytesUploaded;
+    bytesUploaded = 0;
+    return bytes;
+}
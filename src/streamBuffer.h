@@ -0,0 +1,48 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+// a ring of per frame regions in one buffer for data that changes every frame. with
+// ARB_buffer_storage the buffer is mapped once, persistently. otherwise each write maps
+// its range unsynchronized. either way a fence per region stops the CPU from overwriting
+// what the GPU may still read, so there's no implicit sync in the driver
+class StreamBuffer
+{
+    void create(size_t size);
+    void waitForRegion(int region);
+
+    GLenum target;
+    int regionCount;
+    size_t regionSize;
+    bool persistent;
+    char *mapped = nullptr;
+
+    int region = 0;
+    size_t used = 0;
+    std::vector<GLsync> fences;
+
+public:
+    GLuint buffer = 0;
+
+    // bytes written since the last call to takeBytesUploaded
+    size_t bytesUploaded = 0;
+
+    StreamBuffer(GLenum bufferTarget, size_t initialRegionSize, int regions = 3);
+    ~StreamBuffer();
+
+    // copies bytes into this frame's region and returns their offset in buffer. the
+    // buffer is left bound to the target
+    size_t write(const void *data, size_t bytes);
+
+    // call once the frame's draws using the buffer are submitted
+    void endFrame();
+
+    size_t takeBytesUploaded();
+};
+
+#endif // STREAMBUFFER_H
@@ -0,0 +1,166 @@
+#include "threadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the caller of parallelFor is the last worker
+    for (int i = 0; i < threadCount - 1; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = generation;
+
+        busy++;
+        while (nextChunk < jobEnd)
+        {
+            size_t first = nextChunk;
+            size_t last = std::min(jobEnd, first + jobGrain);
+            nextChunk = last;
+
+            lock.unlock();
+            jobFn(jobContext, first, last);
+            lock.lock();
+        }
+        busy--;
+        if (busy == 0)
+        {
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::run(size_t begin, size_t end, size_t grain, void (*fn)(const void *, size_t, size_t), const void *context)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+
+    // not worth waking anyone for a single chunk
+    if (workers.empty() || end - begin <= grain)
+    {
+        fn(context, begin, end);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    jobFn = fn;
+    jobContext = context;
+    jobEnd = end;
+    jobGrain = grain;
+    nextChunk = begin;
+    generation++;
+    wake.notify_all();
+
+    busy++;
+    while (nextChunk < jobEnd)
+    {
+        size_t first = nextChunk;
+        size_t last = std::min(jobEnd, first + jobGrain);
+        nextChunk = last;
+
+        lock.unlock();
+        fn(context, first, last);
+        lock.lock();
+    }
+    busy--;
+
+    done.wait(lock, [&] { return busy == 0; });
+    jobFn = nullptr;
+    jobContext = nullptr;
+}
+
+size_t parallelExclusiveScan(ThreadPool &pool, const std::vector<size_t> &counts, std::vector<size_t> &offsets)
+{
+    offsets.resize(counts.size());
+    if (counts.empty())
+    {
+        return 0;
+    }
+    return parallelExclusiveScan(pool, &counts[0], &offsets[0], counts.size());
+}
+
+size_t parallelExclusiveScan(ThreadPool &pool, const size_t *counts, size_t *offsets, size_t n)
+{
+    // chunk totals live on the stack, past this many chunks the extra threads wouldn't help
+    const size_t maxChunks = 64;
+    size_t chunks = std::min<size_t>(std::min<size_t>(pool.size(), maxChunks), n);
+    if (chunks == 0)
+    {
+        return 0;
+    }
+    size_t grain = (n + chunks - 1) / chunks;
+    chunks = (n + grain - 1) / grain;
+
+    size_t chunkSums[maxChunks];
+    pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            size_t sum = 0;
+            for (size_t i = c * grain; i < std::min(n, (c + 1) * grain); i++)
+            {
+                sum += counts[i];
+            }
+            chunkSums[c] = sum;
+        }
+    });
+
+    size_t total = 0;
+    for (size_t c = 0; c < chunks; c++)
+    {
+        size_t sum = chunkSums[c];
+        chunkSums[c] = total;
+        total += sum;
+    }
+
+    pool.parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; c++)
+        {
+            size_t running = chunkSums[c];
+            for (size_t i = c * grain; i < std::min(n, (c + 1) * grain); i++)
+            {
+                offsets[i] = running;
+                running += counts[i];
+            }
+        }
+    });
+    return total;
+}
@@ -0,0 +1,55 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads for splitting loops over the field into chunks
+class ThreadPool
+{
+    void workerLoop();
+    void run(size_t begin, size_t end, size_t grain, void (*fn)(const void *, size_t, size_t), const void *context);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // the job currently being run, workers grab chunks until none are left. a plain
+    // function and context pointer, unlike a std::function starting a job never allocates
+    void (*jobFn)(const void *, size_t, size_t) = nullptr;
+    const void *jobContext = nullptr;
+    size_t jobEnd = 0;
+    size_t jobGrain = 1;
+    size_t nextChunk = 0;
+    int busy = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+
+public:
+    ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+    int size() const;
+
+    // calls fn(first, last) over [begin, end) in chunks of at most grain and returns
+    // once every chunk has run. the calling thread works on chunks too. only one thread
+    // may be inside parallelFor on a given pool at a time
+    template <typename Fn>
+    void parallelFor(size_t begin, size_t end, size_t grain, const Fn &fn)
+    {
+        run(begin, end, grain,
+            [](const void *context, size_t first, size_t last) { (*static_cast<const Fn *>(context))(first, last); },
+            &fn);
+    }
+};
+
+// writes the exclusive prefix sum of counts to offsets and returns the total. chunks are
+// summed in parallel, the chunk totals scanned serially, then each chunk is offset in parallel.
+// the pointer version works on caller owned storage and doesn't allocate
+size_t parallelExclusiveScan(ThreadPool &pool, const size_t *counts, size_t *offsets, size_t n);
+size_t parallelExclusiveScan(ThreadPool &pool, const std::vector<size_t> &counts, std::vector<size_t> &offsets);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,55 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <vector>
+
+// lock free hand off of whole values between one writer and one reader thread. the
+// writer fills its back slot and publishes it, the reader picks up the newest published
+// slot. neither side ever waits on the other, and a slow reader just skips values
+template <class T>
+class TripleBuffer
+{
+    static const int freshBit = 4;
+
+    std::vector<T> slots;
+    std::atomic<int> middle;
+    int back;
+    int front;
+
+public:
+    TripleBuffer(const T &init) : slots(3, init), middle(2), back(0), front(1)
+    {
+    }
+
+    // writer side
+    T &writeBuffer()
+    {
+        return slots[back];
+    }
+
+    void publish()
+    {
+        int old = middle.exchange(back | freshBit, std::memory_order_acq_rel);
+        back = old & 3;
+    }
+
+    // reader side, returns true when a newer value was published since the last call
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_acquire) & freshBit))
+        {
+            return false;
+        }
+        int old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & 3;
+        return true;
+    }
+
+    const T &readBuffer() const
+    {
+        return slots[front];
+    }
+};
+
+#endif // TRIPLEBUFFER_H
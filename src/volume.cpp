@@ -0,0 +1,273 @@
+#include "volume.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+
+VolumeRenderer::VolumeRenderer(const FieldGrid &grid)
+{
+    dims = grid.dims;
+    coarseDims = glm::ivec3((dims.x + coarseSize - 1) / coarseSize,
+                            (dims.y + coarseSize - 1) / coarseSize,
+                            (dims.z + coarseSize - 1) / coarseSize);
+    volumeMin = grid.origin;
+    volumeMax = grid.origin + grid.extent();
+
+    // nothing has been uploaded yet, so every brick compares as changed
+    uploaded.resize(grid.magnitude.size(), -1.0f);
+    coarse.resize((size_t)coarseDims.x * coarseDims.y * coarseDims.z, glm::vec2(0.0f));
+    coarseStale.resize(coarse.size(), 0);
+    packedDirection.resize(grid.magnitude.size() * 4, 0);
+
+    shaderProgram = loadShaderProgram("shaders/fullscreenVertex.glsl", "shaders/volumeFragment.glsl");
+    glUseProgram(shaderProgram);
+
+    // the full screen triangle is generated from gl_VertexID, but core profile still wants a VAO
+    glGenVertexArrays(1, &VAO);
+
+    glGenTextures(1, &volumeTex);
+    glBindTexture(GL_TEXTURE_3D, volumeTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, dims.x, dims.y, dims.z, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &directionTex);
+    glBindTexture(GL_TEXTURE_3D, directionTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8, dims.x, dims.y, dims.z, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &coarseTex);
+    glBindTexture(GL_TEXTURE_3D, coarseTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, coarseDims.x, coarseDims.y, coarseDims.z, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &transferTex);
+    buildTransferFunction();
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glUniform1i(glGetUniformLocation(shaderProgram, "volume"), 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "directions"), 1);
+    glUniform1i(glGetUniformLocation(shaderProgram, "coarse"), 2);
+    glUniform1i(glGetUniformLocation(shaderProgram, "transfer"), 3);
+
+    uniInvViewProj = glGetUniformLocation(shaderProgram, "invViewProj");
+    uniEye = glGetUniformLocation(shaderProgram, "eye");
+    uniVolumeMin = glGetUniformLocation(shaderProgram, "volumeMin");
+    uniVolumeMax = glGetUniformLocation(shaderProgram, "volumeMax");
+    uniSpacing = glGetUniformLocation(shaderProgram, "spacing");
+    uniMagLow = glGetUniformLocation(shaderProgram, "magLow");
+    uniMagHigh = glGetUniformLocation(shaderProgram, "magHigh");
+    uniEmptyBelow = glGetUniformLocation(shaderProgram, "emptyBelow");
+    uniCoarseSize = glGetUniformLocation(shaderProgram, "coarseSize");
+    uniUseDirection = glGetUniformLocation(shaderProgram, "useDirection");
+
+    glUniform3f(glGetUniformLocation(shaderProgram, "dims"), dims.x, dims.y, dims.z);
+    glUniform3f(glGetUniformLocation(shaderProgram, "coarseDims"), coarseDims.x, coarseDims.y, coarseDims.z);
+}
+
+void VolumeRenderer::buildTransferFunction()
+{
+    // dark blue through cyan and yellow to white, transparent below emptyBelow
+    const int size = 256;
+    const glm::vec3 stops[4] = {glm::vec3(0.0f, 0.1f, 0.6f), glm::vec3(0.0f, 0.8f, 1.0f),
+                                glm::vec3(1.0f, 0.9f, 0.1f), glm::vec3(1.0f, 1.0f, 1.0f)};
+    std::vector<GLubyte> texels(size * 4);
+    for (int i = 0; i < size; i++)
+    {
+        float v = (float)i / (size - 1);
+        float s = std::min(v * 3.0f, 2.999f);
+        int stop = (int)s;
+        glm::vec3 color = glm::mix(stops[stop], stops[stop + 1], s - stop);
+
+        float alpha = 0.0f;
+        if (v >= emptyBelow)
+        {
+            float a = (v - emptyBelow) / (1.0f - emptyBelow);
+            alpha = 0.02f + 0.3f * a * a;
+        }
+
+        texels[i * 4 + 0] = (GLubyte)(color.x * 255.0f);
+        texels[i * 4 + 1] = (GLubyte)(color.y * 255.0f);
+        texels[i * 4 + 2] = (GLubyte)(color.z * 255.0f);
+        texels[i * 4 + 3] = (GLubyte)(alpha * 255.0f);
+    }
+
+    glBindTexture(GL_TEXTURE_1D, transferTex);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+void VolumeRenderer::markCoarse(int bx, int by, int bz)
+{
+    // the coarse cells covering this brick, and the ring around it whose one voxel of
+    // padding reaches into it
+    int perBrick = brickSize / coarseSize;
+    glm::ivec3 lo = glm::max(glm::ivec3(bx, by, bz) * perBrick - glm::ivec3(1), glm::ivec3(0));
+    glm::ivec3 hi = glm::min(glm::ivec3(bx + 1, by + 1, bz + 1) * perBrick, coarseDims - glm::ivec3(1));
+    for (int cz = lo.z; cz <= hi.z; cz++)
+        for (int cy = lo.y; cy <= hi.y; cy++)
+            for (int cx = lo.x; cx <= hi.x; cx++)
+            {
+                coarseStale[((size_t)cz * coarseDims.y + cy) * coarseDims.x + cx] = 1;
+            }
+}
+
+void VolumeRenderer::updateCoarse(int cx, int cy, int cz)
+{
+    // padded by one voxel so trilinear samples near a block edge can't be skipped by mistake
+    glm::ivec3 lo = glm::max(glm::ivec3(cx, cy, cz) * coarseSize - glm::ivec3(1), glm::ivec3(0));
+    glm::ivec3 hi = glm::min(glm::ivec3(cx + 1, cy + 1, cz + 1) * coarseSize, dims - glm::ivec3(1));
+
+    float mn = uploaded[((size_t)lo.z * dims.y + lo.y) * dims.x + lo.x];
+    float mx = mn;
+    for (int z = lo.z; z <= hi.z; z++)
+        for (int y = lo.y; y <= hi.y; y++)
+            for (int x = lo.x; x <= hi.x; x++)
+            {
+                float m = uploaded[((size_t)z * dims.y + y) * dims.x + x];
+                mn = std::min(mn, m);
+                mx = std::max(mx, m);
+            }
+
+    coarse[((size_t)cz * coarseDims.y + cy) * coarseDims.x + cx] = glm::vec2(mn, mx);
+}
+
+void VolumeRenderer::update(const FieldGrid &grid)
+{
+    bricksUploaded = 0;
+
+    // let glTexSubImage3D read a brick straight out of the full grid
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, dims.x);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, dims.y);
+
+    for (int bz = 0; bz < dims.z; bz += brickSize)
+    {
+        for (int by = 0; by < dims.y; by += brickSize)
+        {
+            for (int bx = 0; bx < dims.x; bx += brickSize)
+            {
+                int w = std::min(brickSize, dims.x - bx);
+                int h = std::min(brickSize, dims.y - by);
+                int d = std::min(brickSize, dims.z - bz);
+
+                bool changed = false;
+                for (int z = bz; z < bz + d && !changed; z++)
+                    for (int y = by; y < by + h && !changed; y++)
+                        for (int x = bx; x < bx + w; x++)
+                        {
+                            size_t i = grid.index(x, y, z);
+                            float old = uploaded[i];
+                            if (std::fabs(grid.magnitude[i] - old) > tolerance * std::max(std::fabs(old), magLow))
+                            {
+                                changed = true;
+                                break;
+                            }
+                        }
+
+                if (!changed)
+                {
+                    continue;
+                }
+
+                for (int z = bz; z < bz + d; z++)
+                    for (int y = by; y < by + h; y++)
+                        for (int x = bx; x < bx + w; x++)
+                        {
+                            size_t i = grid.index(x, y, z);
+                            uploaded[i] = grid.magnitude[i];
+                            glm::vec3 dir = grid.direction[i] * 0.5f + glm::vec3(0.5f);
+                            packedDirection[i * 4 + 0] = (GLubyte)(dir.x * 255.0f);
+                            packedDirection[i * 4 + 1] = (GLubyte)(dir.y * 255.0f);
+                            packedDirection[i * 4 + 2] = (GLubyte)(dir.z * 255.0f);
+                            packedDirection[i * 4 + 3] = 255;
+                        }
+
+                size_t first = grid.index(bx, by, bz);
+                glBindTexture(GL_TEXTURE_3D, volumeTex);
+                glTexSubImage3D(GL_TEXTURE_3D, 0, bx, by, bz, w, h, d, GL_RED, GL_FLOAT, &grid.magnitude[first]);
+                glBindTexture(GL_TEXTURE_3D, directionTex);
+                glTexSubImage3D(GL_TEXTURE_3D, 0, bx, by, bz, w, h, d, GL_RGBA, GL_UNSIGNED_BYTE,
+                                &packedDirection[first * 4]);
+
+                markCoarse(bx / brickSize, by / brickSize, bz / brickSize);
+                bricksUploaded++;
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // the coarse cells are only redone once every changed brick is in uploaded, so the
+    // padding of a cell next to a changed brick reads its new values
+    for (int cz = 0; cz < coarseDims.z; cz++)
+        for (int cy = 0; cy < coarseDims.y; cy++)
+            for (int cx = 0; cx < coarseDims.x; cx++)
+            {
+                char &stale = coarseStale[((size_t)cz * coarseDims.y + cy) * coarseDims.x + cx];
+                if (stale)
+                {
+                    updateCoarse(cx, cy, cz);
+                    stale = 0;
+                }
+            }
+
+    // the coarse grid is tiny, send it whole when anything moved
+    if (bricksUploaded > 0)
+    {
+        glBindTexture(GL_TEXTURE_3D, coarseTex);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, coarseDims.x, coarseDims.y, coarseDims.z,
+                        GL_RG, GL_FLOAT, &coarse[0]);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void VolumeRenderer::render(Camera &camera)
+{
+    glUseProgram(shaderProgram);
+    glBindVertexArray(VAO);
+
+    const glm::mat4 &invViewProj = camera.inverseViewProj();
+    const glm::vec3 &eye = camera.position();
+
+    glUniformMatrix4fv(uniInvViewProj, 1, GL_FALSE, glm::value_ptr(invViewProj));
+    glUniform3fv(uniEye, 1, glm::value_ptr(eye));
+    glUniform3fv(uniVolumeMin, 1, glm::value_ptr(volumeMin));
+    glUniform3fv(uniVolumeMax, 1, glm::value_ptr(volumeMax));
+    glUniform1f(uniSpacing, (volumeMax.x - volumeMin.x) / (dims.x - 1));
+    glUniform1f(uniMagLow, magLow);
+    glUniform1f(uniMagHigh, magHigh);
+    glUniform1f(uniEmptyBelow, emptyBelow);
+    glUniform1f(uniCoarseSize, (float)coarseSize);
+    glUniform1i(uniUseDirection, useDirection ? 1 : 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, volumeTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, directionTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, coarseTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_1D, transferTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    // the shader outputs premultiplied color and marches the whole volume itself
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+}
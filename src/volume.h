@@ -0,0 +1,61 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+#define GLEW_STATIC
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Camera.h"
+#include "field.h"
+
+// ray marches the field magnitude stored in a 3D texture. the volume is split into
+// bricks that are only re-uploaded when their contents change, and a coarse min/max
+// grid lets the shader jump over blocks the transfer function maps to zero opacity
+class VolumeRenderer
+{
+    void buildTransferFunction();
+    void markCoarse(int bx, int by, int bz);
+    void updateCoarse(int cx, int cy, int cz);
+
+    GLuint shaderProgram, VAO;
+    GLuint volumeTex, directionTex, coarseTex, transferTex;
+    GLint uniInvViewProj, uniEye, uniVolumeMin, uniVolumeMax, uniSpacing;
+    GLint uniMagLow, uniMagHigh, uniEmptyBelow, uniCoarseSize, uniUseDirection;
+
+    glm::ivec3 dims;
+    glm::ivec3 coarseDims;
+    glm::vec3 volumeMin, volumeMax;
+
+    // what the GPU currently holds, to find the bricks that changed
+    std::vector<float> uploaded;
+    std::vector<glm::vec2> coarse;
+    // coarse cells whose padded block saw a brick change this update
+    std::vector<char> coarseStale;
+    std::vector<GLubyte> packedDirection;
+
+public:
+    static const int brickSize = 16;
+    static const int coarseSize = 8;
+
+    // magnitudes are mapped logarithmically between these before the transfer function
+    float magLow = 1e-4f;
+    float magHigh = 0.25f;
+    // transfer function opacity is zero below this normalized value
+    float emptyBelow = 0.05f;
+    // bricks whose samples all moved less than this (relative) are not re-uploaded
+    float tolerance = 1e-3f;
+    bool useDirection = false;
+
+    int bricksUploaded = 0;
+
+    VolumeRenderer(const FieldGrid &grid);
+    void update(const FieldGrid &grid);
+    void render(Camera &camera);
+};
+
+#endif // VOLUME_H
@@ -0,0 +1,468 @@
+// distributed field solver for grids too big for one node. the sampling grid is split
+// into z slabs, one per rank, and every rank writes its slab of the result into one
+// shared file with MPI-IO.
+//
+// charges are either broadcast so every rank sums all of them exactly (--direct), or
+// partitioned by slab, in which case each rank builds a Barnes-Hut tree over its own
+// charges and sends every other rank only the locally essential part of it: multipoles
+// for the cells far enough from that rank's slab, the charges themselves for the rest.
+// each rank then builds one tree over its own charges and everything it received and
+// walks it for every sample.
+//
+//   mpirun -n 4 build/fieldMpi --random 200000 --grid 128 --out field.bin
+//
+// prints a timing summary and a "csv," line per run, tools/scaling.sh uses those for
+// strong and weak scaling tables.
+//
+// output file: a 64 byte header (magic "EFFG", uint32 version, int32 dims[3], float
+// origin[3], float spacing, 28 reserved bytes), then the magnitude of every sample and
+// then its unit direction as 3 floats, both in FieldGrid::index order
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "charges.h"
+#include "chargeTree.h"
+#include "field.h"
+#include "scene.h"
+#include "threadPool.h"
+
+struct FieldFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t dims[3];
+    float origin[3];
+    float spacing;
+    uint32_t reserved[7];
+};
+
+struct Settings
+{
+    std::string scenePath;
+    std::string outPath;
+    size_t randomCount = 100000;
+    int gridSize = 128;
+    float theta = 0.5f;
+    int threads = 0;
+    bool direct = false;
+    bool weak = false;
+};
+
+// the grid and how its z layers are split over the ranks
+struct Decomposition
+{
+    glm::ivec3 dims;
+    glm::vec3 origin;
+    float spacing;
+    int ranks;
+
+    int firstLayer(int rank) const
+    {
+        return (int)((long)rank * dims.z / ranks);
+    }
+
+    int owner(float z) const
+    {
+        int layer = std::min(std::max((int)((z - origin.z) / spacing + 0.5f), 0), dims.z - 1);
+        int rank = (int)((long)layer * ranks / dims.z);
+        // the division can land one rank low at slab edges
+        while (rank + 1 < ranks && firstLayer(rank + 1) <= layer)
+        {
+            rank++;
+        }
+        return rank;
+    }
+
+    void slabBox(int rank, glm::vec3 &lo, glm::vec3 &hi) const
+    {
+        lo = origin + glm::vec3(0.0f, 0.0f, firstLayer(rank) * spacing);
+        hi = origin + glm::vec3((dims.x - 1) * spacing, (dims.y - 1) * spacing,
+                                (firstLayer(rank + 1) - 1) * spacing);
+    }
+};
+
+static void usage()
+{
+    printf("usage: fieldMpi [--scene path | --random count] [--grid n] [--theta t] [--threads n]\n"
+           "                [--direct] [--weak] [--out path]\n");
+}
+
+static bool parseArgs(int argc, char *argv[], Settings &settings)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--scene") == 0 && hasValue)
+            settings.scenePath = argv[++i];
+        else if (strcmp(argv[i], "--random") == 0 && hasValue)
+            settings.randomCount = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--grid") == 0 && hasValue)
+            settings.gridSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--theta") == 0 && hasValue)
+            settings.theta = atof(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+            settings.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)
+            settings.outPath = argv[++i];
+        else if (strcmp(argv[i], "--direct") == 0)
+            settings.direct = true;
+        else if (strcmp(argv[i], "--weak") == 0)
+            settings.weak = true;
+        else
+            return false;
+    }
+    return settings.gridSize > 1;
+}
+
+// MPI counts are ints, big arrays go over in pieces
+static void broadcastFloats(std::vector<float> &values, size_t count)
+{
+    const size_t piece = 1 << 28;
+    values.resize(count);
+    for (size_t first = 0; first < count; first += piece)
+    {
+        int n = (int)std::min(piece, count - first);
+        MPI_Bcast(&values[first], n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    }
+}
+
+static void broadcastCharges(ChargeSet &charges)
+{
+    unsigned long count = charges.size();
+    MPI_Bcast(&count, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    broadcastFloats(charges.x, count);
+    broadcastFloats(charges.y, count);
+    broadcastFloats(charges.z, count);
+    broadcastFloats(charges.q, count);
+}
+
+// rank 0 sorts the charges by owning slab and hands every rank its own
+static void scatterCharges(const ChargeSet &all, const Decomposition &grid, int rank, ChargeSet &mine)
+{
+    std::vector<int> counts(grid.ranks, 0);
+    std::vector<int> offsets(grid.ranks, 0);
+    std::vector<float> send[4];
+    if (rank == 0)
+    {
+        std::vector<int> owners(all.size());
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            owners[i] = grid.owner(all.z[i]);
+            counts[owners[i]]++;
+        }
+        for (int r = 1; r < grid.ranks; r++)
+        {
+            offsets[r] = offsets[r - 1] + counts[r - 1];
+        }
+
+        std::vector<int> next = offsets;
+        for (int c = 0; c < 4; c++)
+        {
+            send[c].resize(all.size());
+        }
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            int slot = next[owners[i]]++;
+            send[0][slot] = all.x[i];
+            send[1][slot] = all.y[i];
+            send[2][slot] = all.z[i];
+            send[3][slot] = all.q[i];
+        }
+    }
+
+    int myCount = 0;
+    MPI_Scatter(&counts[0], 1, MPI_INT, &myCount, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<float> *columns[4] = {&mine.x, &mine.y, &mine.z, &mine.q};
+    for (int c = 0; c < 4; c++)
+    {
+        columns[c]->resize(myCount);
+        MPI_Scatterv(rank == 0 ? &send[c][0] : nullptr, &counts[0], &offsets[0], MPI_FLOAT,
+                     myCount > 0 ? &(*columns[c])[0] : nullptr, myCount, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    }
+}
+
+// sends every rank the locally essential part of this rank's tree for its slab
+static void exchangeEssentialTrees(const ChargeTree &tree, const Decomposition &grid, int rank, float theta,
+                                   ChargeSet &near, MultipoleSet &far)
+{
+    int ranks = grid.ranks;
+    std::vector<std::vector<float> > nearOut(ranks), farOut(ranks);
+    for (int r = 0; r < ranks; r++)
+    {
+        if (r == rank)
+        {
+            continue;
+        }
+        glm::vec3 lo, hi;
+        grid.slabBox(r, lo, hi);
+        ChargeSet essentialNear;
+        MultipoleSet essentialFar;
+        tree.collect(lo, hi, theta, essentialNear, essentialFar);
+
+        for (size_t i = 0; i < essentialNear.size(); i++)
+        {
+            float c[4] = {essentialNear.x[i], essentialNear.y[i], essentialNear.z[i], essentialNear.q[i]};
+            nearOut[r].insert(nearOut[r].end(), c, c + 4);
+        }
+        for (size_t i = 0; i < essentialFar.size(); i++)
+        {
+            float m[7] = {essentialFar.x[i], essentialFar.y[i], essentialFar.z[i], essentialFar.q[i],
+                          essentialFar.px[i], essentialFar.py[i], essentialFar.pz[i]};
+            farOut[r].insert(farOut[r].end(), m, m + 7);
+        }
+    }
+
+    // near charges then multipoles, counts first so every rank can size its receive
+    std::vector<std::vector<float> > *lists[2] = {&nearOut, &farOut};
+    std::vector<float> received[2];
+    for (int k = 0; k < 2; k++)
+    {
+        std::vector<int> sendCounts(ranks), sendOffsets(ranks), recvCounts(ranks), recvOffsets(ranks);
+        std::vector<float> flat;
+        for (int r = 0; r < ranks; r++)
+        {
+            sendOffsets[r] = flat.size();
+            sendCounts[r] = (*lists[k])[r].size();
+            flat.insert(flat.end(), (*lists[k])[r].begin(), (*lists[k])[r].end());
+        }
+        MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+        int total = 0;
+        for (int r = 0; r < ranks; r++)
+        {
+            recvOffsets[r] = total;
+            total += recvCounts[r];
+        }
+        received[k].resize(std::max(total, 1));
+        flat.resize(std::max<size_t>(flat.size(), 1));
+        MPI_Alltoallv(&flat[0], &sendCounts[0], &sendOffsets[0], MPI_FLOAT,
+                      &received[k][0], &recvCounts[0], &recvOffsets[0], MPI_FLOAT, MPI_COMM_WORLD);
+        received[k].resize(total);
+    }
+
+    for (size_t i = 0; i + 4 <= received[0].size(); i += 4)
+    {
+        const float *c = &received[0][i];
+        near.add(glm::vec3(c[0], c[1], c[2]), c[3]);
+    }
+    for (size_t i = 0; i + 7 <= received[1].size(); i += 7)
+    {
+        const float *m = &received[1][i];
+        far.add(glm::vec3(m[0], m[1], m[2]), m[3], glm::vec3(m[4], m[5], m[6]));
+    }
+}
+
+static void writeSlabs(const std::string &path, const Decomposition &grid, int rank, const FieldGrid &slab)
+{
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) !=
+        MPI_SUCCESS)
+    {
+        if (rank == 0)
+        {
+            fprintf(stderr, "fieldMpi: could not open %s\n", path.c_str());
+        }
+        return;
+    }
+
+    size_t total = (size_t)grid.dims.x * grid.dims.y * grid.dims.z;
+    MPI_File_set_size(file, sizeof(FieldFileHeader) + total * 4 * sizeof(float));
+    if (rank == 0)
+    {
+        FieldFileHeader header = {};
+        memcpy(header.magic, "EFFG", 4);
+        header.version = 1;
+        header.dims[0] = grid.dims.x;
+        header.dims[1] = grid.dims.y;
+        header.dims[2] = grid.dims.z;
+        header.origin[0] = grid.origin.x;
+        header.origin[1] = grid.origin.y;
+        header.origin[2] = grid.origin.z;
+        header.spacing = grid.spacing;
+        MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+
+    // slabs are contiguous in z major order, every rank writes its two ranges collectively
+    size_t layer = (size_t)grid.dims.x * grid.dims.y;
+    size_t first = grid.firstLayer(rank) * layer;
+    size_t count = slab.magnitude.size();
+    MPI_Offset magnitudeAt = sizeof(FieldFileHeader) + first * sizeof(float);
+    MPI_Offset directionAt = sizeof(FieldFileHeader) + (total + first * 3) * sizeof(float);
+    MPI_File_write_at_all(file, magnitudeAt, count ? (void *)&slab.magnitude[0] : nullptr, (int)count, MPI_FLOAT,
+                          MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, directionAt, count ? (void *)&slab.direction[0] : nullptr, (int)count * 3,
+                          MPI_FLOAT, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+}
+
+int main(int argc, char *argv[])
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    Settings settings;
+    if (!parseArgs(argc, argv, settings))
+    {
+        if (rank == 0)
+        {
+            usage();
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    ThreadPool pool(settings.threads);
+    double phase[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+
+    // weak scaling grows the grid in z and the random charges with the rank count
+    Decomposition grid;
+    grid.ranks = ranks;
+    grid.dims = glm::ivec3(settings.gridSize, settings.gridSize, settings.gridSize * (settings.weak ? ranks : 1));
+
+    ChargeSet all;
+    float bounds[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    int failed = 0;
+    if (rank == 0)
+    {
+        if (!settings.scenePath.empty())
+        {
+            try
+            {
+                loadScene(settings.scenePath, all, pool);
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "%s\n", e.what());
+                failed = 1;
+            }
+        }
+        else
+        {
+            // uniform in a box as deep as the grid, seeded so every run is the same
+            size_t count = settings.randomCount * (settings.weak ? ranks : 1);
+            std::mt19937 random(1234);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            float depth = 1000.0f * grid.dims.z / grid.dims.x;
+            for (size_t i = 0; i < count; i++)
+            {
+                all.add(glm::vec3(unit(random) * 1000.0f, unit(random) * 1000.0f, unit(random) * depth),
+                        unit(random) < 0.5f ? -1.0f : 1.0f);
+            }
+        }
+
+        if (!failed && all.empty())
+        {
+            fprintf(stderr, "fieldMpi: no charges\n");
+            failed = 1;
+        }
+        if (!failed)
+        {
+            glm::vec3 lo = all.position(0), hi = lo;
+            for (size_t i = 0; i < all.size(); i++)
+            {
+                lo = glm::min(lo, all.position(i));
+                hi = glm::max(hi, all.position(i));
+            }
+            bounds[0] = lo.x, bounds[1] = lo.y, bounds[2] = lo.z;
+            bounds[3] = hi.x, bounds[4] = hi.y, bounds[5] = hi.z;
+        }
+    }
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (failed)
+    {
+        MPI_Finalize();
+        return 1;
+    }
+
+    // the grid spans the charges' bounds, with the same spacing on every axis
+    MPI_Bcast(bounds, 6, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    glm::vec3 extent = glm::vec3(bounds[3] - bounds[0], bounds[4] - bounds[1], bounds[5] - bounds[2]);
+    grid.origin = glm::vec3(bounds[0], bounds[1], bounds[2]);
+    grid.spacing = std::max(std::max(extent.x / (grid.dims.x - 1), extent.y / (grid.dims.y - 1)),
+                            std::max(extent.z / (grid.dims.z - 1), 1e-6f));
+
+    int z0 = grid.firstLayer(rank);
+    int z1 = grid.firstLayer(rank + 1);
+    FieldGrid slab(glm::ivec3(grid.dims.x, grid.dims.y, z1 - z0), grid.origin, grid.spacing);
+    slab.firstLayer = z0;
+
+    unsigned long sources[2] = {0, 0};
+    if (settings.direct)
+    {
+        broadcastCharges(all);
+        MPI_Barrier(MPI_COMM_WORLD);
+        phase[0] = phase[1] = phase[2] = MPI_Wtime();
+
+        slab.evaluate(all, pool);
+        sources[0] = all.size();
+        phase[3] = MPI_Wtime();
+    }
+    else
+    {
+        ChargeSet mine;
+        scatterCharges(all, grid, rank, mine);
+        all.clear();
+        MPI_Barrier(MPI_COMM_WORLD);
+        phase[0] = MPI_Wtime();
+
+        ChargeTree ownTree;
+        ownTree.build(mine);
+        phase[1] = MPI_Wtime();
+
+        MultipoleSet far;
+        exchangeEssentialTrees(ownTree, grid, rank, settings.theta, mine, far);
+        phase[2] = MPI_Wtime();
+
+        ChargeTree localTree;
+        localTree.build(mine, far);
+        slab.evaluate(localTree, settings.theta, pool);
+        sources[0] = mine.size();
+        sources[1] = far.size();
+        phase[3] = MPI_Wtime();
+    }
+
+    if (!settings.outPath.empty())
+    {
+        writeSlabs(settings.outPath, grid, rank, slab);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    phase[4] = MPI_Wtime();
+
+    // the slowest rank decides every phase
+    double local[5] = {phase[0] - start, phase[1] - phase[0], phase[2] - phase[1], phase[3] - phase[2],
+                       phase[4] - phase[3]};
+    double slowest[5];
+    MPI_Reduce(local, slowest, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    unsigned long sourceSum[2];
+    MPI_Reduce(sources, sourceSum, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        double total = phase[4] - start;
+        const char *mode = settings.direct ? "direct" : "let";
+        printf("%d ranks x %d threads, %dx%dx%d grid, %s\n", ranks, pool.size(), grid.dims.x, grid.dims.y,
+               grid.dims.z, mode);
+        printf("distribute %.3fs | tree %.3fs | exchange %.3fs | evaluate %.3fs | write %.3fs | total %.3fs\n",
+               slowest[0], slowest[1], slowest[2], slowest[3], slowest[4], total);
+        printf("sources per rank: %lu charges, %lu multipoles\n", sourceSum[0] / ranks, sourceSum[1] / ranks);
+        printf("csv,%s,%d,%d,%d,%d,%d,%.6f,%.6f\n", mode, ranks, pool.size(), grid.dims.x, grid.dims.z,
+               settings.weak ? 1 : 0, slowest[3], total);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# strong and weak scaling of build/fieldMpi (make fieldmpi) for 1, 2, 4 ... ranks.
+# strong keeps the problem fixed, weak grows the grid and charges with the ranks.
+#
+#   tools/scaling.sh 8 --random 200000 --grid 96
+#
+# MPIRUN overrides the launcher, e.g. MPIRUN="mpirun --oversubscribe" on one machine
+
+MAX_RANKS=${1:-4}
+[ $# -gt 0 ] && shift
+MPIRUN=${MPIRUN:-mpirun}
+BIN=${BIN:-build/fieldMpi}
+
+table()
+{
+    # csv,mode,ranks,threads,grid,depth,weak,evaluate,total
+    awk -F, -v weak="$1" '
+        NR == 1 { base = $9 }
+        {
+            speedup = base / $9
+            efficiency = weak ? speedup : speedup / $3
+            printf "%6d %10.3f %10.3f %9.2f %9.0f%%\n", $3, $8, $9, weak ? $3 * speedup : speedup, 100 * efficiency
+        }'
+}
+
+for mode in strong weak; do
+    echo "$mode scaling"
+    echo " ranks   evaluate      total   speedup efficiency"
+    n=1
+    while [ "$n" -le "$MAX_RANKS" ]; do
+        if [ "$mode" = weak ]; then
+            $MPIRUN -n "$n" "$BIN" --threads 1 --weak "$@" | grep '^csv,'
+        else
+            $MPIRUN -n "$n" "$BIN" --threads 1 "$@" | grep '^csv,'
+        fi
+        n=$((n * 2))
+    done | table "$([ "$mode" = weak ] && echo 1 || echo 0)"
+    echo
+done